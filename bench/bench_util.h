@@ -0,0 +1,79 @@
+// Shared by the microbenchmarks: timing loops, heap allocation counting and
+// results as a table or, with --json, as one JSON metric per line for
+// scripts/bench.sh to collect. Include from exactly one file per binary;
+// it replaces the global operator new.
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+static std::atomic<unsigned long> allocations{0};
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+struct Result {
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+template <typename F>
+static Result measure(unsigned long iterations, F body) {
+    unsigned long before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++) {
+        body(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    Result r;
+    r.ns_per_op = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+    r.allocs_per_op = static_cast<double>(allocations.load() - before) / iterations;
+    return r;
+}
+
+// Command line shared by the benchmarks: [ITERATIONS] [--json]
+struct BenchOptions {
+    unsigned long iterations;
+    bool json = false;
+
+    BenchOptions(int argc, char** argv, unsigned long default_iterations) : iterations(default_iterations) {
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--json") == 0) json = true;
+            else iterations = strtoul(argv[i], nullptr, 10);
+        }
+        if (iterations == 0) iterations = 1;
+    }
+};
+
+// One metric line; `better` is "lower" or "higher"
+static inline void json_metric(const char* name, double value, const char* unit, const char* better) {
+    printf("{\"metric\": \"%s\", \"value\": %.6g, \"unit\": \"%s\", \"better\": \"%s\"}\n", name, value, unit, better);
+}
+
+// `label` for the table, `metric` (a dotted name) for JSON
+static inline void report(const BenchOptions& options, const char* label, const char* metric, const Result& r) {
+    if (!options.json) {
+        printf("%-34s %10.1f ns/op %8.2f allocs/op\n", label, r.ns_per_op, r.allocs_per_op);
+        return;
+    }
+    char name[128];
+    snprintf(name, sizeof(name), "%s.ns_per_op", metric);
+    json_metric(name, r.ns_per_op, "ns", "lower");
+    snprintf(name, sizeof(name), "%s.allocs_per_op", metric);
+    json_metric(name, r.allocs_per_op, "allocs", "lower");
+}
+
+#endif
@@ -0,0 +1,77 @@
+// Microbenchmark for the per-sample path from a raw HX711 count to the
+// numbers a Sample carries: the fixed point conversion to grams and
+// ounces, the default filter chain, and the stability and flow statistics
+// measurement_thread runs on every conversion. The conversion itself must
+// not allocate; the median stage's multisets allocate a node per sample,
+// which bench/thresholds.conf holds to its current two.
+//
+// Build and run with: make bench (or build/convert_bench [ITERATIONS] [--json])
+
+#include <cmath>
+#include <memory>
+#include "scale.h"
+#include "filters.h"
+#include "stability.h"
+#include "flow_rate.h"
+#include "bench_util.h"
+
+// A pour: 80 SPS, ramping up 2 g per sample with a few counts of noise
+static long raw_at(unsigned long i) {
+    static const long noise[8] = { 3, -5, 1, 7, -2, -6, 4, 0 };
+    return 50000 - static_cast<long>(i % 4096) * 2200 + noise[i % 8];
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options(argc, argv, 2000000);
+    unsigned long iterations = options.iterations;
+
+    Scale scale(nullptr);
+    scale.set_scale(-1100.0);
+    scale.set_offset(to_fixed(50088.2));
+
+    fixed_t sink = 0;
+    Result toUnits = measure(iterations, [&](unsigned long i) {
+        sink += scale.to_units(raw_at(i));
+    });
+
+    Result toOunces = measure(iterations, [&](unsigned long i) {
+        sink += convert_units<GramsToOunces>(scale.to_units(raw_at(i)));
+    });
+
+    std::string error;
+    std::unique_ptr<FilterChain> chain(build_filter_chain(DEFAULT_FILTER_CHAIN, &error));
+    if (chain == nullptr) {
+        fprintf(stderr, "default filter chain: %s\n", error.c_str());
+        return 1;
+    }
+    Result filter = measure(iterations, [&](unsigned long i) {
+        sink += chain->update(scale.to_units(raw_at(i)), i * 12500);
+    });
+
+    // Everything process_sample computes from the count, minus the I/O
+    StabilityDetector stability;
+    FlowEstimator flow;
+    Result pipeline = measure(iterations, [&](unsigned long i) {
+        uint64_t timestamp_us = i * 12500;
+        fixed_t grams = chain->update(scale.to_units(raw_at(i)), timestamp_us);
+        double net = from_fixed(grams);
+        stability.update(net, timestamp_us, static_cast<int64_t>(timestamp_us / 1000));
+        flow.update(net, timestamp_us);
+        FillPrediction fill = predict_fill(flow, 500.0, 0.25);
+        sink += convert_units<GramsToOunces>(grams) + to_fixed(flow.rate()) + to_fixed(fill.cutoff_g);
+    });
+
+    if (!options.json) {
+        printf("%lu iterations (checksum %lld)\n", iterations, static_cast<long long>(sink));
+    }
+    report(options, "convert: raw to grams", "convert.to_units", toUnits);
+    report(options, "convert: raw to ounces", "convert.to_ounces", toOunces);
+    report(options, "filter: " DEFAULT_FILTER_CHAIN, "convert.filter_chain", filter);
+    report(options, "sample: filter, settle, flow", "convert.pipeline", pipeline);
+
+    if (toUnits.allocs_per_op != 0 || toOunces.allocs_per_op != 0) {
+        fprintf(stderr, "FAIL: raw to units conversion allocated\n");
+        return 1;
+    }
+    return 0;
+}
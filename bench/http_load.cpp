@@ -0,0 +1,377 @@
+// End-to-end load generator for a running server, normally the `make sim`
+// build on a simulated sensor (scripts/bench.sh starts one). Unlike wrk it
+// also holds Server-Sent Event streams open and measures how far behind
+// the samples arrive, which is what the dashboards notice first.
+//
+//   pollers    keep-alive connections requesting --path back to back;
+//              reports requests/s and latency percentiles
+//   streamers  connections on --stream-path reading events for the whole
+//              run; reports events/s and lag (arrival time minus the
+//              sample's timestamp_ms, both wall clock, so run it on the
+//              same host as the server)
+//
+// Usage:
+//   build/http_load [--host=127.0.0.1] [--port=8080] [--pollers=16]
+//                   [--streamers=4] [--duration=10] [--path=/api/measurements]
+//                   [--stream-path=/api/stream] [--json]
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench_util.h"
+
+#define LOAD_READ_BUFFER 16384
+#define LOAD_IO_TIMEOUT_S 5           // a stalled server counts as an error, not a hang
+#define LOAD_RECONNECT_PAUSE_MS 100
+
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    unsigned pollers = 16;
+    unsigned streamers = 4;
+    unsigned duration_s = 10;
+    std::string path = "/api/measurements";
+    std::string streamPath = "/api/stream";
+    bool json = false;
+};
+
+struct WorkerStats {
+    std::vector<uint32_t> latencies_us;  // pollers: per request
+    std::vector<int64_t> lags_ms;        // streamers: per event
+    uint64_t completed = 0;
+    uint64_t errors = 0;
+};
+
+static std::atomic<bool> stopping{false};
+
+static int64_t wall_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static int connect_to(const LoadOptions& options) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    std::string port = std::to_string(options.port);
+    if (getaddrinfo(options.host.c_str(), port.c_str(), &hints, &found) != 0) return -1;
+
+    int fd = -1;
+    for (addrinfo* a = found; a != nullptr && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0) return -1;
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    timeval timeout = { LOAD_IO_TIMEOUT_S, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+static bool send_all(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads one HTTP response from a connection, headers first, then a body
+// framed by Content-Length or chunked transfer coding. Bytes beyond the
+// response stay buffered for the next one.
+class ResponseReader {
+public:
+    explicit ResponseReader(int fd) : fd(fd) {}
+
+    // Status code, or -1 once the connection fails
+    int read_headers(bool* chunked, long* length, bool* close) {
+        size_t end;
+        while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) return -1;
+        }
+        std::string headers = buffer.substr(0, end);
+        buffer.erase(0, end + 4);
+        std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+
+        int status = -1;
+        if (sscanf(headers.c_str(), "http/1.%*d %d", &status) != 1) return -1;
+        *chunked = headers.find("transfer-encoding: chunked") != std::string::npos;
+        *close = headers.find("connection: close") != std::string::npos;
+        *length = -1;
+        size_t at = headers.find("content-length:");
+        if (at != std::string::npos) *length = strtol(headers.c_str() + at + 15, nullptr, 10);
+        return status;
+    }
+
+    // Body bytes as they arrive; false at the end of the body or on error
+    // (`failed` tells them apart)
+    bool read_body(bool chunked, long* remaining, std::string* out) {
+        out->clear();
+        if (!chunked) {
+            if (*remaining == 0) return false;
+            if (buffer.empty() && !fill()) return false;
+            size_t n = buffer.size();
+            if (*remaining > 0) n = std::min(n, static_cast<size_t>(*remaining));
+            out->assign(buffer, 0, n);
+            buffer.erase(0, n);
+            if (*remaining > 0) *remaining -= static_cast<long>(n);
+            return true;
+        }
+        if (*remaining == -2) return false;
+        if (*remaining <= 0) {
+            // Next chunk size line; the CRLF ending the previous chunk first
+            if (*remaining == 0 && !consume_line(nullptr)) return false;
+            std::string line;
+            if (!consume_line(&line)) return false;
+            *remaining = strtol(line.c_str(), nullptr, 16);
+            if (*remaining == 0) {
+                consume_line(nullptr);  // the empty trailer
+                *remaining = -2;        // finished
+                return false;
+            }
+        }
+        if (buffer.empty() && !fill()) return false;
+        size_t n = std::min(buffer.size(), static_cast<size_t>(*remaining));
+        out->assign(buffer, 0, n);
+        buffer.erase(0, n);
+        *remaining -= static_cast<long>(n);
+        return true;
+    }
+
+    bool failed = false;
+    bool received = false;  // any bytes at all on this connection
+
+private:
+    bool fill() {
+        char chunk[LOAD_READ_BUFFER];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            failed = true;
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+        received = true;
+        return true;
+    }
+
+    bool consume_line(std::string* line) {
+        size_t end;
+        while ((end = buffer.find("\r\n")) == std::string::npos) {
+            if (!fill()) return false;
+        }
+        if (line != nullptr) line->assign(buffer, 0, end);
+        buffer.erase(0, end + 2);
+        return true;
+    }
+
+    int fd;
+    std::string buffer;
+};
+
+static void run_poller(const LoadOptions& options, WorkerStats* stats) {
+    std::string request = "GET " + options.path + " HTTP/1.1\r\nHost: " + options.host +
+                          "\r\nConnection: keep-alive\r\n\r\n";
+    while (!stopping) {
+        int fd = connect_to(options);
+        if (fd < 0) {
+            stats->errors++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(LOAD_RECONNECT_PAUSE_MS));
+            continue;
+        }
+        // A keep-alive connection the server closes between two requests
+        // is reopened, as a browser would; failing anywhere else is an error
+        ResponseReader reader(fd);
+        std::string body;
+        bool failed = false, closing = false;
+        while (!stopping && !closing) {
+            auto start = std::chrono::steady_clock::now();
+            bool chunked;
+            long remaining;
+            int status = send_all(fd, request) ? reader.read_headers(&chunked, &remaining, &closing) : -1;
+            if (status < 0) {
+                failed = reader.received || stats->completed == 0;
+                break;
+            }
+            if (chunked) remaining = -1;
+            while (reader.read_body(chunked, &remaining, &body)) {
+            }
+            if (reader.failed && (chunked || remaining > 0)) {
+                failed = true;
+                break;
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            if (status != 200) {
+                stats->errors++;
+                continue;
+            }
+            stats->completed++;
+            stats->latencies_us.push_back(static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+        }
+        if (failed && !stopping) stats->errors++;
+        close(fd);
+    }
+}
+
+static void run_streamer(const LoadOptions& options, WorkerStats* stats) {
+    std::string request = "GET " + options.streamPath + " HTTP/1.1\r\nHost: " + options.host +
+                          "\r\nAccept: text/event-stream\r\n\r\n";
+    while (!stopping) {
+        int fd = connect_to(options);
+        if (fd < 0 || !send_all(fd, request)) {
+            stats->errors++;
+            if (fd >= 0) close(fd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(LOAD_RECONNECT_PAUSE_MS));
+            continue;
+        }
+        ResponseReader reader(fd);
+        bool chunked, closing;
+        long remaining;
+        int status = reader.read_headers(&chunked, &remaining, &closing);
+        if (chunked) remaining = -1;
+        std::string body, pending;
+        while (status == 200 && !stopping && reader.read_body(chunked, &remaining, &body)) {
+            pending += body;
+            size_t end;
+            while ((end = pending.find('\n')) != std::string::npos) {
+                if (pending.compare(0, 5, "data:") == 0) {
+                    size_t at = pending.find("\"timestamp_ms\":");
+                    if (at < end) {
+                        int64_t timestamp = strtoll(pending.c_str() + at + 15, nullptr, 10);
+                        stats->lags_ms.push_back(wall_ms() - timestamp);
+                        stats->completed++;
+                    }
+                }
+                pending.erase(0, end + 1);
+            }
+        }
+        if (!stopping) {
+            stats->errors++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(LOAD_RECONNECT_PAUSE_MS));
+        }
+        close(fd);
+    }
+}
+
+template <typename T>
+static double percentile(std::vector<T>& values, double p) {
+    if (values.empty()) return 0;
+    size_t at = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + at, values.end());
+    return static_cast<double>(values[at]);
+}
+
+static bool parse_option(const char* arg, const char* name, std::string* value) {
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=') return false;
+    *value = arg + length + 1;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    LoadOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string value;
+        if (strcmp(argv[i], "--json") == 0) options.json = true;
+        else if (parse_option(argv[i], "--host", &value)) options.host = value;
+        else if (parse_option(argv[i], "--port", &value)) options.port = atoi(value.c_str());
+        else if (parse_option(argv[i], "--pollers", &value)) options.pollers = strtoul(value.c_str(), nullptr, 10);
+        else if (parse_option(argv[i], "--streamers", &value)) options.streamers = strtoul(value.c_str(), nullptr, 10);
+        else if (parse_option(argv[i], "--duration", &value)) options.duration_s = strtoul(value.c_str(), nullptr, 10);
+        else if (parse_option(argv[i], "--path", &value)) options.path = value;
+        else if (parse_option(argv[i], "--stream-path", &value)) options.streamPath = value;
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (options.duration_s == 0 || options.pollers + options.streamers == 0) {
+        fprintf(stderr, "Nothing to do: need a duration and at least one poller or streamer\n");
+        return 2;
+    }
+
+    std::vector<WorkerStats> pollStats(options.pollers), streamStats(options.streamers);
+    std::vector<std::thread> workers;
+    for (auto& stats : pollStats) workers.emplace_back(run_poller, std::cref(options), &stats);
+    for (auto& stats : streamStats) workers.emplace_back(run_streamer, std::cref(options), &stats);
+
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(options.duration_s));
+    stopping = true;
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // Streamers notice at their next event, or at the I/O timeout on a
+    // stream that went quiet
+    for (auto& worker : workers) worker.join();
+
+    WorkerStats polls, streams;
+    for (auto& stats : pollStats) {
+        polls.completed += stats.completed;
+        polls.errors += stats.errors;
+        polls.latencies_us.insert(polls.latencies_us.end(), stats.latencies_us.begin(), stats.latencies_us.end());
+    }
+    for (auto& stats : streamStats) {
+        streams.completed += stats.completed;
+        streams.errors += stats.errors;
+        streams.lags_ms.insert(streams.lags_ms.end(), stats.lags_ms.begin(), stats.lags_ms.end());
+    }
+
+    double rps = polls.completed / elapsed_s;
+    double p50 = percentile(polls.latencies_us, 0.50);
+    double p90 = percentile(polls.latencies_us, 0.90);
+    double p99 = percentile(polls.latencies_us, 0.99);
+    double pmax = polls.latencies_us.empty() ? 0 : *std::max_element(polls.latencies_us.begin(), polls.latencies_us.end());
+    double eps = streams.completed / elapsed_s;
+    double lag50 = percentile(streams.lags_ms, 0.50);
+    double lag99 = percentile(streams.lags_ms, 0.99);
+
+    if (!options.json) {
+        printf("%.1f s against %s:%d\n", elapsed_s, options.host.c_str(), options.port);
+        if (options.pollers > 0) {
+            printf("poll   %-24s %4u conns %10.0f req/s  p50 %6.0f us  p90 %6.0f us  p99 %6.0f us  max %7.0f us  %llu errors\n",
+                   options.path.c_str(), options.pollers, rps, p50, p90, p99, pmax,
+                   static_cast<unsigned long long>(polls.errors));
+        }
+        if (options.streamers > 0) {
+            printf("stream %-24s %4u conns %10.0f ev/s   lag p50 %4.0f ms  p99 %4.0f ms  %llu errors\n",
+                   options.streamPath.c_str(), options.streamers, eps, lag50, lag99,
+                   static_cast<unsigned long long>(streams.errors));
+        }
+        return 0;
+    }
+    if (options.pollers > 0) {
+        json_metric("http.poll.requests_per_sec", rps, "req/s", "higher");
+        json_metric("http.poll.latency_p50_us", p50, "us", "lower");
+        json_metric("http.poll.latency_p90_us", p90, "us", "lower");
+        json_metric("http.poll.latency_p99_us", p99, "us", "lower");
+        json_metric("http.poll.latency_max_us", pmax, "us", "lower");
+        json_metric("http.poll.errors", static_cast<double>(polls.errors), "count", "lower");
+    }
+    if (options.streamers > 0) {
+        json_metric("http.stream.events_per_sec", eps, "events/s", "higher");
+        json_metric("http.stream.lag_p50_ms", lag50, "ms", "lower");
+        json_metric("http.stream.lag_p99_ms", lag99, "ms", "lower");
+        json_metric("http.stream.errors", static_cast<double>(streams.errors), "count", "lower");
+    }
+    return 0;
+}
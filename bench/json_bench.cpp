@@ -0,0 +1,125 @@
+// Microbenchmark for the /api/measurements hot path.
+//
+// Compares the old per-request stringstream rendering with the to_chars
+// renderer the measurement thread now runs once per sample, and drives
+// ResponseCache::serve() against stubbed libmicrohttpd entry points to show
+// that serving a cached body makes no heap allocations. Every operator new
+// in the process is counted.
+//
+// Build and run with: make bench (or build/json_bench [ITERATIONS] [--json])
+
+#include <sstream>
+#include <string>
+#include "sample_json.h"
+#include "response_cache.h"
+#include "bench_util.h"
+
+// ---- libmicrohttpd stand-ins: just enough for ResponseCache ----
+struct MHD_Response { MHD_ContentReaderFreeCallback release; void* body; };
+static const char* clientEtag = nullptr;  // what the fake client sends as If-None-Match
+static char lastEtag[64];                  // last ETag the cache attached
+static unsigned long responsesQueued = 0;
+static unsigned long notModifiedQueued = 0;
+
+extern "C" {
+struct MHD_Response* MHD_create_response_from_buffer(size_t, void*, enum MHD_ResponseMemoryMode) {
+    return static_cast<MHD_Response*>(calloc(1, sizeof(MHD_Response)));
+}
+struct MHD_Response* MHD_create_response_from_buffer_with_free_callback(size_t, void* body, MHD_ContentReaderFreeCallback release) {
+    MHD_Response* r = static_cast<MHD_Response*>(calloc(1, sizeof(MHD_Response)));
+    r->release = release;
+    r->body = body;
+    return r;
+}
+MHD_Result MHD_add_response_header(struct MHD_Response*, const char* name, const char* value) {
+    if (strcmp(name, "ETag") == 0) snprintf(lastEtag, sizeof(lastEtag), "%s", value);
+    return MHD_YES;
+}
+void MHD_destroy_response(struct MHD_Response* r) {
+    if (r->release != nullptr) r->release(r->body);
+    free(r);
+}
+MHD_Result MHD_queue_response(struct MHD_Connection*, unsigned int status, struct MHD_Response*) {
+    responsesQueued++;
+    if (status == MHD_HTTP_NOT_MODIFIED) notModifiedQueued++;
+    return MHD_YES;
+}
+const char* MHD_lookup_connection_value(struct MHD_Connection*, enum MHD_ValueKind, const char*) {
+    return clientEtag;
+}
+}
+
+// The formatting /api/measurements did per request before the cache, on
+// the float weights samples had then
+static const float oldGramsToFluidOunces = 0.03527396;
+static std::string render_with_stringstream(const Sample& s) {
+    float weight = from_fixed(s.weight_g), container = from_fixed(s.container_g), net = from_fixed(s.net_g);
+    std::stringstream ss;
+    ss << "{";
+    ss << "\"measured_weight_g\": " << weight << ",";
+    ss << "\"measured_weight_oz\": " << (weight * oldGramsToFluidOunces) << ",";
+    ss << "\"container_weight_g\": " << container << ",";
+    ss << "\"container_weight_oz\": " << (container * oldGramsToFluidOunces) << ",";
+    ss << "\"fluid_weight_g\": " << net << ",";
+    ss << "\"fluid_weight_oz\": " << (net * oldGramsToFluidOunces);
+    ss << "}";
+    return ss.str();
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options(argc, argv, 1000000);
+    unsigned long iterations = options.iterations;
+
+    Sample sample = Sample();
+    sample.wall_ms = 1700000000000LL;
+    sample.weight_g = to_fixed(512.25);
+    sample.container_g = to_fixed(120.5);
+    sample.net_g = sample.weight_g - sample.container_g;
+
+    size_t sink = 0;
+    Result oldRender = measure(iterations, [&](unsigned long i) {
+        sample.weight_g += to_fixed(0.01);
+        sink += render_with_stringstream(sample).size();
+    });
+
+    char buf[SAMPLE_JSON_MAX];
+    Result newRender = measure(iterations, [&](unsigned long i) {
+        sample.weight_g += to_fixed(0.01);
+        sink += render_sample_json(sample, buf, sizeof(buf));
+    });
+
+    // One update per 100 requests, roughly a 10 SPS sensor polled at 1 kHz
+    ResponseCache cache("application/json");
+    struct MHD_Connection* connection = nullptr;
+    Result serve = measure(iterations, [&](unsigned long i) {
+        if (i % 100 == 0) {
+            unsigned long before = allocations.load();
+            char* body = cache.begin_update();
+            if (body != nullptr) {
+                cache.commit_update(i + 1, render_sample_json(sample, body, cache.body_max()));
+            }
+            allocations = before;  // producer side; only requests are measured
+        }
+        cache.serve(connection);
+    });
+
+    clientEtag = lastEtag;
+    Result notModified = measure(iterations, [&](unsigned long) {
+        cache.serve(connection);
+    });
+
+    if (!options.json) {
+        printf("%lu iterations (checksum %zu, %lu responses queued, %lu of them 304)\n",
+               iterations, sink, responsesQueued, notModifiedQueued);
+    }
+    report(options, "render: stringstream (old)", "json.render_stringstream", oldRender);
+    report(options, "render: to_chars", "json.render_to_chars", newRender);
+    report(options, "serve: cached 200", "json.serve_cached", serve);
+    report(options, "serve: If-None-Match", "json.serve_not_modified", notModified);
+
+    if (newRender.allocs_per_op != 0 || serve.allocs_per_op != 0 || notModified.allocs_per_op != 0) {
+        fprintf(stderr, "FAIL: request hot path allocated\n");
+        return 1;
+    }
+    return 0;
+}
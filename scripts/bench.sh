@@ -0,0 +1,143 @@
+#!/bin/bash
+#
+# Run the benchmark suite and check it for regressions; `make bench` builds
+# everything and runs this.
+#
+# The suite is the microbenchmarks (JSON rendering and caching as done in
+# handle_request, raw count to units conversion and the per-sample filter
+# path) and an end-to-end run of build/http_load against the simulator
+# build of the server, with pollers on /api/measurements and streamers on
+# /api/stream. Every metric goes into one JSON report together with the
+# git revision it was measured on:
+#
+#   {"revision": "...", "describe": "...", "date": "...", "host": "...",
+#    "settings": {...}, "metrics": {"json.serve_cached.ns_per_op":
+#    {"value": 41.2, "unit": "ns", "better": "lower"}, ...}}
+#
+# written to $RESULTS_DIR/<date>-<revision>.json and copied to
+# $RESULTS_DIR/latest.json. scripts/bench_check.py then compares it with
+# the limits in bench/thresholds.conf and, when $BASELINE names an earlier
+# report, with that report; the script exits non-zero on a regression.
+#
+# Usage:
+#   scripts/bench.sh [extra server args...]
+#
+# Environment:
+#   SERVER       server binary                        (default build/sim/fluid_measurement_server)
+#   SENSOR       simulated sensor for the server      (default sim:pour:80)
+#   PORT         port the server is started on        (default 18090)
+#   POLLERS      concurrent polling connections       (default 16)
+#   STREAMERS    concurrent SSE connections           (default 4)
+#   DURATION     load run time in seconds             (default 10)
+#   ITERATIONS   microbenchmark iterations            (default: each bench's own)
+#   RESULTS_DIR  where reports are written            (default bench/results)
+#   THRESHOLDS   absolute limits                      (default bench/thresholds.conf)
+#   BASELINE     earlier report to compare against   (default: none)
+#   TOLERANCE    allowed relative regression vs the baseline, percent (default 15)
+#
+# Numbers from different machines are not comparable; keep baselines per
+# host (the report records it). Stop the installed service first so it
+# does not compete for the CPU.
+
+BUILD_DIR=${BUILD_DIR:-build}
+SERVER=${SERVER:-$BUILD_DIR/sim/fluid_measurement_server}
+SENSOR=${SENSOR:-sim:pour:80}
+PORT=${PORT:-18090}
+POLLERS=${POLLERS:-16}
+STREAMERS=${STREAMERS:-4}
+DURATION=${DURATION:-10}
+ITERATIONS=${ITERATIONS:-}
+RESULTS_DIR=${RESULTS_DIR:-bench/results}
+THRESHOLDS=${THRESHOLDS:-bench/thresholds.conf}
+BASELINE=${BASELINE:-}
+TOLERANCE=${TOLERANCE:-15}
+
+for binary in "$BUILD_DIR/json_bench" "$BUILD_DIR/convert_bench" "$BUILD_DIR/http_load" "$SERVER"; do
+    if [ ! -x "$binary" ]; then
+        echo "$binary not found; run make bench" >&2
+        exit 1
+    fi
+done
+
+metrics=$(mktemp)
+server_log=$(mktemp)
+server_pid=
+cleanup() {
+    if [ -n "$server_pid" ]; then
+        kill "$server_pid" 2> /dev/null
+        wait "$server_pid" 2> /dev/null
+    fi
+    rm -f "$metrics" "$server_log"
+}
+trap cleanup EXIT
+
+echo "Microbenchmarks"
+for bench in json_bench convert_bench; do
+    "$BUILD_DIR/$bench" $ITERATIONS
+    "$BUILD_DIR/$bench" $ITERATIONS --json >> "$metrics" || exit 1
+done
+
+# No history, calibration or web files: the run must not touch the
+# installed ones, and a cold start keeps runs comparable
+"$SERVER" --config=/dev/null --port="$PORT" --sensor="$SENSOR" --history_file= \
+    --calibration_file="$(mktemp -u)" --web_root= "$@" > "$server_log" 2>&1 &
+server_pid=$!
+
+# Wait for the first sample, up to ~20 s (tare takes a moment); until then
+# /api/measurements answers 503
+up=
+for _ in $(seq 1 100); do
+    if curl -sf -o /dev/null "http://127.0.0.1:$PORT/api/measurements"; then
+        up=1
+        break
+    fi
+    sleep 0.2
+done
+if [ -z "$up" ]; then
+    echo "Server did not come up:" >&2
+    cat "$server_log" >&2
+    exit 1
+fi
+
+echo
+echo "HTTP load: $POLLERS pollers, $STREAMERS streamers, ${DURATION}s on $SENSOR"
+load_args=(--port="$PORT" --pollers="$POLLERS" --streamers="$STREAMERS" --duration="$DURATION")
+"$BUILD_DIR/http_load" "${load_args[@]}" --json >> "$metrics" || exit 1
+grep '"http\.' "$metrics" | sed 's/{"metric": "\([^"]*\)", "value": \([^,]*\), "unit": "\([^"]*\)".*/  \1 \2 \3/'
+
+kill "$server_pid"
+wait "$server_pid" 2> /dev/null
+server_pid=
+
+date=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+revision=$(git rev-parse HEAD 2> /dev/null || echo unknown)
+describe=$(git describe --always --dirty 2> /dev/null || echo unknown)
+mkdir -p "$RESULTS_DIR"
+report="$RESULTS_DIR/$(date -u +%Y%m%d-%H%M%S)-$describe.json"
+
+python3 - "$metrics" > "$report" <<EOF || exit 1
+import json, sys
+metrics = {}
+for line in open(sys.argv[1]):
+    if line.strip():
+        m = json.loads(line)
+        metrics[m.pop("metric")] = m
+print(json.dumps({
+    "revision": "$revision",
+    "describe": "$describe",
+    "date": "$date",
+    "host": "$(hostname)",
+    "settings": {"sensor": "$SENSOR", "pollers": $POLLERS, "streamers": $STREAMERS,
+                 "duration_s": $DURATION, "server_args": "$*"},
+    "metrics": metrics,
+}, indent=2, sort_keys=True))
+EOF
+cp "$report" "$RESULTS_DIR/latest.json"
+echo
+echo "Report: $report"
+
+check_args=("$report" --thresholds="$THRESHOLDS" --tolerance="$TOLERANCE")
+if [ -n "$BASELINE" ]; then
+    check_args+=(--baseline="$BASELINE")
+fi
+python3 scripts/bench_check.py "${check_args[@]}"
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+#
+# Check a report from scripts/bench.sh for regressions:
+#
+#   scripts/bench_check.py REPORT [--thresholds=FILE] [--baseline=REPORT] [--tolerance=PERCENT]
+#
+# Thresholds are absolute limits, one per line ("metric max|min value",
+# # for comments), for what must hold on any machine: no allocations on
+# the hot paths, no HTTP errors, streams keeping up. A baseline is an
+# earlier report from the same machine; every metric both reports have
+# may be at most PERCENT worse than it was, in the direction its "better"
+# field gives. Prints one line per failed check and exits 1 if any failed.
+
+import json
+import sys
+
+
+def load_thresholds(path):
+    limits = []
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            parts = line.split()
+            if len(parts) != 3 or parts[1] not in ("max", "min"):
+                sys.exit("%s:%d: expected 'metric max|min value'" % (path, number))
+            limits.append((parts[0], parts[1], float(parts[2])))
+    return limits
+
+
+def main():
+    args = [a for a in sys.argv[1:] if not a.startswith("--")]
+    options = dict(a[2:].split("=", 1) for a in sys.argv[1:] if a.startswith("--") and "=" in a)
+    if len(args) != 1:
+        sys.exit("usage: bench_check.py REPORT [--thresholds=FILE] [--baseline=REPORT] [--tolerance=PERCENT]")
+
+    with open(args[0]) as f:
+        metrics = json.load(f)["metrics"]
+    failures = []
+    checked = 0
+
+    if options.get("thresholds"):
+        for name, kind, limit in load_thresholds(options["thresholds"]):
+            if name not in metrics:
+                failures.append("%s: missing from the report" % name)
+                continue
+            value = metrics[name]["value"]
+            checked += 1
+            if (kind == "max" and value > limit) or (kind == "min" and value < limit):
+                failures.append("%s: %g %s, limit %s %g" % (name, value, metrics[name]["unit"], kind, limit))
+
+    if options.get("baseline"):
+        with open(options["baseline"]) as f:
+            baseline = json.load(f)
+        tolerance = float(options.get("tolerance", 15)) / 100
+        for name, before in sorted(baseline["metrics"].items()):
+            if name not in metrics:
+                continue
+            was, now = before["value"], metrics[name]["value"]
+            checked += 1
+            # Counts that were zero (allocations, errors) must stay zero;
+            # the thresholds say so more clearly, this only catches new ones
+            if before["better"] == "lower":
+                worse = now > was * (1 + tolerance) if was > 0 else now > 0
+            else:
+                worse = now < was * (1 - tolerance)
+            if worse:
+                change = (now - was) / was * 100 if was else float("inf")
+                failures.append("%s: %g %s, was %g at %s (%+.0f%%)" % (
+                    name, now, metrics[name]["unit"], was, baseline.get("describe", "baseline"), change))
+
+    for failure in failures:
+        print("REGRESSION " + failure)
+    print("%d checks, %d failed" % (checked, len(failures)))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+#
+# Decode a compressed history export into CSV with the columns and values
+# of /api/history/export?format=csv.
+#
+#   curl -s 'http://fluidscale.local:8080/api/history/export?from=...' > day.fsh
+#   scripts/decode_history_export.py day.fsh > day.csv
+#
+# The format is described in src/history_export.h. Also a reference for
+# reading the export from other languages.
+
+import struct
+import sys
+
+
+class Bits:
+    def __init__(self, data):
+        self.value = int.from_bytes(data, "big")
+        self.left = len(data) * 8
+
+    def read(self, n):
+        self.left -= n
+        return (self.value >> self.left) & ((1 << n) - 1)
+
+    def signed(self, n):
+        v = self.read(n)
+        return v - (1 << n) if v >> (n - 1) else v
+
+
+def decode_delta(bits):
+    # 0, 10 + 7, 110 + 9, 1110 + 12, 11110 + 32, 11111 + 64
+    if bits.read(1) == 0:
+        return 0
+    for width in (7, 9, 12, 32):
+        if bits.read(1) == 0:
+            return bits.signed(width)
+    return bits.signed(64)
+
+
+def decode_floats(bits, count):
+    previous = bits.read(32)
+    values = [previous]
+    leading, trailing = 32, 0
+    for _ in range(count - 1):
+        if bits.read(1) == 0:
+            values.append(previous)
+            continue
+        if bits.read(1) == 1:
+            leading = bits.read(5)
+            trailing = 32 - leading - (bits.read(5) + 1)
+        previous ^= bits.read(32 - leading - trailing) << trailing
+        values.append(previous)
+    return [struct.unpack("<f", struct.pack("<I", v))[0] for v in values]
+
+
+def shortest(value):
+    # Fewest digits that read back to the same 32-bit float
+    for digits in range(1, 10):
+        text = "%.*g" % (digits, value)
+        if struct.unpack("<f", struct.pack("<f", float(text)))[0] == value:
+            return text
+    return repr(value)
+
+
+def decode(data, out):
+    if data[:4] != b"FSH1":
+        raise ValueError("not a history export")
+    pos = 4
+    out.write("timestamp_ms,weight_g,net_g,raw,stable\n")
+    while True:
+        if pos + 4 > len(data):
+            raise ValueError("export cut off")
+        (count,) = struct.unpack_from("<I", data, pos)
+        pos += 4
+        if count == 0:
+            return
+        columns = []
+        for _ in range(5):
+            (length,) = struct.unpack_from("<I", data, pos)
+            columns.append(Bits(data[pos + 4:pos + 4 + length]))
+            pos += 4 + length
+
+        bits = columns[0]
+        timestamps = [bits.signed(64)]
+        delta = 0
+        for _ in range(count - 1):
+            delta += decode_delta(bits)
+            timestamps.append(timestamps[-1] + delta)
+
+        weights = decode_floats(columns[1], count)
+        nets = decode_floats(columns[2], count)
+
+        bits = columns[3]
+        raws = [bits.signed(32)]
+        for _ in range(count - 1):
+            raws.append(raws[-1] + decode_delta(bits))
+
+        bits = columns[4]
+        flags = [bits.read(32)]
+        for _ in range(count - 1):
+            flags.append(bits.read(32) if bits.read(1) else flags[-1])
+
+        for i in range(count):
+            out.write("%d,%s,%s,%d,%d\n" % (timestamps[i], shortest(weights[i]), shortest(nets[i]),
+                                            raws[i], flags[i] & 1))
+
+
+if __name__ == "__main__":
+    with open(sys.argv[1], "rb") if len(sys.argv) > 1 else sys.stdin.buffer as f:
+        decode(f.read(), sys.stdout)
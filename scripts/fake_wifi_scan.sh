@@ -0,0 +1,25 @@
+#!/bin/bash
+#
+# Stand-in for the Wi-Fi scan of the setup portal, for trying the portal
+# without a wireless interface:
+#
+#   wifi_scan_command=scripts/fake_wifi_scan.sh
+#
+# Prints one SSID per line like the default iwlist pipeline, after a delay
+# like a real scan takes. Hidden networks (empty, \x00...) and a duplicate
+# are included so the filtering can be seen to work.
+#
+# Environment:
+#   SCAN_DELAY   seconds the scan takes                  (default 3)
+#   SCAN_FAIL    exit with this status instead           (default 0)
+
+SCAN_DELAY=${SCAN_DELAY:-3}
+SCAN_FAIL=${SCAN_FAIL:-0}
+
+sleep "$SCAN_DELAY"
+if [ "$SCAN_FAIL" != 0 ]; then
+    echo "fake scan failed" >&2
+    exit "$SCAN_FAIL"
+fi
+
+printf '%s\n' "HomeNetwork" "Kitchen <5G>" "Guest \"Wi-Fi\"" "" '\x00\x00\x00' "HomeNetwork" "Cafe & Bakery"
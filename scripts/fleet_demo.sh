@@ -0,0 +1,58 @@
+#!/bin/bash
+#
+# Run an aggregator over several simulated scales on this machine.
+#
+# Starts $SCALES simulator builds of the server on consecutive ports from
+# $PORT + 1, each pouring into its own simulated container, and an
+# aggregator on $PORT subscribed to all of them, then waits until
+# interrupted. Watch the merged table with
+#
+#   curl http://127.0.0.1:18100/api/fleet
+#   curl -N http://127.0.0.1:18100/api/fleet/stream
+#
+# and stop or restart single scales (their pids are printed) to see them
+# go stale and reconnect.
+#
+# Usage:
+#   scripts/fleet_demo.sh [extra aggregator args...]
+#
+# Environment:
+#   SERVER   server binary                 (default build/sim/fluid_measurement_server)
+#   SCALES   simulated scales to start     (default 3)
+#   SENSOR   simulated sensor per scale    (default sim:pour:80)
+#   PORT     aggregator port               (default 18100)
+
+SERVER=${SERVER:-build/sim/fluid_measurement_server}
+SCALES=${SCALES:-3}
+SENSOR=${SENSOR:-sim:pour:80}
+PORT=${PORT:-18100}
+
+if [ ! -x "$SERVER" ]; then
+    echo "$SERVER not found; run make sim" >&2
+    exit 1
+fi
+
+pids=()
+state=$(mktemp -d)
+cleanup() {
+    kill "${pids[@]}" 2> /dev/null
+    wait 2> /dev/null
+    rm -rf "$state"
+}
+trap cleanup EXIT
+trap exit INT TERM
+
+devices=()
+for i in $(seq 1 "$SCALES"); do
+    port=$((PORT + i))
+    "$SERVER" --config=/dev/null --port="$port" --sensor="$SENSOR" --history_file= \
+        --calibration_file="$state/calibration$i.conf" --web_root= \
+        > "$state/scale$i.log" 2>&1 &
+    pids+=($!)
+    echo "scale$i: port $port, pid $!"
+    devices+=(--fleet.scale$i=127.0.0.1:$port)
+done
+
+"$SERVER" --config=/dev/null --port="$PORT" "${devices[@]}" "$@" &
+pids+=($!)
+wait "${pids[-1]}"
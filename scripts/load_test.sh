@@ -0,0 +1,95 @@
+#!/bin/bash
+#
+# Load test /api/measurements under each web server engine.
+#
+# For every engine (select, poll, epoll, pool) the script starts the server
+# on a spare port, hammers the endpoint with wrk, stops the server again and
+# prints one line per engine:
+#
+#   engine    requests/sec    p50        p99
+#   select    ...             ...        ...
+#
+# The same rows are written as CSV to $RESULTS so runs can be compared.
+#
+# Usage:
+#   scripts/load_test.sh [server-binary] [extra server args...]
+#
+# Environment:
+#   DURATION     wrk run time per engine             (default 30s)
+#   CONNECTIONS  concurrent keep-alive connections   (default 64)
+#   WRK_THREADS  wrk client threads                  (default 2)
+#   THREADS      server threads for the pool engine  (default 4)
+#   PORT         port the server is started on       (default 18080)
+#   ENGINES      engines to test                     (default "select poll epoll pool")
+#   ENDPOINT     path to request                     (default /api/measurements)
+#   RESULTS      CSV output file                     (default load_test_results.csv)
+#
+# Requires wrk (https://github.com/wg/wrk). Stop the installed service first
+# so it does not compete for the HX711 and the CPU:
+#   sudo systemctl stop fluid-measurement.service
+#   sudo scripts/load_test.sh build/fluid_measurement_server
+#
+# Off the Pi, build the server with `make sim` and let it simulate the scale:
+#   scripts/load_test.sh build/sim/fluid_measurement_server --sensor=sim:pour:80
+#
+# Run wrk from another machine on the same network for numbers that include
+# the Wi-Fi link; running it on the Pi itself measures the server alone but
+# the load generator then competes for the same cores.
+
+SERVER=${1:-build/fluid_measurement_server}
+shift
+DURATION=${DURATION:-30s}
+CONNECTIONS=${CONNECTIONS:-64}
+WRK_THREADS=${WRK_THREADS:-2}
+THREADS=${THREADS:-4}
+PORT=${PORT:-18080}
+ENGINES=${ENGINES:-"select poll epoll pool"}
+ENDPOINT=${ENDPOINT:-/api/measurements}
+RESULTS=${RESULTS:-load_test_results.csv}
+
+if ! command -v wrk > /dev/null; then
+    echo "wrk not found; install it first" >&2
+    exit 1
+fi
+if [ ! -x "$SERVER" ]; then
+    echo "Server binary $SERVER not found; run make first" >&2
+    exit 1
+fi
+
+# Wait for the server to answer, up to ~20 s (tare takes a moment)
+wait_for_server() {
+    for _ in $(seq 1 100); do
+        if curl -s -o /dev/null "http://127.0.0.1:$PORT$ENDPOINT"; then
+            return 0
+        fi
+        sleep 0.2
+    done
+    return 1
+}
+
+echo "engine,connections,duration,requests_per_sec,p50,p99" > "$RESULTS"
+printf "%-8s %14s %10s %10s\n" "engine" "requests/sec" "p50" "p99"
+
+for engine in $ENGINES; do
+    "$SERVER" --config=/dev/null --port="$PORT" --engine="$engine" --threads="$THREADS" "$@" > /dev/null 2>&1 &
+    server_pid=$!
+
+    if ! wait_for_server; then
+        echo "$engine: server did not come up" >&2
+        kill "$server_pid" 2> /dev/null
+        wait "$server_pid" 2> /dev/null
+        continue
+    fi
+
+    output=$(wrk --latency -t"$WRK_THREADS" -c"$CONNECTIONS" -d"$DURATION" "http://127.0.0.1:$PORT$ENDPOINT")
+
+    rps=$(echo "$output" | awk '/^Requests\/sec:/ { print $2 }')
+    p50=$(echo "$output" | awk '$1 == "50%" { print $2 }')
+    p99=$(echo "$output" | awk '$1 == "99%" { print $2 }')
+
+    printf "%-8s %14s %10s %10s\n" "$engine" "$rps" "$p50" "$p99"
+    echo "$engine,$CONNECTIONS,$DURATION,$rps,$p50,$p99" >> "$RESULTS"
+
+    kill "$server_pid"
+    wait "$server_pid" 2> /dev/null
+done
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+#
+# Print the telemetry frames a scale sends over UDP, for checking a
+# telemetry=udp://... setup without the SCADA collector:
+#
+#   scripts/telemetry_listen.py 239.255.70.1:5005      # multicast group
+#   scripts/telemetry_listen.py 5005                   # unicast to this box
+#
+# One line per frame: source, device, seq and sample count, then the
+# samples. Both json and binary frames are understood (the binary layout
+# is described in src/telemetry.h). For MQTT use the broker's own tools,
+# e.g. mosquitto_sub -v -t 'fluidscale/#'.
+#
+# Environment:
+#   QUIET   set to print only the frame lines, not the samples
+
+import json
+import os
+import socket
+import struct
+import sys
+
+
+def decode(data):
+    if data[:2] == b"FT" and data[2] == 1:
+        length = data[3]
+        device = data[4:4 + length].decode()
+        seq, count, base = struct.unpack_from("<IHq", data, 4 + length)
+        pos = 4 + length + 14
+        samples = []
+        for _ in range(count):
+            scale, flags, offset, weight, net, flow = struct.unpack_from("<BBIiii", data, pos)
+            pos += 18
+            samples.append([scale, base + offset, weight / 1000, net / 1000, flow / 1000, bool(flags & 1)])
+        return device, seq, samples
+    frame = json.loads(data)
+    return frame["device"], frame["seq"], frame["samples"]
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: telemetry_listen.py [GROUP:]PORT")
+    group, _, port = sys.argv[1].rpartition(":")
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", int(port)))
+    if group:
+        membership = struct.pack("4s4s", socket.inet_aton(group), socket.inet_aton("0.0.0.0"))
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+
+    quiet = bool(os.environ.get("QUIET"))
+    while True:
+        data, source = sock.recvfrom(65536)
+        device, seq, samples = decode(data)
+        print("%s %s seq %d: %d samples, %d bytes" % (source[0], device, seq, len(samples), len(data)), flush=True)
+        if not quiet:
+            for sample in samples:
+                print("    %s" % sample, flush=True)
+
+
+if __name__ == "__main__":
+    main()
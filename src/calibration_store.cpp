@@ -0,0 +1,161 @@
+#include "calibration_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+
+// Fields of one entry, as bits, to spot incomplete ones
+#define FIELD_OFFSET 1
+#define FIELD_FACTOR 2
+#define FIELD_GAIN 4
+#define FIELD_ALL (FIELD_OFFSET | FIELD_FACTOR | FIELD_GAIN)
+
+bool CalibrationStore::load(const std::string& file, std::string* error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    path = file;
+    entries.clear();
+
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        return true;
+    }
+    std::map<std::string, Calibration> loaded;
+    if (!parse(in, loaded, error)) {
+        // The next save would replace the file with only what it knows,
+        // so keep what could not be read for a person to look at
+        std::string aside = path + ".bad";
+        if (rename(path.c_str(), aside.c_str()) == 0) *error += " (moved to " + aside + ")";
+        return false;
+    }
+    entries.swap(loaded);
+    return true;
+}
+
+bool CalibrationStore::parse(std::istream& in, std::map<std::string, Calibration>& out,
+                             std::string* error) const {
+    std::map<std::string, int> seen;
+    std::string line;
+    for (unsigned number = 1; std::getline(in, line); number++) {
+        if (line.empty() || line[0] == '#') continue;
+
+        // scale.ID.FIELD=VALUE
+        size_t eq = line.find('=');
+        size_t dot = line.rfind('.', eq);
+        if (line.compare(0, 6, "scale.") != 0 || eq == std::string::npos || dot == std::string::npos || dot <= 6) {
+            *error = path + ":" + std::to_string(number) + ": expected scale.ID.FIELD=VALUE";
+            return false;
+        }
+        std::string id = line.substr(6, dot - 6);
+        std::string field = line.substr(dot + 1, eq - dot - 1);
+        const char* value = line.c_str() + eq + 1;
+        char* end = nullptr;
+        Calibration& entry = out[id];
+        if (field == "offset") {
+            entry.offset = strtod(value, &end);
+            seen[id] |= std::fabs(entry.offset) < 1e15 ? FIELD_OFFSET : 0;
+        } else if (field == "factor") {
+            entry.factor = strtof(value, &end);
+            seen[id] |= entry.factor != 0 && std::isfinite(entry.factor) ? FIELD_FACTOR : 0;
+        } else if (field == "gain") {
+            entry.gain = static_cast<int>(strtol(value, &end, 10));
+            seen[id] |= FIELD_GAIN;
+        } else {
+            *error = path + ":" + std::to_string(number) + ": unknown field '" + field + "'";
+            return false;
+        }
+        if (*value == '\0' || *end != '\0') {
+            *error = path + ":" + std::to_string(number) + ": invalid value";
+            return false;
+        }
+    }
+
+    for (const auto& scale : seen) {
+        if (scale.second != FIELD_ALL) {
+            std::cerr << path << ": incomplete or invalid calibration for scale " << scale.first << ", ignoring it" << std::endl;
+            out.erase(scale.first);
+        }
+    }
+    return true;
+}
+
+bool CalibrationStore::find(const std::string& scaleId, Calibration& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = entries.find(scaleId);
+    if (entry == entries.end()) return false;
+    out = entry->second;
+    return true;
+}
+
+bool CalibrationStore::save(const std::string& scaleId, const Calibration& calibration, std::string* error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[scaleId] = calibration;
+    return write_file(error);
+}
+
+// Write a temporary next to the file, flush it to the card, rename it over
+// the file and flush the directory so the rename itself survives power loss
+bool CalibrationStore::write_file(std::string* error) {
+    if (path.empty()) {
+        *error = "no calibration file configured";
+        return false;
+    }
+
+    std::string contents = "# Written by fluid_measurement_server on every tare and calibration\n";
+    char value[32];
+    for (const auto& entry : entries) {
+        const std::string prefix = "scale." + entry.first;
+        snprintf(value, sizeof(value), "%.10g", entry.second.offset);
+        contents += prefix + ".offset=" + value + "\n";
+        snprintf(value, sizeof(value), "%.9g", entry.second.factor);
+        contents += prefix + ".factor=" + value + "\n";
+        snprintf(value, sizeof(value), "%d", entry.second.gain);
+        contents += prefix + ".gain=" + value + "\n";
+    }
+
+    std::string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        *error = "cannot create " + temporary + ": " + strerror(errno);
+        return false;
+    }
+    const char* data = contents.data();
+    size_t left = contents.size();
+    while (left > 0) {
+        ssize_t written = ::write(fd, data, left);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            *error = "cannot write " + temporary + ": " + strerror(errno);
+            ::close(fd);
+            unlink(temporary.c_str());
+            return false;
+        }
+        data += written;
+        left -= written;
+    }
+    bool flushed = fsync(fd) == 0;
+    if (::close(fd) != 0) flushed = false;
+    if (!flushed) {
+        *error = "cannot flush " + temporary + ": " + strerror(errno);
+        unlink(temporary.c_str());
+        return false;
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        *error = "cannot replace " + path + ": " + strerror(errno);
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        ::close(dirFd);
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef CALIBRATION_STORE_H
+#define CALIBRATION_STORE_H
+
+#include <istream>
+#include <string>
+#include <map>
+#include <mutex>
+
+#define DEFAULT_CALIBRATION_FILE "calibration.conf"
+
+// What it takes to turn a scale's raw counts into grams
+struct Calibration {
+    double offset = 0;  // raw reading with nothing on the scale, averaged
+    float factor = 0;   // raw counts per gram
+    int gain = 128;     // HX711 channel A gain the offset and factor were taken at
+};
+
+// Per-scale calibration kept in a small key=value file, so a restart
+// carries on with the last tare instead of taring whatever is on the
+// scale. Every change rewrites the file through a temporary, fsync and
+// rename, so a crash leaves either the old or the new file, never a torn
+// one. Thread safe.
+class CalibrationStore {
+public:
+    // Read `path`; a missing file is an empty store. Entries missing a field
+    // or with a value out of range (a factor of 0, nan, inf) are skipped
+    // with a warning. A file that cannot be parsed leaves the store empty
+    // and is renamed to `path`.bad.
+    bool load(const std::string& path, std::string* error);
+
+    bool find(const std::string& scaleId, Calibration& out) const;
+
+    // Record `calibration` for the scale and write the file. On failure the
+    // entry is still updated in memory.
+    bool save(const std::string& scaleId, const Calibration& calibration, std::string* error);
+
+private:
+    // Lines of the file into `out`, complete ones only
+    bool parse(std::istream& in, std::map<std::string, Calibration>& out, std::string* error) const;
+    bool write_file(std::string* error);
+
+    std::string path;
+    mutable std::mutex mutex;
+    std::map<std::string, Calibration> entries;
+};
+
+#endif
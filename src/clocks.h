@@ -0,0 +1,33 @@
+#ifndef CLOCKS_H
+#define CLOCKS_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Monotonic clock in microseconds, used to timestamp samples
+inline uint64_t monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Same clock in nanoseconds, for timing short stretches of code
+inline uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Same clock in milliseconds, for timeouts and backoff in event loops
+inline int64_t monotonic_ms() {
+    return static_cast<int64_t>(monotonic_us() / 1000);
+}
+
+// Wall-clock time in milliseconds since the epoch
+inline int64_t wall_clock_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+#endif
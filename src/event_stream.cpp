@@ -0,0 +1,174 @@
+#include "event_stream.h"
+#include "sample_queue.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+
+#define KEEPALIVE_US 15000000ULL  // comment line so proxies keep the socket open
+#define STREAM_BLOCK_SIZE 4096
+
+EventStream::EventStream(const EventSource& src) : source(src) {
+}
+
+EventStream::~EventStream() {
+    stop();
+}
+
+bool EventStream::start() {
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        return false;
+    }
+    running = true;
+    pumpThread = std::thread(&EventStream::pump, this);
+    return true;
+}
+
+void EventStream::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    notify();
+    pumpThread.join();
+    // Resumed subscribers see !running and end their stream
+    resume_all();
+    close(wakeFd);
+    wakeFd = -1;
+}
+
+void EventStream::notify() {
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        // Counter saturated: the pump is already due to wake up
+    }
+}
+
+void EventStream::resume_all() {
+    std::lock_guard<std::mutex> lock(parkedMutex);
+    for (Subscriber* sub : parked) {
+        MHD_resume_connection(sub->connection);
+    }
+    parked.clear();
+}
+
+// Wake suspended subscribers on every notify, and periodically for keepalives
+void EventStream::pump() {
+    struct pollfd pfd;
+    pfd.fd = wakeFd;
+    pfd.events = POLLIN;
+
+    while (running) {
+        int rc = poll(&pfd, 1, KEEPALIVE_US / 1000);
+        if (rc > 0) {
+            uint64_t count;
+            if (read(wakeFd, &count, sizeof(count)) < 0) {
+                // Spurious wakeup; nothing to drain
+            }
+        }
+        resume_all();
+    }
+}
+
+MHD_Result EventStream::open(struct MHD_Connection* connection) {
+    if (!running) {
+        return MHD_NO;
+    }
+
+    Subscriber* sub = new Subscriber;
+    sub->stream = this;
+    sub->connection = connection;
+    sub->lastWriteUs = monotonic_us();
+    sub->sentRetry = false;
+
+    // Start with the current sample, or replay from Last-Event-ID if the
+    // client is reconnecting and we still hold what it missed
+    uint64_t head = source.head();
+    sub->lastSeq = source.subscribe_from();
+    const char* lastId = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Last-Event-ID");
+    if (lastId != nullptr) {
+        uint64_t resumeFrom = strtoull(lastId, nullptr, 10);
+        if (resumeFrom >= source.oldest() && resumeFrom <= head) {
+            sub->lastSeq = resumeFrom;
+        }
+    }
+
+    struct MHD_Response* response = MHD_create_response_from_callback(
+        MHD_SIZE_UNKNOWN, STREAM_BLOCK_SIZE, &EventStream::read_events, sub,
+        &EventStream::close_subscriber);
+    if (response == nullptr) {
+        delete sub;
+        return MHD_NO;
+    }
+    subscribers++;
+
+    MHD_add_response_header(response, "Content-Type", "text/event-stream");
+    MHD_add_response_header(response, "Cache-Control", "no-cache");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    MHD_add_response_header(response, "X-Accel-Buffering", "no");
+    MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// Content reader: emit every event since the subscriber's last one, or
+// suspend the connection until the pump resumes it
+ssize_t EventStream::read_events(void* cls, uint64_t pos, char* buf, size_t max) {
+    Subscriber* sub = static_cast<Subscriber*>(cls);
+    EventStream* self = sub->stream;
+    const EventSource& source = self->source;
+
+    if (!self->running) {
+        return MHD_CONTENT_READER_END_OF_STREAM;
+    }
+
+    size_t used = 0;
+    if (!sub->sentRetry) {
+        used += snprintf(buf, max, "retry: 2000\n\n");
+        sub->sentRetry = true;
+    }
+
+    uint64_t head = source.head();
+    // A subscriber that fell behind the producer skips what was overwritten
+    sub->lastSeq = std::max(sub->lastSeq, source.oldest() > 0 ? source.oldest() - 1 : 0);
+    while (sub->lastSeq < head) {
+        int n = source.format_event(sub->lastSeq + 1, buf + used, max - used);
+        if (n < 0) break;  // buffer full; MHD calls again once it drains
+        used += n;
+        sub->lastSeq++;
+    }
+
+    uint64_t now = monotonic_us();
+    if (used == 0 && now - sub->lastWriteUs >= KEEPALIVE_US) {
+        used = snprintf(buf, max, ": keepalive\n\n");
+    }
+    if (used > 0) {
+        sub->lastWriteUs = now;
+        return used;
+    }
+
+    // Nothing to send. Check again under the lock so a publish between the
+    // check above and the suspend cannot be missed: the pump resumes parked
+    // subscribers only after taking the same lock.
+    std::lock_guard<std::mutex> lock(self->parkedMutex);
+    if (self->running && source.head() == sub->lastSeq) {
+        self->parked.push_back(sub);
+        MHD_suspend_connection(sub->connection);
+    }
+    return 0;
+}
+
+void EventStream::close_subscriber(void* cls) {
+    Subscriber* sub = static_cast<Subscriber*>(cls);
+    EventStream* self = sub->stream;
+    {
+        std::lock_guard<std::mutex> lock(self->parkedMutex);
+        self->parked.erase(std::remove(self->parked.begin(), self->parked.end(), sub),
+                           self->parked.end());
+    }
+    self->subscribers--;
+    delete sub;
+}
@@ -0,0 +1,81 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <microhttpd.h>
+
+// Where an EventStream gets its events from. Events are numbered by a
+// monotonically increasing sequence, matching SeqRing.
+class EventSource {
+public:
+    virtual ~EventSource() {}
+
+    // Sequence number of the newest event, 0 if none yet
+    virtual uint64_t head() const = 0;
+
+    // Oldest sequence number that may still be available
+    virtual uint64_t oldest() const = 0;
+
+    // Sequence number a new subscriber starts after. By default it gets
+    // only the newest event; a source whose events are partial updates
+    // starts further back so the subscriber sees the whole state.
+    virtual uint64_t subscribe_from() const {
+        uint64_t newest = head();
+        return newest > 0 ? newest - 1 : 0;
+    }
+
+    // Write one complete SSE event ("id: ...\ndata: ...\n\n") for `seq`.
+    // Returns bytes written, 0 if that event is no longer available, or
+    // -1 if it does not fit in `max` bytes.
+    virtual int format_event(uint64_t seq, char* buf, size_t max) const = 0;
+};
+
+// Server-Sent Events fan-out over libmicrohttpd callback responses.
+// Subscribers with nothing to send are suspended rather than polled, so an
+// idle stream costs no thread and no CPU. A single pump thread resumes them
+// when the producer calls notify(). Requires MHD_ALLOW_SUSPEND_RESUME.
+class EventStream {
+public:
+    explicit EventStream(const EventSource& source);
+    ~EventStream();
+
+    bool start();
+    void stop();  // call before MHD_stop_daemon so no connection stays suspended
+
+    // Producer side: wake subscribers. Never blocks.
+    void notify();
+
+    // Queue a streaming response on `connection`
+    MHD_Result open(struct MHD_Connection* connection);
+
+    unsigned subscriber_count() const { return subscribers.load(); }
+
+private:
+    struct Subscriber {
+        EventStream* stream;
+        struct MHD_Connection* connection;
+        uint64_t lastSeq;
+        uint64_t lastWriteUs;
+        bool sentRetry;
+    };
+
+    static ssize_t read_events(void* cls, uint64_t pos, char* buf, size_t max);
+    static void close_subscriber(void* cls);
+    void pump();
+    void resume_all();
+
+    const EventSource& source;
+    int wakeFd = -1;
+    std::atomic<bool> running{false};
+    std::atomic<unsigned> subscribers{0};
+    std::thread pumpThread;
+    std::mutex parkedMutex;
+    std::vector<Subscriber*> parked;  // suspended, waiting for new events
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include "filters.h"
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include "spec_parse.h"
+
+#define ONEEURO_MAX_CUTOFF_HZ 10000       // alpha is as good as 1 beyond this
+#define ONEEURO_MAX_GAP_US 16000000       // longer gaps count as this long
+#define ONEEURO_MAX_DERIVATIVE_GPS 1e7    // keeps derivative products within 63 bits
+#define ONEEURO_MAX_BETA 100
+
+MedianFilter::MedianFilter(unsigned w) : window(std::max(w, 1u)) {
+    history.reserve(window);
+}
+
+void MedianFilter::rebalance() {
+    while (low.size() > high.size() + 1) {
+        auto largest = std::prev(low.end());
+        high.insert(*largest);
+        low.erase(largest);
+    }
+    while (high.size() > low.size()) {
+        auto smallest = high.begin();
+        low.insert(*smallest);
+        high.erase(smallest);
+    }
+}
+
+fixed_t MedianFilter::update(fixed_t value, uint64_t timestamp_us) {
+    if (history.size() < window) {
+        history.push_back(value);
+    } else {
+        // Drop the value leaving the window. Anything <= the low half's
+        // maximum has a copy in the low half.
+        fixed_t old = history[next];
+        history[next] = value;
+        if (old <= *low.rbegin()) {
+            low.erase(low.find(old));
+        } else {
+            high.erase(high.find(old));
+        }
+    }
+    next = (next + 1) % window;
+
+    if (low.empty() || value <= *low.rbegin()) {
+        low.insert(value);
+    } else {
+        high.insert(value);
+    }
+    rebalance();
+
+    if (low.size() > high.size()) {
+        return *low.rbegin();
+    }
+    return div_round(*low.rbegin() + *high.begin(), 2);
+}
+
+EmaFilter::EmaFilter(double a) : alpha(to_fixed(a)) {
+}
+
+fixed_t EmaFilter::update(fixed_t value, uint64_t timestamp_us) {
+    if (!primed) {
+        state = value;
+        primed = true;
+    } else {
+        state += fixed_mul(alpha, value - state);
+    }
+    return state;
+}
+
+OneEuroFilter::OneEuroFilter(double minC, double b, double dC)
+    : minCutoff(to_fixed(minC)), beta(to_fixed(b)), derivativeCutoff(to_fixed(dC)) {
+}
+
+// Smoothing factor of a first-order low-pass at `cutoff` Hz over `dt_us`:
+// 1 / (1 + tau / dt) with tau = 1 / (2 pi cutoff), computed as k / (1 + k)
+// with k = 2 pi cutoff dt
+static fixed_t lowpass_alpha(fixed_t cutoff, uint64_t dt_us) {
+    static constexpr fixed_t TWO_PI = to_fixed(2 * M_PI);
+    cutoff = std::min(cutoff, to_fixed(ONEEURO_MAX_CUTOFF_HZ));
+    int64_t dt = static_cast<int64_t>(std::min<uint64_t>(dt_us, ONEEURO_MAX_GAP_US));
+    fixed_t k = div_round(fixed_mul(TWO_PI, cutoff) * dt, 1000000);
+    return fixed_div(k, FIXED_ONE + k);
+}
+
+fixed_t OneEuroFilter::update(fixed_t x, uint64_t timestamp_us) {
+    if (!primed || timestamp_us <= lastUs) {
+        if (!primed) {
+            value = x;
+            derivative = 0;
+            primed = true;
+        }
+        lastUs = timestamp_us;
+        return value;
+    }
+
+    uint64_t dt = timestamp_us - lastUs;
+    lastUs = timestamp_us;
+
+    static constexpr fixed_t MAX_DERIVATIVE = to_fixed(ONEEURO_MAX_DERIVATIVE_GPS);
+    fixed_t rawDerivative = div_round((x - value) * 1000000, static_cast<int64_t>(dt));
+    rawDerivative = std::max(std::min(rawDerivative, MAX_DERIVATIVE), -MAX_DERIVATIVE);
+    derivative += fixed_mul(lowpass_alpha(derivativeCutoff, dt), rawDerivative - derivative);
+    fixed_t cutoff = minCutoff + fixed_mul(beta, derivative < 0 ? -derivative : derivative);
+    value += fixed_mul(lowpass_alpha(cutoff, dt), x - value);
+    return value;
+}
+
+KalmanFilter::KalmanFilter(double processNoise, double measurementNoise)
+    : q(to_fixed(processNoise)), r(to_fixed(measurementNoise)) {
+}
+
+fixed_t KalmanFilter::update(fixed_t z, uint64_t timestamp_us) {
+    if (!primed) {
+        estimate = z;
+        variance = r;
+        primed = true;
+        return estimate;
+    }
+    variance += q;
+    fixed_t gain = fixed_div(variance, variance + r);
+    estimate += fixed_mul(gain, z - estimate);
+    variance = fixed_mul(variance, FIXED_ONE - gain);
+    return estimate;
+}
+
+fixed_t FilterChain::update(fixed_t value, uint64_t timestamp_us) {
+    for (auto& stage : stages) {
+        value = stage->update(value, timestamp_us);
+    }
+    return value;
+}
+
+// A positive number that is still positive once in fixed point
+static bool parse_positive(const std::string& text, double& out) {
+    return parse_number(text, out) && out > 0 && out < 1e9 && to_fixed(out) > 0;
+}
+
+FilterChain* build_filter_chain(const std::string& spec, std::string* error) {
+    std::unique_ptr<FilterChain> chain(new FilterChain);
+    chain->description = spec;
+
+    for (const std::string& stage : split(spec, ',')) {
+        std::vector<std::string> args = split(stage, ':');
+        if (args.empty()) continue;
+        const std::string& name = args[0];
+        double a = 0, b = 0, c = 1.0;
+
+        if (name == "none" && args.size() == 1) {
+            continue;
+        } else if (name == "median" && args.size() == 2 && parse_positive(args[1], a) && a <= 255 &&
+                   a == std::floor(a)) {
+            chain->stages.emplace_back(new MedianFilter(static_cast<unsigned>(a)));
+        } else if (name == "ema" && args.size() == 2 && parse_positive(args[1], a) && a <= 1) {
+            chain->stages.emplace_back(new EmaFilter(a));
+        } else if (name == "oneeuro" && (args.size() == 3 || args.size() == 4) &&
+                   parse_positive(args[1], a) && parse_positive(args[2], b) && b <= ONEEURO_MAX_BETA &&
+                   (args.size() == 3 || parse_positive(args[3], c))) {
+            chain->stages.emplace_back(new OneEuroFilter(a, b, c));
+        } else if (name == "kalman" && args.size() == 3 &&
+                   parse_positive(args[1], a) && parse_positive(args[2], b)) {
+            chain->stages.emplace_back(new KalmanFilter(a, b));
+        } else {
+            if (error != nullptr) *error = "invalid filter stage '" + stage + "'";
+            return nullptr;
+        }
+    }
+    return chain.release();
+}
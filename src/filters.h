@@ -0,0 +1,99 @@
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <stdint.h>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "fixed_point.h"
+
+#define DEFAULT_FILTER_CHAIN "median:5,oneeuro:0.5:0.05"
+
+// One incremental filter stage. update() is called once per raw sample
+// with its timestamp and must not block. Weights are in fixed point
+// grams and every stage keeps to integer arithmetic.
+class Filter {
+public:
+    virtual ~Filter() {}
+    virtual fixed_t update(fixed_t value, uint64_t timestamp_us) = 0;
+};
+
+// Median of the last N samples; rejects single-sample spikes from pump
+// vibration. Two balanced multisets give O(log N) per sample.
+class MedianFilter : public Filter {
+public:
+    explicit MedianFilter(unsigned window);  // a window of 0 is taken as 1
+    fixed_t update(fixed_t value, uint64_t timestamp_us) override;
+
+private:
+    void rebalance();
+
+    unsigned window;
+    std::vector<fixed_t> history;  // ring of the values in the window
+    unsigned next = 0;
+    std::multiset<fixed_t> low, high;  // low holds the smaller half
+};
+
+// Exponential moving average, y += alpha * (x - y)
+class EmaFilter : public Filter {
+public:
+    explicit EmaFilter(double alpha);
+    fixed_t update(fixed_t value, uint64_t timestamp_us) override;
+
+private:
+    fixed_t alpha;
+    fixed_t state = 0;
+    bool primed = false;
+};
+
+// One-euro filter: a low-pass whose cutoff rises with the rate of change,
+// so readings track a pour quickly but stay steady at rest
+class OneEuroFilter : public Filter {
+public:
+    OneEuroFilter(double minCutoff, double beta, double derivativeCutoff);
+    fixed_t update(fixed_t value, uint64_t timestamp_us) override;
+
+private:
+    fixed_t minCutoff, beta, derivativeCutoff;  // Hz, s, Hz
+    fixed_t value = 0, derivative = 0;          // g, g/s
+    uint64_t lastUs = 0;
+    bool primed = false;
+};
+
+// Scalar Kalman filter for a constant weight with process noise q and
+// measurement noise r (both in g^2)
+class KalmanFilter : public Filter {
+public:
+    KalmanFilter(double processNoise, double measurementNoise);
+    fixed_t update(fixed_t value, uint64_t timestamp_us) override;
+
+private:
+    fixed_t q, r;
+    fixed_t estimate = 0, variance = 0;
+    bool primed = false;
+};
+
+// Stages applied in order
+class FilterChain {
+public:
+    fixed_t update(fixed_t value, uint64_t timestamp_us);
+    const std::string& spec() const { return description; }
+
+private:
+    friend FilterChain* build_filter_chain(const std::string&, std::string*);
+    std::vector<std::unique_ptr<Filter>> stages;
+    std::string description;
+};
+
+// Parse a chain like "median:5,ema:0.3". Stages:
+//   median:N                      moving median over N samples, 1 <= N <= 255
+//   ema:ALPHA                     exponential moving average, 0 < ALPHA <= 1
+//   oneeuro:MINCUTOFF:BETA[:DCUTOFF]
+//   kalman:Q:R
+//   none                          pass samples through
+// Parameters are taken to fixed point; one that rounds to zero there is
+// invalid. Returns nullptr and sets *error if the spec is invalid.
+FilterChain* build_filter_chain(const std::string& spec, std::string* error);
+
+#endif
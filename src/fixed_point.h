@@ -0,0 +1,62 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <stdint.h>
+#include <ratio>
+
+// Weights go from raw counts to the JSON as signed 64-bit fixed point
+// with FIXED_FRAC_BITS fractional bits. 16 gives steps of 1/65536 g with
+// room for far more than any load cell carries, and leaves headroom for
+// the (raw << bits) << bits of the count to grams conversion. The same
+// integer arithmetic runs on every Pi, FPU or not, so a given trace of
+// raw values always produces the same weights. Build with
+// -DFIXED_FRAC_BITS=N to change the resolution.
+#ifndef FIXED_FRAC_BITS
+#define FIXED_FRAC_BITS 16
+#endif
+static_assert(FIXED_FRAC_BITS >= 8 && FIXED_FRAC_BITS <= 18, "FIXED_FRAC_BITS must be 8 to 18");
+
+typedef int64_t fixed_t;
+
+constexpr fixed_t FIXED_ONE = static_cast<fixed_t>(1) << FIXED_FRAC_BITS;
+
+// Integer division rounded to nearest, halves away from zero
+constexpr int64_t div_round(int64_t numerator, int64_t denominator) {
+    return (numerator < 0) == (denominator < 0)
+        ? (numerator + denominator / 2) / denominator
+        : (numerator - denominator / 2) / denominator;
+}
+
+// For settings and query arguments coming in, and numbers going out where
+// a double is what the consumer takes
+constexpr fixed_t to_fixed(double value) {
+    return static_cast<fixed_t>(value * FIXED_ONE + (value < 0 ? -0.5 : 0.5));
+}
+
+constexpr double from_fixed(fixed_t value) {
+    return static_cast<double>(value) / FIXED_ONE;
+}
+
+// Product of two fixed point values, rounded. a * b must fit in 63 bits,
+// which it does for weights times factors up to a few thousand.
+constexpr fixed_t fixed_mul(fixed_t a, fixed_t b) {
+    return (a * b + FIXED_ONE / 2) >> FIXED_FRAC_BITS;
+}
+
+// Quotient of two fixed point values, rounded; a must stay below 2^(63 - FIXED_FRAC_BITS)
+constexpr fixed_t fixed_div(fixed_t a, fixed_t b) {
+    return div_round(a * FIXED_ONE, b);
+}
+
+// Unit conversions as exact ratios, applied to fixed point values with
+// one multiply and one division
+typedef std::ratio<1600000, 45359237> GramsToOunces;  // 1 oz = 28.349523125 g
+
+template <class Ratio>
+constexpr fixed_t convert_units(fixed_t value) {
+    static_assert(Ratio::num < (1 << 24) && Ratio::den < (static_cast<int64_t>(1) << 32),
+                  "ratio too wide for fixed point weights");
+    return div_round(value * Ratio::num, Ratio::den);
+}
+
+#endif
@@ -0,0 +1,525 @@
+#include "fleet.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <iostream>
+#include "clocks.h"
+#include "net_client.h"
+#include "sample_json.h"
+
+#define FLEET_URL_MAX 256
+#define FLEET_ERROR_MAX 128
+#define FLEET_DEVICE_JSON_MAX (SAMPLE_JSON_MAX + 2 * FLEET_URL_MAX + 2 * FLEET_ERROR_MAX + 256)
+
+// http://HOST[:PORT][/PATH], or without the scheme; IPv6 literals in brackets
+static bool parse_device_url(const std::string& url, std::string& host, unsigned& port, std::string& path) {
+    std::string rest = url;
+    if (rest.compare(0, 7, "http://") == 0) {
+        rest = rest.substr(7);
+    } else if (rest.find("://") != std::string::npos) {
+        return false;
+    }
+    size_t slash = rest.find('/');
+    path = slash != std::string::npos ? rest.substr(slash) : FLEET_STREAM_PATH;
+    return split_host_port(rest.substr(0, slash), FLEET_DEFAULT_PORT, host, port) &&
+           path.find_first_of(" \r\n") == std::string::npos;
+}
+
+// Whether `text` is one JSON object on one line, brackets balanced and
+// nothing after it, so it can be pasted into the aggregate table and its
+// SSE rows without breaking them. Strings are skipped over, escapes
+// included; values are not checked.
+static bool single_json_object(const std::string& text) {
+    if (text.empty() || text[0] != '{') return false;
+    std::string closers;  // what each open bracket expects
+    bool inString = false;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (static_cast<unsigned char>(c) < 0x20) return false;
+        if (i > 0 && closers.empty()) return false;  // something after the object
+        if (inString) {
+            if (c == '\\') {
+                // The escaped character, which must not be a control one either
+                if (++i < text.size() && static_cast<unsigned char>(text[i]) < 0x20) return false;
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{' || c == '[') {
+            if (closers.size() >= 32) return false;
+            closers += c == '{' ? '}' : ']';
+        } else if (c == '}' || c == ']') {
+            if (closers.back() != c) return false;
+            closers.pop_back();
+        }
+    }
+    return closers.empty();
+}
+
+// One subscription: connect, request the event stream, then read events
+// for as long as the scale sends them. Runs on the aggregator's thread
+// and never blocks; the host name is resolved by ReconnectingClient.
+class FleetDevice : public ReconnectingClient {
+public:
+    FleetDevice(const std::string& id, const std::string& host, unsigned port, const std::string& path)
+        : ReconnectingClient(host, port, FLEET_CONNECT_TIMEOUT_MS, FLEET_RECONNECT_MAX_S), id(id), path(path) {
+        url = "http://" + (host.find(':') != std::string::npos ? "[" + host + "]" : host) + ":" +
+              std::to_string(port) + path;
+        label = "Fleet: " + id + " (" + url + ")";
+    }
+
+    const std::string id;
+    std::string url;
+
+    // When service() or the staleness check next has something to do. A
+    // change already pending goes out with the next publish(), so the
+    // stale deadline, which stays in the past until then, is left out.
+    int64_t deadline_ms(int64_t now_ms, unsigned stale_ms) const {
+        int64_t deadline = ReconnectingClient::deadline_ms();
+        if (!isStale.load(std::memory_order_relaxed) && hasSample && !has_change(now_ms, stale_ms)) {
+            deadline = std::min(deadline, lastSampleMs + stale_ms);
+        }
+        return deadline;
+    }
+
+    // Whether the device's row differs from when take_change() last ran:
+    // a new measurement, connected or not, stale or not, a new error
+    bool has_change(int64_t now_ms, unsigned stale_ms) const {
+        return changed || stale(now_ms, stale_ms) != isStale.load(std::memory_order_relaxed);
+    }
+
+    bool take_change(int64_t now_ms, unsigned stale_ms) {
+        bool was = has_change(now_ms, stale_ms);
+        isStale.store(stale(now_ms, stale_ms), std::memory_order_relaxed);
+        changed = false;
+        return was;
+    }
+
+    void render(std::string& out, int64_t now_ms) const {
+        char item[192];
+        out += "{\"id\": \"";
+        out += id;
+        out += "\", \"url\": ";
+        append_json_string(out, url);
+        int n = snprintf(item, sizeof(item), ", \"connected\": %s, \"stale\": %s, ",
+                         streaming ? "true" : "false",
+                         isStale.load(std::memory_order_relaxed) ? "true" : "false");
+        out.append(item, n);
+        if (hasSample) {
+            n = snprintf(item, sizeof(item), "\"age_ms\": %lld, \"received_ms\": %lld, ",
+                         static_cast<long long>(now_ms - lastSampleMs), static_cast<long long>(receivedWallMs));
+        } else {
+            n = snprintf(item, sizeof(item), "\"age_ms\": null, \"received_ms\": null, ");
+        }
+        out.append(item, n);
+        n = snprintf(item, sizeof(item), "\"connects\": %llu, \"error\": ",
+                     static_cast<unsigned long long>(sessions.load(std::memory_order_relaxed)));
+        out.append(item, n);
+        if (streaming) {
+            out += "null";
+        } else {
+            append_json_string(out, last_error().substr(0, FLEET_ERROR_MAX));
+        }
+        out += ", \"measurement\": ";
+        out += hasSample ? measurement : "null";
+        out += "}";
+    }
+
+    FleetDeviceStats stats() const {
+        FleetDeviceStats stats;
+        stats.id = id;
+        stats.connected = isConnected.load(std::memory_order_relaxed);
+        stats.stale = isStale.load(std::memory_order_relaxed);
+        stats.samples = samples.load(std::memory_order_relaxed);
+        stats.connects = sessions.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    bool stale(int64_t now_ms, unsigned stale_ms) const {
+        return !hasSample || now_ms - lastSampleMs >= stale_ms;
+    }
+
+    void opened(int64_t now_ms) override {
+        // A fresh socket takes a request this small in one go
+        std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + ":" + std::to_string(port) +
+                              "\r\nAccept: text/event-stream\r\nCache-Control: no-cache\r\n\r\n";
+        ssize_t n = send(sock, request.data(), request.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n != static_cast<ssize_t>(request.size())) {
+            fail(now_ms, n < 0 ? strerror(errno) : "request not sent");
+            return;
+        }
+        openedMs = now_ms;
+        lastReceivedMs = now_ms;
+    }
+
+    short session_events() const override { return POLLIN; }
+
+    int64_t session_deadline_ms() const override {
+        return streaming ? lastReceivedMs + FLEET_IDLE_TIMEOUT_MS : openedMs + FLEET_CONNECT_TIMEOUT_MS;
+    }
+
+    void session_service(short revents, int64_t now_ms) override {
+        if ((revents & (POLLIN | POLLERR | POLLHUP)) && !receive(now_ms)) return;
+        if (!streaming && now_ms >= openedMs + FLEET_CONNECT_TIMEOUT_MS) {
+            fail(now_ms, "no response");
+        } else if (streaming && now_ms >= lastReceivedMs + FLEET_IDLE_TIMEOUT_MS) {
+            fail(now_ms, "stream went silent");
+        }
+    }
+
+    void closed(int64_t now_ms, bool new_error) override {
+        if (new_error || streaming) changed = true;
+        streaming = false;
+        isConnected.store(false, std::memory_order_relaxed);
+        in.clear();
+        sse.clear();
+        eventData.clear();
+        eventName.clear();
+    }
+
+    bool receive(int64_t now_ms) {
+        char buf[8192];
+        ssize_t n = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            fail(now_ms, n == 0 ? "closed by the scale" : strerror(errno));
+            return false;
+        }
+        if (n < 0) return true;
+        lastReceivedMs = now_ms;
+        in.append(buf, n);
+
+        if (!streaming) {
+            size_t end = in.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                if (in.size() > FLEET_MAX_LINE) {
+                    fail(now_ms, "response headers too long");
+                    return false;
+                }
+                return true;
+            }
+            std::string headers = in.substr(0, end);
+            in.erase(0, end + 4);
+            std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+            int status = 0;
+            if (sscanf(headers.c_str(), "http/1.%*d %d", &status) != 1 || status != 200) {
+                fail(now_ms, status != 0 ? ("HTTP " + std::to_string(status)).c_str() : "not an HTTP response");
+                return false;
+            }
+            if (headers.find("content-type: text/event-stream") == std::string::npos) {
+                fail(now_ms, "not an event stream");
+                return false;
+            }
+            chunked = headers.find("transfer-encoding: chunked") != std::string::npos;
+            chunkRemaining = -1;
+            sessions.fetch_add(1, std::memory_order_relaxed);
+            streaming = true;
+            changed = true;
+            isConnected.store(true, std::memory_order_relaxed);
+            std::cout << "Fleet: " << id << " streaming from " << url << std::endl;
+        }
+        return decode(now_ms);
+    }
+
+    // Take the event stream out of the transfer coding
+    bool decode(int64_t now_ms) {
+        if (!chunked) {
+            bool ok = feed(in.data(), in.size(), now_ms);
+            in.clear();
+            return ok;
+        }
+        size_t at = 0;
+        bool ok = true;
+        while (ok && at < in.size()) {
+            if (chunkRemaining > 0) {
+                size_t take = std::min(in.size() - at, static_cast<size_t>(chunkRemaining));
+                ok = feed(in.data() + at, take, now_ms);
+                at += take;
+                chunkRemaining -= take;
+                if (chunkRemaining == 0) chunkRemaining = -2;  // CRLF after the data
+            } else if (chunkRemaining == -2) {
+                if (in.size() - at < 2) break;
+                at += 2;
+                chunkRemaining = -1;
+            } else {
+                size_t end = in.find("\r\n", at);
+                if (end == std::string::npos) {
+                    if (in.size() - at > 64) ok = fail(now_ms, "bad chunk header");
+                    break;
+                }
+                chunkRemaining = strtol(in.c_str() + at, nullptr, 16);
+                at = end + 2;
+                if (chunkRemaining <= 0) ok = fail(now_ms, "stream ended");
+            }
+        }
+        if (ok) in.erase(0, at);
+        return ok;
+    }
+
+    // SSE: lines of field: value, an empty line ending each event
+    bool feed(const char* data, size_t length, int64_t now_ms) {
+        sse.append(data, length);
+        size_t start = 0, end;
+        while ((end = sse.find('\n', start)) != std::string::npos) {
+            size_t lineEnd = end > start && sse[end - 1] == '\r' ? end - 1 : end;
+            if (!handle_line(sse.data() + start, lineEnd - start, now_ms)) return false;
+            start = end + 1;
+        }
+        sse.erase(0, start);
+        if (sse.size() > FLEET_MAX_LINE || eventData.size() > FLEET_MAX_LINE) {
+            return fail(now_ms, "event too long");
+        }
+        return true;
+    }
+
+    bool handle_line(const char* line, size_t length, int64_t now_ms) {
+        if (length == 0) {
+            // Measurements are the unnamed events; "settle" and the like are skipped
+            bool measurementEvent = eventName.empty() || eventName == "message";
+            std::string payload;
+            payload.swap(eventData);
+            eventName.clear();
+            if (!measurementEvent || payload.empty()) return true;
+            if (payload.size() > SAMPLE_JSON_MAX || !single_json_object(payload)) {
+                return fail(now_ms, "not a measurement stream");
+            }
+            measurement.swap(payload);
+            hasSample = true;
+            lastSampleMs = now_ms;
+            receivedWallMs = wall_clock_ms();
+            samples.fetch_add(1, std::memory_order_relaxed);
+            reset_backoff();
+            changed = true;
+            return true;
+        }
+        if (line[0] == ':') return true;  // comment, e.g. keepalive
+        const char* colon = static_cast<const char*>(memchr(line, ':', length));
+        size_t nameLength = colon != nullptr ? colon - line : length;
+        const char* value = colon != nullptr ? colon + 1 : line + length;
+        if (value < line + length && *value == ' ') value++;
+        size_t valueLength = line + length - value;
+        if (nameLength == 4 && memcmp(line, "data", 4) == 0) {
+            if (!eventData.empty()) eventData += '\n';
+            eventData.append(value, valueLength);
+        } else if (nameLength == 5 && memcmp(line, "event", 5) == 0) {
+            eventName.assign(value, valueLength);
+        }
+        return true;
+    }
+
+    std::string path;
+
+    bool streaming = false;  // headers accepted, events arriving
+    int64_t openedMs = 0;
+    int64_t lastReceivedMs = 0;
+    std::string in;       // received, not yet decoded
+    bool chunked = false;
+    long chunkRemaining = -1;  // data bytes left in the chunk; -1 size line next, -2 CRLF next
+    std::string sse;      // decoded, up to the last complete line
+    std::string eventData;    // data lines of the event being read
+    std::string eventName;
+
+    std::string measurement;  // newest, as the scale rendered it
+    bool hasSample = false;
+    int64_t lastSampleMs = 0;
+    int64_t receivedWallMs = 0;
+    bool changed = true;
+
+    std::atomic<bool> isConnected{false};
+    std::atomic<bool> isStale{true};
+    std::atomic<uint64_t> samples{0};
+    std::atomic<uint64_t> sessions{0};
+};
+
+FleetAggregator::FleetAggregator() {}
+
+FleetAggregator::~FleetAggregator() {
+    stop();
+}
+
+bool FleetAggregator::start(const FleetSettings& config, std::string* error) {
+    settings = config;
+    if (settings.devices.empty() || settings.devices.size() > FLEET_MAX_DEVICES) {
+        *error = "an aggregator takes 1 to " + std::to_string(FLEET_MAX_DEVICES) + " fleet devices";
+        return false;
+    }
+    if (settings.stale_ms == 0) {
+        *error = "fleet_stale_ms must be positive";
+        return false;
+    }
+    devices.clear();
+    for (const FleetDeviceConfig& device : settings.devices) {
+        std::string host, path;
+        unsigned port = 0;
+        if (device.url.size() > FLEET_URL_MAX || !parse_device_url(device.url, host, port, path)) {
+            *error = "invalid url '" + device.url + "' for fleet device " + device.id +
+                     " (http://HOST[:PORT][/PATH])";
+            devices.clear();
+            return false;
+        }
+        devices.emplace_back(new FleetDevice(device.id, host, port, path));
+    }
+
+    snapshot.reset(new ResponseCache("application/json", devices.size() * (FLEET_DEVICE_JSON_MAX + 16) + 128));
+    events.assign(FLEET_EVENTS, std::string());
+    latestEvent.assign(devices.size(), 0);
+    eventHead = 0;
+    stream.reset(new EventStream(*this));
+    if (!stream->start()) {
+        *error = std::string("fleet stream: ") + strerror(errno);
+        return false;
+    }
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        *error = std::string("fleet: eventfd: ") + strerror(errno);
+        stream->stop();
+        return false;
+    }
+    stopping = false;
+    worker = std::thread(&FleetAggregator::run, this);
+    return true;
+}
+
+void FleetAggregator::stop() {
+    if (!worker.joinable()) return;
+    stream->stop();
+    stopping = true;
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        // the worker still sees `stopping` at its next deadline
+    }
+    worker.join();
+    close(wakeFd);
+    wakeFd = -1;
+    for (auto& device : devices) {
+        device->disconnect();
+    }
+}
+
+std::vector<FleetDeviceStats> FleetAggregator::stats() const {
+    std::vector<FleetDeviceStats> all;
+    for (const auto& device : devices) {
+        all.push_back(device->stats());
+    }
+    return all;
+}
+
+uint64_t FleetAggregator::oldest() const {
+    uint64_t newest = eventHead.load();
+    return newest > FLEET_EVENTS ? newest - FLEET_EVENTS + 1 : 1;
+}
+
+// Back to the oldest of the devices' newest events, so a new subscriber
+// hears about every device. publish() keeps that within a few events per
+// device of the head.
+uint64_t FleetAggregator::subscribe_from() const {
+    std::lock_guard<std::mutex> lock(eventsMutex);
+    uint64_t from = eventHead.load();
+    for (uint64_t seq : latestEvent) {
+        if (seq > 0) from = std::min(from, seq - 1);
+    }
+    return from;
+}
+
+int FleetAggregator::format_event(uint64_t seq, char* buf, size_t max) const {
+    std::lock_guard<std::mutex> lock(eventsMutex);
+    if (seq == 0 || seq > eventHead.load() || seq < oldest()) return 0;
+    const std::string& event = events[seq % FLEET_EVENTS];
+    if (event.size() > max) return -1;
+    memcpy(buf, event.data(), event.size());
+    return static_cast<int>(event.size());
+}
+
+// One event per changed device, then the whole table for the snapshot
+void FleetAggregator::publish(int64_t now_ms) {
+    std::vector<size_t> changed;
+    uint64_t head = eventHead.load();
+    for (size_t i = 0; i < devices.size(); i++) {
+        bool change = devices[i]->take_change(now_ms, settings.stale_ms);
+        // Repeat a quiet device's row before it falls too far behind, so
+        // catching up a new subscriber takes a bounded number of events
+        if (change || head - latestEvent[i] >= 4 * devices.size()) changed.push_back(i);
+    }
+    if (changed.empty()) return;
+
+    std::string json;
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex);
+        for (size_t i : changed) {
+            json.clear();
+            devices[i]->render(json, now_ms);
+            std::string& event = events[++head % FLEET_EVENTS];
+            event = "id: " + std::to_string(head) + "\ndata: ";
+            event += json;
+            event += "\n\n";
+            latestEvent[i] = head;
+        }
+        eventHead.store(head);
+    }
+    stream->notify();
+
+    char header[96];
+    snprintf(header, sizeof(header), "{\"seq\": %llu, \"updated_ms\": %lld, \"devices\": {",
+             static_cast<unsigned long long>(head), static_cast<long long>(wall_clock_ms()));
+    json = header;
+    for (size_t i = 0; i < devices.size(); i++) {
+        json += i > 0 ? ", \"" : "\"";
+        json += devices[i]->id;
+        json += "\": ";
+        devices[i]->render(json, now_ms);
+    }
+    json += "}}";
+    char* body = snapshot->begin_update();
+    if (body != nullptr && json.size() <= snapshot->body_max()) {
+        memcpy(body, json.data(), json.size());
+        snapshot->commit_update(head, json.size());
+    }
+}
+
+void FleetAggregator::run() {
+    std::vector<pollfd> fds(devices.size() + 1);
+    int64_t lastPublishMs = -static_cast<int64_t>(settings.coalesce_ms);
+    bool dirty = true;  // the first table goes out straight away
+
+    while (!stopping) {
+        int64_t now = monotonic_ms();
+        for (size_t i = 0; i < devices.size(); i++) {
+            devices[i]->service(fds[i + 1].revents, now);
+            dirty = dirty || devices[i]->has_change(now, settings.stale_ms);
+        }
+        if (dirty && now - lastPublishMs >= settings.coalesce_ms) {
+            publish(now);
+            lastPublishMs = now;
+            dirty = false;
+        }
+
+        // Sleep until a socket is ready, a device has a deadline or a
+        // coalesced update is due
+        int64_t wake = dirty ? lastPublishMs + settings.coalesce_ms : -1;
+        for (size_t i = 0; i < devices.size(); i++) {
+            int64_t deadline = devices[i]->deadline_ms(now, settings.stale_ms);
+            if (deadline >= 0 && (wake < 0 || deadline < wake)) wake = deadline;
+            fds[i + 1].fd = devices[i]->events() != 0 ? devices[i]->fd() : -1;
+            fds[i + 1].events = devices[i]->events();
+            fds[i + 1].revents = 0;
+        }
+        int timeout = wake < 0 ? -1 : static_cast<int>(std::max<int64_t>(wake - monotonic_ms(), 0));
+        fds[0].fd = wakeFd;
+        fds[0].events = POLLIN;
+        if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) {
+            std::cerr << "Fleet: poll: " << strerror(errno) << std::endl;
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint64_t count;
+            if (read(wakeFd, &count, sizeof(count)) < 0) {
+                // raced with another read; nothing to do
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <microhttpd.h>
+#include "event_stream.h"
+#include "response_cache.h"
+
+#define DEFAULT_FLEET_STALE_MS 2000     // a device with no sample for this long is stale
+#define DEFAULT_FLEET_COALESCE_MS 100   // one update per device per this, at most
+#define FLEET_DEFAULT_PORT 8080         // what scales listen on unless configured otherwise
+#define FLEET_STREAM_PATH "/api/stream"
+#define FLEET_MAX_DEVICES 64
+#define FLEET_CONNECT_TIMEOUT_MS 3000
+#define FLEET_IDLE_TIMEOUT_MS 20000     // silence beyond a scale's 15 s SSE keepalive
+#define FLEET_RECONNECT_MAX_S 30        // backoff doubles from 1 s up to this
+#define FLEET_EVENTS 512                // updates kept for stream subscribers catching up
+#define FLEET_MAX_LINE 8192             // longest SSE line accepted from a scale
+
+// One scale to subscribe to, from fleet.ID=URL settings
+struct FleetDeviceConfig {
+    std::string id;   // up to MAX_ID_LENGTH letters, digits and underscores
+    std::string url;  // http://HOST[:PORT][/PATH], PATH defaulting to FLEET_STREAM_PATH
+};
+
+struct FleetSettings {
+    std::vector<FleetDeviceConfig> devices;  // empty: not an aggregator
+    unsigned stale_ms = DEFAULT_FLEET_STALE_MS;
+    unsigned coalesce_ms = DEFAULT_FLEET_COALESCE_MS;
+};
+
+struct FleetDeviceStats {
+    std::string id;
+    bool connected;
+    bool stale;
+    uint64_t samples;   // measurements received
+    uint64_t connects;  // streams established
+};
+
+class FleetDevice;
+
+// Aggregator mode: keeps a Server-Sent Events subscription open to every
+// configured scale and merges their latest measurements into one table.
+//
+// A single thread drives all subscriptions with non-blocking sockets.
+// Each device is reconnected with backoff when its stream fails, goes
+// silent or cannot be reached, and marked stale when no measurement has
+// arrived for stale_ms. Measurements arriving faster than coalesce_ms are
+// coalesced: only the newest is kept and published.
+//
+// The table is served two ways, both shaped per device as
+//   {"id": "ID", "url": "...", "connected": bool, "stale": bool,
+//    "age_ms": ms|null, "received_ms": ms|null, "connects": N,
+//    "error": "..."|null, "measurement": {/api/measurements}|null}
+// snapshot(): {"seq": N, "updated_ms": ms, "devices": {"ID": device, ...}},
+//             rendered once per change and served from a ResponseCache
+// stream():   one SSE event per changed device; a new subscriber first
+//             gets every device's current state. Opening it with
+//             Last-Event-ID set to a snapshot's seq continues from there.
+class FleetAggregator : public EventSource {
+public:
+    FleetAggregator();
+    ~FleetAggregator();
+
+    bool start(const FleetSettings& settings, std::string* error);
+    void stop();  // before MHD_stop_daemon, as EventStream::stop(); the snapshot stays servable
+    bool running() const { return worker.joinable(); }
+
+    MHD_Result serve_snapshot(struct MHD_Connection* connection) { return snapshot->serve(connection); }
+    MHD_Result open_stream(struct MHD_Connection* connection) { return stream->open(connection); }
+
+    std::vector<FleetDeviceStats> stats() const;
+    unsigned subscriber_count() const { return stream != nullptr ? stream->subscriber_count() : 0; }
+
+    // EventSource, for stream()
+    uint64_t head() const override { return eventHead.load(); }
+    uint64_t oldest() const override;
+    uint64_t subscribe_from() const override;
+    int format_event(uint64_t seq, char* buf, size_t max) const override;
+
+private:
+    void run();
+    void publish(int64_t now_ms);
+
+    FleetSettings settings;
+    std::vector<std::unique_ptr<FleetDevice>> devices;
+    std::unique_ptr<ResponseCache> snapshot;
+    std::unique_ptr<EventStream> stream;
+    int wakeFd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+
+    // The stream's events, a ring indexed by seq; written by the worker
+    mutable std::mutex eventsMutex;
+    std::vector<std::string> events;
+    std::vector<uint64_t> latestEvent;  // per device, the seq of its newest event
+    std::atomic<uint64_t> eventHead{0};
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "flow_rate.h"
+#include <algorithm>
+#include <cmath>
+
+FlowEstimator::FlowEstimator(unsigned w) : window(w < 2 ? 2 : w) {
+    times.reserve(window);
+    weights.reserve(window);
+}
+
+void FlowEstimator::update(double weight_g, uint64_t timestamp_us) {
+    if (times.empty()) {
+        originUs = timestamp_us;
+    }
+    double t = (static_cast<int64_t>(timestamp_us - originUs)) / 1e6;
+    if (times.size() < window) {
+        times.push_back(timestamp_us);
+        weights.push_back(weight_g);
+    } else {
+        double oldT = (static_cast<int64_t>(times[next] - originUs)) / 1e6;
+        double oldW = weights[next];
+        sumT -= oldT;
+        sumW -= oldW;
+        sumTT -= oldT * oldT;
+        sumTW -= oldT * oldW;
+        sumWW -= oldW * oldW;
+        times[next] = timestamp_us;
+        weights[next] = weight_g;
+    }
+    next = (next + 1) % window;
+    newestUs = timestamp_us;
+
+    sumT += t;
+    sumW += weight_g;
+    sumTT += t * t;
+    sumTW += t * weight_g;
+    sumWW += weight_g * weight_g;
+
+    if (++sinceRebase >= window) {
+        rebase();
+    }
+}
+
+// Recompute the sums exactly, with the newest sample at t = 0
+void FlowEstimator::rebase() {
+    originUs = newestUs;
+    sumT = sumW = sumTT = sumTW = sumWW = 0;
+    for (size_t i = 0; i < times.size(); i++) {
+        double t = (static_cast<int64_t>(times[i] - originUs)) / 1e6;
+        sumT += t;
+        sumW += weights[i];
+        sumTT += t * t;
+        sumTW += t * weights[i];
+        sumWW += weights[i] * weights[i];
+    }
+    sinceRebase = 0;
+}
+
+double FlowEstimator::rate() const {
+    double n = times.size();
+    if (n < 2) return 0;
+    double denominator = n * sumTT - sumT * sumT;
+    if (denominator <= 0) return 0;  // all samples at one instant
+    return (n * sumTW - sumT * sumW) / denominator;
+}
+
+double FlowEstimator::fitted() const {
+    double n = times.size();
+    if (n == 0) return 0;
+    double slope = rate();
+    double newestT = (static_cast<int64_t>(newestUs - originUs)) / 1e6;
+    return (sumW - slope * sumT) / n + slope * newestT;
+}
+
+double FlowEstimator::residual() const {
+    double n = times.size();
+    if (n < 2) return 0;
+    double tt = sumTT - sumT * sumT / n;
+    double tw = sumTW - sumT * sumW / n;
+    double ww = sumWW - sumW * sumW / n;
+    double squares = tt > 0 ? ww - tw * tw / tt : ww;
+    return std::sqrt(std::max(squares, 0.0) / n);
+}
+
+FillPrediction predict_fill(const FlowEstimator& flow, double target_g, double inflight_s) {
+    FillPrediction prediction;
+    double rate = flow.rate();
+    if (target_g <= 0 || rate < FLOW_MIN_RATE_GPS) {
+        return prediction;
+    }
+    double weight = flow.fitted();
+    prediction.time_to_target_s = std::max((target_g - weight) / rate, 0.0);
+    prediction.cutoff_g = target_g - rate * inflight_s;
+    prediction.time_to_cutoff_s = std::max((prediction.cutoff_g - weight) / rate, 0.0);
+    return prediction;
+}
@@ -0,0 +1,54 @@
+#ifndef FLOW_RATE_H
+#define FLOW_RATE_H
+
+#include <stdint.h>
+#include <vector>
+
+#define DEFAULT_FLOW_WINDOW 10         // samples
+#define DEFAULT_FLOW_INFLIGHT_MS 250   // valve closing to the last drop landing
+#define FLOW_MIN_RATE_GPS 0.2          // slower than this no fill is running
+
+// Flow rate as the least-squares slope of weight over time across the
+// last `window` samples. The regression sums are updated in O(1) per
+// sample; every `window` samples they are recomputed from the window
+// around a new time origin, so rounding cannot build up over a long run.
+class FlowEstimator {
+public:
+    explicit FlowEstimator(unsigned window = DEFAULT_FLOW_WINDOW);
+
+    void update(double weight_g, uint64_t timestamp_us);
+
+    // Grams per second; 0 until the window has two samples
+    double rate() const;
+
+    // The regression line at the newest sample: a less noisy weight
+    double fitted() const;
+
+    // Root mean square distance of the window's weights from the line;
+    // large when the weight stepped rather than flowed
+    double residual() const;
+
+private:
+    void rebase();
+
+    unsigned window;
+    std::vector<uint64_t> times;
+    std::vector<double> weights;
+    unsigned next = 0;
+    unsigned sinceRebase = 0;
+    uint64_t originUs = 0;
+    uint64_t newestUs = 0;
+    double sumT = 0, sumW = 0, sumTT = 0, sumTW = 0, sumWW = 0;  // t in seconds from originUs
+};
+
+// Where a fill towards a target weight stands, -1 for the times when no
+// fill is running
+struct FillPrediction {
+    double time_to_target_s = -1;
+    double cutoff_g = 0;            // close the valve here; the rest is in flight
+    double time_to_cutoff_s = -1;   // 0 once the cutoff is reached
+};
+
+FillPrediction predict_fill(const FlowEstimator& flow, double target_g, double inflight_s);
+
+#endif
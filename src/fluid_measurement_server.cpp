@@ -2,24 +2,51 @@
 #include <unistd.h>
 #include <string>
 #include <iostream>
-#include <sstream>
 #include <thread>
 #include <mutex>
 #include <atomic>
 #include <microhttpd.h>
 #include <sys/stat.h>
+#include <signal.h>
 #include <fstream>
 #include <cstring>
+#include <cmath>
 #include <algorithm>
-#include <pigpio.h>
+#include <vector>
+#include <memory>
 
 // Include WiFi setup functionality
 #include "wifi_setup.h"
+#include "sample_queue.h"
+#include "sample_ring.h"
+#include "event_stream.h"
+#include "server_config.h"
+#include "sample_json.h"
+#include "response_cache.h"
+#include "filters.h"
+#include "stability.h"
+#include "history_store.h"
+#include "history_export.h"
+#include "telemetry.h"
+#include "fleet.h"
+#include "sensor_backend.h"
+#include "metrics.h"
+#include "static_assets.h"
+#include "calibration_store.h"
+#include "flow_rate.h"
+#include "output_rules.h"
+#include "scale.h"
+#include "spec_parse.h"
 
-// Pin definitions for Raspberry Pi (using pigpio numbering)
-#define DOUT_PIN 5  // Direct BCM GPIO 5
-#define CLK_PIN  6  // Direct BCM GPIO 6
-#define PORT 8080   // Web server port
+// Samples averaged for a tare or a calibration against a known weight
+#define TARE_SAMPLES 10
+#define BOOT_TARE_TIMEOUT_MS 10000
+
+// /api/history returns this many points when no step is given, and never more than the max
+#define DEFAULT_HISTORY_POINTS 300
+#define MAX_HISTORY_POINTS 10000
+// ...and from/to may lie at most this far ahead of the clock
+#define HISTORY_FUTURE_SLACK_MS (24 * 3600 * 1000LL)
 
 // Utility function to replace ends_with
 bool ends_with(const std::string& str, const std::string& suffix) {
@@ -27,135 +54,934 @@ bool ends_with(const std::string& str, const std::string& suffix) {
     return str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
 }
 
-// HX711 class implementation
-class HX711 {
-private:
-    int DOUT, CLK;
-    long OFFSET = 0;
-    float SCALE = 1.0f;
-    int GAIN = 128;
+// One load cell and everything measured from it
+struct ScaleChannel {
+    unsigned index;  // in scales, and of its samples
+    std::string id;
+    Scale scale;
+    std::atomic<fixed_t> inputWeight{0};  // container weight, grams
+    std::atomic<fixed_t> targetWeight{0};  // fill target for the fluid, grams; 0 for none
+    std::atomic<FilterChain*> pendingFilter{nullptr};  // next chain for measurement_thread
+    std::mutex filterSpecMutex;
+    std::string filterSpec;  // spec of the most recently requested chain
+    std::mutex calibrationMutex;  // one tare or calibration at a time
+    std::atomic<bool> calibrated{false};  // until then samples only feed the ring, for the boot tare
+    std::atomic<OutputRuleSet*> pendingOutputs{nullptr};  // next output rules for measurement_thread
+    std::mutex outputSpecMutex;
+    std::string outputSpec;  // spec of the most recently requested rules
+    SampleRing ring;  // written only by measurement_thread
+    ResponseCache cache{"application/json"};  // body of its measurements endpoint
     
-public:
-    HX711(int dout, int clk) : DOUT(dout), CLK(clk) {
-        gpioSetMode(CLK, PI_OUTPUT);
-        gpioSetMode(DOUT, PI_INPUT);
-        gpioWrite(CLK, 0);
+    // measurement_thread only
+    FilterChain* filter = nullptr;
+    StabilityDetector stability;
+    FlowEstimator flow;
+    LatencyHistogram filterTime;  // one filter update
+    OutputRuleSet* outputs = nullptr;
+    
+    ScaleChannel(unsigned scaleIndex, const std::string& scaleId, SensorBackend* backend,
+                 unsigned stableWindow, double stableStddev, unsigned flowWindow)
+        : index(scaleIndex), id(scaleId), scale(backend), stability(stableWindow, stableStddev), flow(flowWindow) {
     }
     
-    ~HX711() {
-        // Destructor code here (empty in this case)
+    ~ScaleChannel() {
+        delete filter;
+        delete pendingFilter.load();
+        delete outputs;
+        delete pendingOutputs.load();
+    }
+};
+
+// Global variables (PLACE THESE BEFORE ANY FUNCTIONS THAT USE THEM)
+std::vector<SensorBackend*> sensors;
+std::vector<std::unique_ptr<ScaleChannel>> scales;  // scales[0] also serves the single-scale endpoints
+ResponseCache* allScalesCache = nullptr;  // body of /api/scales
+std::atomic<bool> running{true};
+SampleQueue sampleQueue;
+HistoryStore historyStore;  // appended to by measurement_thread, for scales[0]
+TelemetryPublisher telemetry;  // fed by measurement_thread when configured
+unsigned stableWindow = DEFAULT_STABLE_WINDOW;
+double stableStddev = DEFAULT_STABLE_STDDEV_G;
+unsigned flowWindow = DEFAULT_FLOW_WINDOW;
+double flowInflightS = DEFAULT_FLOW_INFLIGHT_MS / 1000.0;
+CalibrationStore calibrationStore;  // offset, factor and gain of every scale
+OutputBank outputBank;  // pins the output rules drive, and their trigger log
+FleetAggregator fleet;  // aggregator mode only
+
+// Routes timed separately at /metrics
+enum Route {
+    ROUTE_MEASUREMENTS, ROUTE_RECENT, ROUTE_FILTER, ROUTE_SCALES, ROUTE_SCALE, ROUTE_HISTORY,
+    ROUTE_HISTORY_EXPORT, ROUTE_ACQUISITION, ROUTE_STREAM, ROUTE_METRICS, ROUTE_TARE, ROUTE_CALIBRATE,
+    ROUTE_RESET_CONTAINER, ROUTE_TARGET, ROUTE_OUTPUTS, ROUTE_TRIGGERS, ROUTE_FLEET, ROUTE_FLEET_STREAM,
+    ROUTE_STATIC, ROUTE_OTHER, ROUTE_COUNT
+};
+const char* const routeNames[ROUTE_COUNT] = {
+    "/api/measurements", "/api/recent", "/api/filter", "/api/scales", "/api/scales/{id}",
+    "/api/history", "/api/history/export", "/api/acquisition", "/api/stream", "/metrics", "/api/tare", "/api/calibrate",
+    "/api/reset_container", "/api/target", "/api/outputs", "/api/triggers", "/api/fleet", "/api/fleet/stream",
+    "static", "other"
+};
+LatencyHistogram requestTime[ROUTE_COUNT];  // handler time, from the request to its queued response
+std::atomic<int> openConnections{0};
+std::atomic<const StaticAssets*> webAssets{nullptr};  // the dashboard, published once loaded
+std::atomic<bool> webAssetsPending{false};  // still loading: 503 rather than 404
+
+// Forward declaration
+static MHD_Result handle_request(void *cls, struct MHD_Connection *connection,
+                          const char *url, const char *method,
+                          const char *version, const char *upload_data,
+                          unsigned int *upload_data_size, void **con_cols);
+
+// Hand a new filter chain to measurement_thread, which picks it up before
+// the scale's next sample without taking a lock
+static bool set_filter_chain(ScaleChannel& channel, const std::string& spec, std::string* error) {
+    FilterChain* chain = build_filter_chain(spec, error);
+    if (chain == nullptr) {
+        return false;
     }
+    std::lock_guard<std::mutex> lock(channel.filterSpecMutex);
+    delete channel.pendingFilter.exchange(chain);  // superseded before it was used
+    channel.filterSpec = spec;
+    return true;
+}
 
-    bool is_ready() {
-        return gpioRead(DOUT) == 0;
+// Same for output rules; the pins of the replaced rules are released then.
+// Pins of the sensors and of other scales' rules are refused.
+static bool set_output_rules(ScaleChannel& channel, const std::string& spec, std::string* error) {
+    OutputRuleSet* rules = build_output_rules(spec, error);
+    if (rules == nullptr) {
+        return false;
     }
+    std::lock_guard<std::mutex> lock(channel.outputSpecMutex);
+    if (!outputBank.assign(channel.index, rules->pins(), error)) {
+        delete rules;
+        return false;
+    }
+    delete channel.pendingOutputs.exchange(rules);
+    channel.outputSpec = spec;
+    return true;
+}
+
+static ScaleChannel* find_scale(const std::string& id) {
+    for (auto& channel : scales) {
+        if (channel->id == id) return channel.get();
+    }
+    return nullptr;
+}
+
+// Queue a body, copied into the response. `anyOrigin` lets pages from
+// anywhere read it.
+static MHD_Result send_body(struct MHD_Connection* connection, unsigned int status,
+                            const char* contentType, const std::string& body, bool anyOrigin = true) {
+    struct MHD_Response* response = MHD_create_response_from_buffer(body.length(), (void*)body.c_str(), MHD_RESPMEM_MUST_COPY);
+    MHD_add_response_header(response, "Content-Type", contentType);
+    if (anyOrigin) MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    MHD_Result ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+static MHD_Result send_json(struct MHD_Connection* connection, unsigned int status, const std::string& json,
+                            bool anyOrigin = true) {
+    return send_body(connection, status, "application/json", json, anyOrigin);
+}
+
+// Integer query argument, or `fallback` if absent or malformed
+static int64_t query_int64(struct MHD_Connection* connection, const char* name, int64_t fallback) {
+    const char* value = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, name);
+    if (value == nullptr || *value == '\0') return fallback;
+    char* end = nullptr;
+    long long parsed = strtoll(value, &end, 10);
+    return *end == '\0' ? parsed : fallback;
+}
+
+// A history from/to: epoch ms no earlier than 1970 and at most a day
+// ahead of `now`, so differences between two of them cannot overflow
+static bool history_time(int64_t ms, int64_t now) {
+    return ms >= 0 && ms <= now + HISTORY_FUTURE_SLACK_MS;
+}
+
+// Whatever changes the scale (filter, tare, calibration, container,
+// target, output rules) must be a POST with an X-Requested-With header:
+// a page from another origin cannot send one without a CORS preflight,
+// which is never granted, and no link, image or form can. Otherwise
+// *answer is the refusal to return. Neither carries the CORS header the
+// read-only endpoints have.
+static bool change_allowed(struct MHD_Connection* connection, bool post, MHD_Result* answer) {
+    if (!post) {
+        *answer = send_json(connection, MHD_HTTP_METHOD_NOT_ALLOWED, "{\"error\": \"changes need a POST\"}", false);
+        return false;
+    }
+    if (MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "X-Requested-With") == nullptr) {
+        *answer = send_json(connection, MHD_HTTP_FORBIDDEN, "{\"error\": \"missing X-Requested-With header\"}", false);
+        return false;
+    }
+    return true;
+}
+
+// GET reports the scale's filter; POST ?chain=median:5,ema:0.3 replaces it
+static MHD_Result filter_request(struct MHD_Connection* connection, ScaleChannel& channel, bool post) {
+    const char* chain = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "chain");
+    std::string error;
+    MHD_Result refused;
+    if ((post || chain != nullptr) && !change_allowed(connection, post, &refused)) return refused;
+    if (post && chain == nullptr) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"chain missing\"}", false);
+    }
+    if (post && !set_filter_chain(channel, chain, &error)) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": " + json_string(error) + "}", false);
+    }
+    std::lock_guard<std::mutex> lock(channel.filterSpecMutex);
+    return send_json(connection, MHD_HTTP_OK, "{\"chain\": " + json_string(channel.filterSpec) + "}", !post);
+}
+
+// Mean raw value of the scale's last `count` samples, in fixed point so
+// the fraction is kept; false if there are not that many yet
+static bool recent_raw_mean(const ScaleChannel& channel, unsigned count, fixed_t& mean) {
+    std::vector<Sample> recent(count);
+    if (channel.ring.history(recent.data(), count) < count) return false;
+    int64_t sum = 0;
+    for (const Sample& sample : recent) {
+        sum += sample.raw;
+    }
+    mean = div_round(sum * FIXED_ONE, count);
+    return true;
+}
+
+// Write the scale's calibration to the store
+static bool save_calibration(ScaleChannel& channel, std::string* error) {
+    Calibration calibration;
+    calibration.offset = from_fixed(channel.scale.get_offset());
+    calibration.factor = channel.scale.get_scale();
+    calibration.gain = channel.scale.get_gain();
+    return calibrationStore.save(channel.id, calibration, error);
+}
+
+// Zero the scale on its last TARE_SAMPLES raw readings and save that.
+// False if there are not that many yet; `saved` tells whether the store
+// was written.
+static bool tare_scale(ScaleChannel& channel, bool* saved, std::string* error) {
+    std::lock_guard<std::mutex> lock(channel.calibrationMutex);
+    fixed_t offset = 0;
+    if (!recent_raw_mean(channel, TARE_SAMPLES, offset)) {
+        *error = "not enough samples yet";
+        return false;
+    }
+    channel.scale.set_offset(offset);
     
-    void set_gain(int gain = 128) {
-        switch (gain) {
-        case 128:
-            GAIN = 1; break;
-        case 64:
-            GAIN = 3; break;
-        case 32:
-            GAIN = 2; break;
-        default:
-            GAIN = 1; break;
+    // A fresh chain, so the filtered weight does not glide down from the old zero
+    std::string spec;
+    {
+        std::lock_guard<std::mutex> specLock(channel.filterSpecMutex);
+        spec = channel.filterSpec;
+    }
+    set_filter_chain(channel, spec, nullptr);
+    channel.calibrated.store(true, std::memory_order_release);
+    *saved = save_calibration(channel, error);
+    return true;
+}
+
+// The scale's calibration as the tare and calibrate endpoints report it
+static std::string calibration_json(const ScaleChannel& channel, bool saved, const std::string& error) {
+    char json[160];
+    snprintf(json, sizeof(json), "{\"offset\": %.10g, \"factor\": %.9g, \"gain\": %d, \"saved\": %s",
+             from_fixed(channel.scale.get_offset()), channel.scale.get_scale(), channel.scale.get_gain(),
+             saved ? "true" : "false");
+    return saved ? std::string(json) + "}" : std::string(json) + ", \"error\": " + json_string(error) + "}";
+}
+
+// POST only, as are calibrate and reset_container
+static MHD_Result tare_request(struct MHD_Connection* connection, ScaleChannel& channel, bool post) {
+    MHD_Result refused;
+    if (!change_allowed(connection, post, &refused)) return refused;
+    std::string error;
+    bool saved = false;
+    if (!tare_scale(channel, &saved, &error)) {
+        return send_json(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "{\"error\": " + json_string(error) + "}", false);
+    }
+    return send_json(connection, MHD_HTTP_OK, calibration_json(channel, saved, error), false);
+}
+
+// ?known_g=G with G grams on the (tared) scale derives the factor from the
+// last readings; ?factor=F sets it outright; ?gain=128|64|32 switches the
+// HX711 gain, rescaling offset and factor of every scale on that clock line
+static MHD_Result calibrate_request(struct MHD_Connection* connection, ScaleChannel& channel, bool post) {
+    MHD_Result refused;
+    if (!change_allowed(connection, post, &refused)) return refused;
+    const char* knownArg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "known_g");
+    const char* factorArg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "factor");
+    const char* gainArg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "gain");
+    unsigned gain = 0;
+    if (gainArg != nullptr && !parse_unsigned(gainArg, gain)) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"gain must be 128, 64 or 32\"}", false);
+    }
+
+    // A gain change rescales every scale on the backend, so it holds all
+    // their calibration locks, taken in scale order so that two cannot
+    // deadlock
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto& other : scales) {
+        if (other.get() == &channel || (gainArg != nullptr && other->scale.backend() == channel.scale.backend())) {
+            locks.emplace_back(other->calibrationMutex);
+        }
+    }
+    if (knownArg != nullptr) {
+        double known = 0;
+        fixed_t mean = 0;
+        if (!parse_number(knownArg, known) || known <= 0) {
+            return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"known_g must be a positive weight\"}", false);
+        }
+        if (!recent_raw_mean(channel, TARE_SAMPLES, mean)) {
+            return send_json(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "{\"error\": \"not enough samples yet\"}", false);
+        }
+        double factor = from_fixed(mean - channel.scale.get_offset()) / known;
+        if (!channel.scale.set_scale(factor)) {
+            return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"the scale reads no load; tare empty first\"}", false);
+        }
+    } else if (factorArg != nullptr) {
+        double factor = 0;
+        if (!parse_number(factorArg, factor) || fabs(factor) > 1e9 || !channel.scale.set_scale(factor)) {
+            return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"factor must be a non-zero number\"}", false);
         }
     }
     
-    long read() {
-        // Wait until HX711 is ready
-        while (!is_ready());
-        
-        unsigned long value = 0;
-        
-        // Pulse the clock pin 24 times to read data
-        for (int i = 0; i < 24; i++) {
-            gpioWrite(CLK, 1);
-            gpioDelay(1);
-            gpioWrite(CLK, 0);
-            gpioDelay(1);
-            
-            value = value << 1;
-            if (gpioRead(DOUT)) {
-                value++;
+    std::string error;
+    bool saved = true;
+    if (gainArg != nullptr) {
+        int previous = channel.scale.get_gain();
+        if (static_cast<int>(gain) != previous) {
+            if (gain > 128 || !channel.scale.set_gain(gain)) {
+                return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"gain not supported by this sensor\"}", false);
+            }
+            // Raw counts scale with the gain; a tare afterwards sharpens the offset
+            for (auto& other : scales) {
+                if (other->scale.backend() != channel.scale.backend()) continue;
+                Scale& scale = other->scale;
+                scale.set_offset(div_round(scale.get_offset() * gain, previous));
+                scale.set_scale(scale.get_scale() * gain / previous);
+                if (other.get() != &channel) {
+                    scale.set_gain(gain);
+                    saved = save_calibration(*other, &error) && saved;
+                }
             }
         }
-        
-        // Set the gain by pulsing the clock pin additional times
-        for (int i = 0; i < GAIN; i++) {
-            gpioWrite(CLK, 1);
-            gpioDelay(1);
-            gpioWrite(CLK, 0);
-            gpioDelay(1);
-        }
-        
-        // Convert 24-bit two's complement to signed 32-bit
-        if (value & 0x800000) {
-            value |= 0xFF000000;
+    }
+    saved = save_calibration(channel, &error) && saved;
+    return send_json(connection, MHD_HTTP_OK, calibration_json(channel, saved, error), false);
+}
+
+// GET reports the fill target for the fluid weight; POST ?g=G sets it,
+// g=0 clears it. GPIO:target output rules fire on it.
+static MHD_Result target_request(struct MHD_Connection* connection, ScaleChannel& channel, bool post) {
+    const char* target = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "g");
+    MHD_Result refused;
+    if ((post || target != nullptr) && !change_allowed(connection, post, &refused)) return refused;
+    if (post && target == nullptr) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"g missing\"}", false);
+    }
+    if (post) {
+        char* end = nullptr;
+        double grams = strtod(target, &end);
+        if (*target == '\0' || *end != '\0' || !(grams >= 0 && grams < 1e9)) {
+            return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"g must be a weight in grams, 0 to clear\"}", false);
         }
-        
-        return static_cast<long>(value);
+        channel.targetWeight.store(to_fixed(grams));
     }
+    char json[64];
+    fixed_t grams = channel.targetWeight.load();
+    if (grams > 0) snprintf(json, sizeof(json), "{\"target_g\": %g}", from_fixed(grams));
+    else snprintf(json, sizeof(json), "{\"target_g\": null}");
+    return send_json(connection, MHD_HTTP_OK, json, !post);
+}
+
+// GET reports the scale's output rules and the pins driven high. POST
+// ?rules=17:target,18:above:500 replaces the rules, rules= clears them.
+// Since the rules drive valves, neither answer carries the CORS header.
+static MHD_Result outputs_request(struct MHD_Connection* connection, ScaleChannel& channel, bool post) {
+    const char* rules = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "rules");
+    std::string error;
+    MHD_Result refused;
+    if ((post || rules != nullptr) && !change_allowed(connection, post, &refused)) return refused;
+    if (post && rules == nullptr) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"rules missing\"}", false);
+    }
+    if (post && !set_output_rules(channel, rules, &error)) {
+        return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": " + json_string(error) + "}", false);
+    }
+    std::string json;
+    {
+        std::lock_guard<std::mutex> lock(channel.outputSpecMutex);
+        json = "{\"rules\": " + json_string(channel.outputSpec);
+    }
+    json += outputBank.simulated() ? ", \"driver\": \"sim\", \"high\": [" : ", \"driver\": \"gpio\", \"high\": [";
+    uint32_t levels = outputBank.levels();
+    bool first = true;
+    for (unsigned gpio = 0; gpio <= OUTPUT_GPIO_MAX; gpio++) {
+        if (!(levels & (1u << gpio))) continue;
+        json += (first ? "" : ",") + std::to_string(gpio);
+        first = false;
+    }
+    json += "]}";
+    return send_json(connection, MHD_HTTP_OK, json, false);
+}
+
+// The latest output rule triggers of every scale, oldest first, each with
+// the time from its sample being taken to the pin being written
+static MHD_Result triggers_request(struct MHD_Connection* connection) {
+    std::vector<OutputTrigger> triggers(OUTPUT_LOG_SIZE);
+    triggers.resize(outputBank.triggers(triggers.data(), triggers.size()));
+    char item[320];
+    snprintf(item, sizeof(item), "{\"driver\": \"%s\", \"triggers_total\": %llu, \"triggers\": [",
+             outputBank.simulated() ? "sim" : "gpio", static_cast<unsigned long long>(outputBank.trigger_count()));
+    std::string json = item;
+    for (size_t i = 0; i < triggers.size(); i++) {
+        const OutputTrigger& t = triggers[i];
+        const char* scale = t.scale < scales.size() ? scales[t.scale]->id.c_str() : "";
+        int n = snprintf(item, sizeof(item),
+                         "%s{\"wall_ms\": %lld, \"scale\": \"%s\", \"rule\": %u, \"gpio\": %u, "
+                         "\"condition\": \"%s\", \"threshold_g\": %.2f, \"net_g\": %.2f, "
+                         "\"predicted\": %s, \"latency_us\": %.1f}",
+                         i > 0 ? "," : "", static_cast<long long>(t.wall_ms), scale, t.rule, t.gpio,
+                         output_condition_name(t.condition), from_fixed(t.threshold_g), from_fixed(t.net_g),
+                         t.predicted ? "true" : "false", t.latency_ns / 1000.0);
+        json.append(item, std::min<int>(n, sizeof(item) - 1));
+    }
+    json += "]}";
+    return send_json(connection, MHD_HTTP_OK, json);
+}
+
+static MHD_Result reset_container_request(struct MHD_Connection* connection, ScaleChannel& channel, bool post) {
+    MHD_Result refused;
+    if (!change_allowed(connection, post, &refused)) return refused;
+    channel.inputWeight.store(0);
+    return send_json(connection, MHD_HTTP_OK, "{\"container_g\": 0}", false);
+}
+
+// Feeds /api/stream from the sample ring
+class SampleEventSource : public EventSource {
+public:
+    uint64_t head() const override { return scales[0]->ring.head(); }
+    uint64_t oldest() const override { return scales[0]->ring.oldest(); }
     
-    long read_average(int times = 10) {
-        long sum = 0;
-        for (int i = 0; i < times; i++) {
-            sum += read();
+    int format_event(uint64_t seq, char* buf, size_t max) const override {
+        Sample s;
+        if (!scales[0]->ring.get(seq, s)) return 0;
+        char header[48];
+        snprintf(header, sizeof(header), "id: %llu\ndata: ", static_cast<unsigned long long>(seq));
+        int length = write_event(buf, max, header, render_sample_json, s);
+        // The sample that settles the reading also raises a "settle" event
+        if (length > 0 && s.settled) {
+            int settle = write_event(buf + length, max - length, "event: settle\ndata: ", render_settle_json, s);
+            if (settle < 0) return -1;
+            length += settle;
         }
-        return sum / times;
+        return length;
+    }
+
+private:
+    // header + rendered JSON + blank line; -1 if it does not fit
+    static int write_event(char* buf, size_t max, const char* header,
+                           size_t (*render)(const Sample&, char*, size_t), const Sample& s) {
+        size_t headerLength = strlen(header);
+        if (headerLength + 2 >= max) return -1;
+        memcpy(buf, header, headerLength);
+        size_t json = render(s, buf + headerLength, max - headerLength - 2);
+        if (json == 0) return -1;
+        memcpy(buf + headerLength + json, "\n\n", 2);
+        return headerLength + json + 2;
+    }
+};
+
+SampleEventSource sampleEvents;
+EventStream sampleStream(sampleEvents);  // /api/stream, for scales[0]
+
+// Run one raw sample through its scale's filter and stability detector
+// and publish the result
+static void process_sample(ScaleChannel& channel, const RawSample& sample) {
+    // Switch to a chain set through the filter endpoint
+    FilterChain* replacement = channel.pendingFilter.exchange(nullptr);
+    if (replacement != nullptr) {
+        delete channel.filter;
+        channel.filter = replacement;
+    }
+    OutputRuleSet* rules = channel.pendingOutputs.exchange(nullptr);
+    if (rules != nullptr) {
+        if (channel.outputs != nullptr) channel.outputs->release(outputBank);
+        delete channel.outputs;
+        rules->claim(outputBank);
+        channel.outputs = rules;
+        outputBank.claimed(channel.index, rules->pins());
     }
     
-    void tare(int times = 10) {
-        long sum = read_average(times);
-        set_offset(sum);
+    // Until the boot tare only the raw value is kept, for the tare itself
+    if (!channel.calibrated.load(std::memory_order_acquire)) {
+        Sample out = {};
+        out.timestamp_us = sample.timestamp_us;
+        out.wall_ms = wall_clock_ms();
+        out.raw = sample.value;
+        channel.ring.publish(out);
+        return;
     }
     
-    void set_scale(float scale) {
-        SCALE = scale;
+    fixed_t grams = channel.scale.to_units(sample.value);
+    
+    Sample out;
+    out.timestamp_us = sample.timestamp_us;
+    out.wall_ms = wall_clock_ms();
+    out.raw = sample.value;
+    uint64_t filterStart = monotonic_ns();
+    out.weight_g = channel.filter != nullptr ? channel.filter->update(grams, sample.timestamp_us) : grams;
+    channel.filterTime.observe(monotonic_ns() - filterStart);
+    out.container_g = channel.inputWeight.load(std::memory_order_relaxed);
+    out.net_g = out.weight_g - out.container_g;
+    // Settling and flow are statistics over a window of samples, in double
+    double net = from_fixed(out.net_g);
+    out.settled = channel.stability.update(from_fixed(out.weight_g), out.timestamp_us, out.wall_ms);
+    out.stable = channel.stability.stable();
+    out.settled_at_ms = channel.stability.settled_at_ms();
+    out.time_to_settle_ms = channel.stability.time_to_settle_ms();
+    
+    // Flow and, with a target set, when to stop the fill
+    channel.flow.update(net, out.timestamp_us);
+    out.flow_gps = to_fixed(channel.flow.rate());
+    out.target_g = channel.targetWeight.load(std::memory_order_relaxed);
+    FillPrediction fill = predict_fill(channel.flow, from_fixed(out.target_g), flowInflightS);
+    out.time_to_target_s = fill.time_to_target_s;
+    out.cutoff_g = to_fixed(fill.cutoff_g);
+    out.time_to_cutoff_s = fill.time_to_cutoff_s;
+    
+    // Drive the outputs before anything is published, so a valve closes
+    // without waiting on the ring, history or JSON
+    if (channel.outputs != nullptr) {
+        channel.outputs->evaluate(out, channel.flow, sample.scale, outputBank);
+    }
+    uint64_t seq = channel.ring.publish(out);
+    if (telemetry.running()) {
+        telemetry.offer(out, sample.scale);
     }
     
-    void set_offset(long offset) {
-        OFFSET = offset;
+    bool primary = &channel == scales[0].get();
+    if (primary && historyStore.is_open()) {
+        HistoryRecord record;
+        record.timestamp_ms = out.wall_ms;
+        record.weight_g = from_fixed(out.weight_g);
+        record.net_g = net;
+        record.raw = out.raw;
+        record.flags = out.stable ? HISTORY_FLAG_STABLE : 0;
+        historyStore.append(record);
     }
     
-    float get_units(int times = 10) {
-        return (read_average(times) - OFFSET) / SCALE;
+    // Render the JSON once here so requests only hand out the cached copy
+    char* json = channel.cache.begin_update();
+    if (json != nullptr) {
+        channel.cache.commit_update(seq, render_sample_json(out, json, channel.cache.body_max()));
+    }
+    if (primary) {
+        sampleStream.notify();
     }
+}
+
+// Render the latest sample of every scale into the /api/scales body
+static void publish_all_scales(uint64_t version) {
+    static std::vector<const char*> ids(scales.size());  // sized once; scales never change
+    static std::vector<Sample> latest(scales.size());
+    static std::vector<const Sample*> present(scales.size());
+    for (size_t i = 0; i < scales.size(); i++) {
+        ids[i] = scales[i]->id.c_str();
+        present[i] = scales[i]->ring.latest(latest[i]) ? &latest[i] : nullptr;
+    }
+    char* json = allScalesCache->begin_update();
+    if (json != nullptr) {
+        allScalesCache->commit_update(version, render_scales_json(ids.data(), present.data(), scales.size(),
+                                                                  json, allScalesCache->body_max()));
+    }
+}
 
+// Thread function for continuous measurement. Sleeps until a backend
+// queues a conversion, so it runs at the chips' own rate.
+void measurement_thread() {
+    RawSample sample;
+    uint64_t bursts = 0;
     
-};
+    while (running) {
+        if (!sampleQueue.pop(sample, 500)) {
+            continue;
+        }
+        if (sample.scale < scales.size()) {
+            process_sample(*scales[sample.scale], sample);
+        }
+        // Scales read in the same clock burst arrive back to back; publish
+        // them together once the burst is drained
+        if (sampleQueue.empty()) {
+            publish_all_scales(++bursts);
+        }
+    }
+}
 
-// Global variables (PLACE THESE BEFORE ANY FUNCTIONS THAT USE THEM)
-HX711* scale = nullptr;
-float calibration_factor = -1100.0;
-float inputWeight = 0.0;
-float currentWeight = 0.0;
-float netWeight = 0.0;
-const float gramsToFluidOunces = 0.03527396;
-std::mutex weightMutex;
-std::atomic<bool> running{true};
+// Counts libmicrohttpd connections in and out for /metrics
+static void track_connection(void *cls, struct MHD_Connection *connection,
+                             void **socket_context, enum MHD_ConnectionNotificationCode code) {
+    if (code == MHD_CONNECTION_NOTIFY_STARTED) {
+        openConnections.fetch_add(1, std::memory_order_relaxed);
+    } else if (code == MHD_CONNECTION_NOTIFY_CLOSED) {
+        openConnections.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
 
-// Forward declaration
-static MHD_Result handle_request(void *cls, struct MHD_Connection *connection,
-                          const char *url, const char *method,
-                          const char *version, const char *upload_data,
-                          unsigned int *upload_data_size, void **con_cols);
+// NAME="ID" for a scale or device id, which may be longer than a fixed
+// label buffer; a cut-off label would make the whole scrape unparseable
+static std::string id_label(const char* name, const std::string& id) {
+    return std::string(name) + "=\"" + id + "\"";
+}
 
-// Thread function for continuous measurement
-void measurement_thread() {
-    while (running) {
-        float weight = scale->get_units(5);  // Average 5 readings
+// Body of /metrics in the Prometheus text format. Everything is read from
+// counters the hot paths keep anyway, so a scrape costs them nothing.
+static std::string render_metrics() {
+    std::string out;
+    char labels[64];  // backend numbers and route names
+    
+    append_metric_header(out, "fluid_samples_total", "counter", "Samples processed per scale.");
+    for (const auto& channel : scales) {
+        append_metric(out, "fluid_samples_total", id_label("scale", channel->id).c_str(), channel->ring.head());
+    }
+    append_metric_header(out, "fluid_last_sample_age_seconds", "gauge", "Time since the scale's newest sample.");
+    int64_t now = wall_clock_ms();
+    for (const auto& channel : scales) {
+        Sample latest;
+        if (!channel->ring.latest(latest)) continue;
+        append_metric(out, "fluid_last_sample_age_seconds", id_label("scale", channel->id).c_str(), (now - latest.wall_ms) / 1000.0);
+    }
+    append_metric_header(out, "fluid_filter_seconds", "histogram", "Filter chain update time per sample.");
+    for (const auto& channel : scales) {
+        channel->filterTime.render(out, "fluid_filter_seconds", id_label("scale", channel->id).c_str());
+    }
+    
+    append_metric_header(out, "fluid_output_triggers_total", "counter", "Output rules fired, all scales.");
+    append_metric(out, "fluid_output_triggers_total", "", outputBank.trigger_count());
+    append_metric_header(out, "fluid_output_latency_seconds", "histogram",
+                         "Delay from a sample being taken to the output pin its rule fired being written.");
+    outputBank.latency().render(out, "fluid_output_latency_seconds", "");
+    
+    if (telemetry.running()) {
+        TelemetryStats stats = telemetry.stats();
+        append_metric_header(out, "fluid_telemetry_samples_total", "counter",
+                             "Samples for the telemetry publisher, by what became of them.");
+        append_metric(out, "fluid_telemetry_samples_total", "result=\"sent\"", stats.sent);
+        append_metric(out, "fluid_telemetry_samples_total", "result=\"dropped_queue\"", stats.dropped_queue);
+        append_metric(out, "fluid_telemetry_samples_total", "result=\"dropped_network\"", stats.dropped_network);
+        append_metric_header(out, "fluid_telemetry_frames_total", "counter", "Telemetry frames sent.");
+        append_metric(out, "fluid_telemetry_frames_total", "", stats.frames);
+        append_metric_header(out, "fluid_telemetry_connects_total", "counter", "MQTT sessions established.");
+        append_metric(out, "fluid_telemetry_connects_total", "", stats.connects);
+        append_metric_header(out, "fluid_telemetry_connected", "gauge", "1 while telemetry can be sent.");
+        append_metric(out, "fluid_telemetry_connected", "", stats.connected ? 1 : 0);
+    }
+    
+    if (fleet.running()) {
+        std::vector<FleetDeviceStats> devices = fleet.stats();
+        append_metric_header(out, "fluid_fleet_connected", "gauge", "1 while the aggregator streams from the scale.");
+        for (const FleetDeviceStats& device : devices) {
+            append_metric(out, "fluid_fleet_connected", id_label("device", device.id).c_str(), device.connected ? 1 : 0);
+        }
+        append_metric_header(out, "fluid_fleet_stale", "gauge", "1 while the scale's newest measurement is stale.");
+        for (const FleetDeviceStats& device : devices) {
+            append_metric(out, "fluid_fleet_stale", id_label("device", device.id).c_str(), device.stale ? 1 : 0);
+        }
+        append_metric_header(out, "fluid_fleet_samples_total", "counter", "Measurements received per scale.");
+        for (const FleetDeviceStats& device : devices) {
+            append_metric(out, "fluid_fleet_samples_total", id_label("device", device.id).c_str(), device.samples);
+        }
+        append_metric_header(out, "fluid_fleet_connects_total", "counter", "Event streams established per scale.");
+        for (const FleetDeviceStats& device : devices) {
+            append_metric(out, "fluid_fleet_connects_total", id_label("device", device.id).c_str(), device.connects);
+        }
+        append_metric_header(out, "fluid_fleet_subscribers", "gauge", "Open /api/fleet/stream connections.");
+        append_metric(out, "fluid_fleet_subscribers", "", fleet.subscriber_count());
+    }
+    
+    append_metric_header(out, "fluid_samples_dropped_total", "counter",
+                         "Samples dropped because the measurement thread fell behind.");
+    append_metric(out, "fluid_samples_dropped_total", "", sampleQueue.dropped_count());
+    std::vector<AcquisitionStats> stats;
+    for (SensorBackend* sensor : sensors) {
+        stats.push_back(sensor->stats());
+    }
+    append_metric_header(out, "fluid_sensor_frames_total", "counter", "Frames acquired per sensor backend.");
+    for (size_t i = 0; i < stats.size(); i++) {
+        snprintf(labels, sizeof(labels), "backend=\"%zu\"", i);
+        append_metric(out, "fluid_sensor_frames_total", labels, stats[i].frames);
+    }
+    append_metric_header(out, "fluid_sensor_frames_discarded_total", "counter",
+                         "Frames dropped because clocking overran the HX711 timing.");
+    for (size_t i = 0; i < stats.size(); i++) {
+        snprintf(labels, sizeof(labels), "backend=\"%zu\"", i);
+        append_metric(out, "fluid_sensor_frames_discarded_total", labels, stats[i].discarded);
+    }
+    append_metric_header(out, "fluid_sensor_frame_max_seconds", "gauge", "Longest time spent clocking one frame.");
+    for (size_t i = 0; i < stats.size(); i++) {
+        snprintf(labels, sizeof(labels), "backend=\"%zu\"", i);
+        append_metric(out, "fluid_sensor_frame_max_seconds", labels, stats[i].max_frame_ns / 1e9);
+    }
+    append_metric_header(out, "fluid_sensor_ready_wait_seconds", "histogram",
+                         "Delay from a conversion being ready (DOUT low) to reading it.");
+    for (size_t i = 0; i < sensors.size(); i++) {
+        snprintf(labels, sizeof(labels), "backend=\"%zu\"", i);
+        sensors[i]->ready_wait().render(out, "fluid_sensor_ready_wait_seconds", labels);
+    }
+    append_metric_header(out, "fluid_sensor_read_seconds", "histogram", "Time to read one conversion.");
+    for (size_t i = 0; i < sensors.size(); i++) {
+        snprintf(labels, sizeof(labels), "backend=\"%zu\"", i);
+        sensors[i]->read_time().render(out, "fluid_sensor_read_seconds", labels);
+    }
+    
+    append_metric_header(out, "fluid_http_request_seconds", "histogram",
+                         "Time to handle a request and queue its response, per route.");
+    for (unsigned route = 0; route < ROUTE_COUNT; route++) {
+        snprintf(labels, sizeof(labels), "route=\"%s\"", routeNames[route]);
+        requestTime[route].render(out, "fluid_http_request_seconds", labels);
+    }
+    append_metric_header(out, "fluid_http_connections", "gauge", "Open HTTP connections, including streams.");
+    append_metric(out, "fluid_http_connections", "", openConnections.load(std::memory_order_relaxed));
+    return out;
+}
+
+// The dashboard, straight from memory; false if `url` is none of its files
+static bool serve_dashboard(struct MHD_Connection *connection, const char *url, Route *route, MHD_Result *result) {
+    const StaticAssets* assets = webAssets.load(std::memory_order_acquire);
+    if (assets != nullptr && assets->serve(connection, url, result)) {
+        *route = ROUTE_STATIC;
+        return true;
+    }
+    if (assets == nullptr && webAssetsPending) {
+        *result = send_json(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "{\"error\": \"starting up\"}");
+        return true;
+    }
+    return false;
+}
+
+// /api/ENDPOINT or /api/scales/ID/ENDPOINT for an endpoint that changes the scale
+static bool changes_scale(const char* url) {
+    static const char* const endpoints[] = { "filter", "tare", "calibrate", "reset_container", "target", "outputs" };
+    if (0 != strncmp(url, "/api/", 5)) return false;
+    const char* name = strrchr(url, '/') + 1;
+    if (name != url + 5 && (0 != strncmp(url, "/api/scales/", 12) || strchr(url + 12, '/') != name - 1)) return false;
+    for (const char* endpoint : endpoints) {
+        if (0 == strcmp(name, endpoint)) return true;
+    }
+    return false;
+}
+
+// Answer a GET request, or a POST that changes a scale, setting `route`
+// for the timing
+static MHD_Result dispatch_request(struct MHD_Connection *connection, const char *url, bool post, Route *route) {
+    *route = ROUTE_OTHER;
+    
+    // Only the endpoints that change a scale take a POST
+    if (post && !changes_scale(url)) {
+        return send_json(connection, MHD_HTTP_METHOD_NOT_ALLOWED, "{\"error\": \"not an endpoint that changes a scale\"}", false);
+    }
+    
+    // Handle API requests
+    if (0 == strcmp(url, "/api/measurements")) {
+        *route = ROUTE_MEASUREMENTS;
+        // Pre-rendered by measurement_thread; 304 if the client has it already
+        return scales[0]->cache.serve(connection);
+    } 
+    else if (0 == strcmp(url, "/api/recent")) {
+        *route = ROUTE_RECENT;
+        // Recent history straight out of the ring, oldest first
+        unsigned count = 30;
+        const char* n = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "n");
+        if (n != nullptr) {
+            count = std::min<unsigned>(strtoul(n, nullptr, 10), SampleRing::CAPACITY);
+        }
+        std::vector<Sample> recent(count);
+        count = scales[0]->ring.history(recent.data(), count);
         
-        {
-            std::lock_guard<std::mutex> lock(weightMutex);
-            currentWeight = weight;
-            netWeight = weight - inputWeight;
+        std::string json = "[";
+        char item[SAMPLE_JSON_MAX];
+        for (unsigned i = 0; i < count; i++) {
+            if (i > 0) json += ",";
+            json.append(item, render_sample_json(recent[i], item, sizeof(item)));
         }
+        json += "]";
+        return send_json(connection, MHD_HTTP_OK, json);
+    }
+    else if (0 == strcmp(url, "/api/filter")) {
+        *route = ROUTE_FILTER;
+        return filter_request(connection, *scales[0], post);
+    }
+    else if (0 == strcmp(url, "/api/tare")) {
+        *route = ROUTE_TARE;
+        return tare_request(connection, *scales[0], post);
+    }
+    else if (0 == strcmp(url, "/api/calibrate")) {
+        *route = ROUTE_CALIBRATE;
+        return calibrate_request(connection, *scales[0], post);
+    }
+    else if (0 == strcmp(url, "/api/reset_container")) {
+        *route = ROUTE_RESET_CONTAINER;
+        return reset_container_request(connection, *scales[0], post);
+    }
+    else if (0 == strcmp(url, "/api/target")) {
+        *route = ROUTE_TARGET;
+        return target_request(connection, *scales[0], post);
+    }
+    else if (0 == strcmp(url, "/api/outputs")) {
+        *route = ROUTE_OUTPUTS;
+        return outputs_request(connection, *scales[0], post);
+    }
+    else if (0 == strcmp(url, "/api/triggers")) {
+        *route = ROUTE_TRIGGERS;
+        return triggers_request(connection);
+    }
+    else if (0 == strcmp(url, "/api/scales")) {
+        *route = ROUTE_SCALES;
+        // Latest sample of every scale, re-rendered once per clock burst
+        return allScalesCache->serve(connection);
+    }
+    else if (0 == strncmp(url, "/api/scales/", 12)) {
+        *route = ROUTE_SCALE;
+        // /api/scales/{id}/ + measurements, filter, tare, calibrate, reset_container, target or outputs
+        const char* id = url + 12;
+        const char* slash = strchr(id, '/');
+        ScaleChannel* channel = slash != nullptr ? find_scale(std::string(id, slash - id)) : nullptr;
+        if (channel == nullptr) {
+            return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\": \"no such scale\"}");
+        }
+        if (0 == strcmp(slash, "/measurements")) return channel->cache.serve(connection);
+        if (0 == strcmp(slash, "/filter")) return filter_request(connection, *channel, post);
+        if (0 == strcmp(slash, "/tare")) return tare_request(connection, *channel, post);
+        if (0 == strcmp(slash, "/calibrate")) return calibrate_request(connection, *channel, post);
+        if (0 == strcmp(slash, "/reset_container")) return reset_container_request(connection, *channel, post);
+        if (0 == strcmp(slash, "/target")) return target_request(connection, *channel, post);
+        if (0 == strcmp(slash, "/outputs")) return outputs_request(connection, *channel, post);
+        return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\": \"unknown scale endpoint\"}");
+    }
+    else if (0 == strcmp(url, "/api/history")) {
+        *route = ROUTE_HISTORY;
+        // ?from=&to= in epoch ms (default: the last hour), step= bucket size in ms
+        int64_t now = wall_clock_ms();
+        int64_t to = query_int64(connection, "to", now);
+        int64_t from = query_int64(connection, "from", history_time(to, now) ? std::max<int64_t>(to - 3600 * 1000, 0) : 0);
+        int64_t requested = query_int64(connection, "step", 0);
+        int64_t step = requested;
+        if (!history_time(from, now) || !history_time(to, now)) {
+            return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"from and to are epoch ms, at most a day ahead\"}");
+        }
+        if (to < from) {
+            return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"to is before from\"}");
+        }
+        if (step <= 0) step = std::max<int64_t>((to - from) / DEFAULT_HISTORY_POINTS, 1);
+        if ((to - from) / step > MAX_HISTORY_POINTS) step = (to - from) / MAX_HISTORY_POINTS + 1;
+        if (step != requested) step = HistoryStore::rollup_step(step);  // let the rollups answer
         
-        // Delay between measurements
-        usleep(500000);  // 500ms
+        std::vector<HistoryPoint> points;
+        historyStore.query(from, to, step, points);
+        
+        // points: [bucket start ms, mean, min, max] of the fluid weight in grams
+        char item[128];
+        snprintf(item, sizeof(item), "{\"from\": %lld, \"to\": %lld, \"step\": %lld, \"points\": [",
+                 static_cast<long long>(from), static_cast<long long>(to), static_cast<long long>(step));
+        std::string json = item;
+        json.reserve(json.size() + points.size() * 48);
+        for (size_t i = 0; i < points.size(); i++) {
+            const HistoryPoint& p = points[i];
+            int n = snprintf(item, sizeof(item), "%s[%lld,%g,%g,%g]", i > 0 ? "," : "",
+                             static_cast<long long>(p.timestamp_ms), p.mean_g, p.min_g, p.max_g);
+            json.append(item, n);
+        }
+        json += "]}";
+        return send_json(connection, MHD_HTTP_OK, json);
+    }
+    else if (0 == strcmp(url, "/api/history/export")) {
+        *route = ROUTE_HISTORY_EXPORT;
+        // Every raw sample in ?from=&to= (epoch ms, default: all of it),
+        // streamed as ?format=gorilla (default) or csv
+        int64_t now = wall_clock_ms();
+        int64_t to = query_int64(connection, "to", now);
+        int64_t from = query_int64(connection, "from", 0);
+        const char* name = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "format");
+        HistoryExportFormat format = EXPORT_GORILLA;
+        if (name != nullptr && !parse_export_format(name, format)) {
+            return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"format is gorilla or csv\"}");
+        }
+        if (!history_time(from, now) || !history_time(to, now)) {
+            return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"from and to are epoch ms, at most a day ahead\"}");
+        }
+        if (to < from) {
+            return send_json(connection, MHD_HTTP_BAD_REQUEST, "{\"error\": \"to is before from\"}");
+        }
+        if (!historyStore.is_open()) {
+            return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\": \"history is disabled\"}");
+        }
+        return serve_history_export(connection, historyStore, from, to, format);
     }
+    else if (0 == strcmp(url, "/api/acquisition")) {
+        *route = ROUTE_ACQUISITION;
+        // Clocking health per backend: frames delivered and dropped, and how
+        // long clocking a frame took, in µs
+        char item[256];
+        snprintf(item, sizeof(item), "{\"queue_dropped\": %lu, \"backends\": [", sampleQueue.dropped_count());
+        std::string json = item;
+        for (size_t i = 0; i < sensors.size(); i++) {
+            AcquisitionStats stats = sensors[i]->stats();
+            unsigned long clocked = stats.frames + stats.discarded;
+            int n = snprintf(item, sizeof(item),
+                             "%s{\"frames\": %lu, \"discarded\": %lu, \"last_frame_us\": %.1f, "
+                             "\"mean_frame_us\": %.1f, \"max_frame_us\": %.1f}",
+                             i > 0 ? "," : "", stats.frames, stats.discarded, stats.last_frame_ns / 1000.0,
+                             clocked > 0 ? stats.total_frame_ns / 1000.0 / clocked : 0.0,
+                             stats.max_frame_ns / 1000.0);
+            json.append(item, n);
+        }
+        json += "]}";
+        return send_json(connection, MHD_HTTP_OK, json);
+    }
+    else if (0 == strcmp(url, "/api/stream")) {
+        *route = ROUTE_STREAM;
+        // Long-lived Server-Sent Events stream, one event per sample
+        return sampleStream.open(connection);
+    }
+    else if (0 == strcmp(url, "/metrics")) {
+        *route = ROUTE_METRICS;
+        return send_body(connection, MHD_HTTP_OK, "text/plain; version=0.0.4", render_metrics());
+    }
+    else {
+        MHD_Result result;
+        if (serve_dashboard(connection, url, route, &result)) {
+            return result;
+        }
+    }
+    
+    return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\": \"not found\"}");
+}
+
+// Aggregator mode has no scales of its own, only the fleet table
+static MHD_Result dispatch_fleet_request(FleetAggregator& aggregator, struct MHD_Connection *connection,
+                                         const char *url, Route *route) {
+    *route = ROUTE_OTHER;
+    MHD_Result result;
+    
+    if (0 == strcmp(url, "/api/fleet")) {
+        *route = ROUTE_FLEET;
+        // Every device's newest measurement and health, re-rendered once per coalesced update
+        return aggregator.serve_snapshot(connection);
+    }
+    else if (0 == strcmp(url, "/api/fleet/stream")) {
+        *route = ROUTE_FLEET_STREAM;
+        // One event per device update, starting with every device's current state
+        return aggregator.open_stream(connection);
+    }
+    else if (0 == strcmp(url, "/metrics")) {
+        *route = ROUTE_METRICS;
+        return send_body(connection, MHD_HTTP_OK, "text/plain; version=0.0.4", render_metrics());
+    }
+    else if (serve_dashboard(connection, url, route, &result)) {
+        return result;
+    }
+    
+    return send_json(connection, MHD_HTTP_NOT_FOUND, "{\"error\": \"not found; this is an aggregator, see /api/fleet\"}");
 }
 
 // Actual handle_request implementation
@@ -165,8 +991,6 @@ static MHD_Result handle_request(void *cls, struct MHD_Connection *connection,
                           unsigned int *upload_data_size, void **con_cols) {
     
     static int request_counter = 0;
-    struct MHD_Response *response;
-    MHD_Result ret;
     
     // First call for this request - do nothing
     if (nullptr == *con_cols) {
@@ -174,91 +998,296 @@ static MHD_Result handle_request(void *cls, struct MHD_Connection *connection,
         return MHD_YES;
     }
     
-    // Process only GET requests
-    if (0 != strcmp(method, "GET"))
+    // Process GET requests, and POSTs that change a scale (cls is the
+    // aggregator in aggregator mode, which has none)
+    bool post = 0 == strcmp(method, "POST");
+    if (0 != strcmp(method, "GET") && !(post && cls == nullptr))
         return MHD_NO;
+    if (post && *upload_data_size != 0) {
+        *upload_data_size = 0;  // arguments come in the query string
+        return MHD_YES;
+    }
     
-    // Handle API requests
-    if (0 == strcmp(url, "/api/measurements")) {
-        // Create JSON with current weight measurements
-        std::stringstream ss;
-        
-        // Lock for thread safety
-        {
-            std::lock_guard<std::mutex> lock(weightMutex);
-            ss << "{";
-            ss << "\"measured_weight_g\": " << currentWeight << ",";
-            ss << "\"measured_weight_oz\": " << (currentWeight * gramsToFluidOunces) << ",";
-            ss << "\"container_weight_g\": " << inputWeight << ",";
-            ss << "\"container_weight_oz\": " << (inputWeight * gramsToFluidOunces) << ",";
-            ss << "\"fluid_weight_g\": " << netWeight << ",";
-            ss << "\"fluid_weight_oz\": " << (netWeight * gramsToFluidOunces);
-            ss << "}";
-        }
-        
-        // Create and send response
-        std::string json = ss.str();
-        response = MHD_create_response_from_buffer(json.length(), (void*)json.c_str(), MHD_RESPMEM_MUST_COPY);
-        MHD_add_response_header(response, "Content-Type", "application/json");
-        MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
-        ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
-        MHD_destroy_response(response);
-        return ret;
-    } 
-    // Rest of your existing request handling code...
+    uint64_t start = monotonic_ns();
+    Route route;
+    MHD_Result result = cls != nullptr
+        ? dispatch_fleet_request(*static_cast<FleetAggregator*>(cls), connection, url, &route)
+        : dispatch_request(connection, url, post, &route);
+    requestTime[route].observe(monotonic_ns() - start);
+    return result;
+}
+
+// Delete the scales and their backends, returning the output pins to
+// their inactive level; acquisition must be stopped
+static void release_scales() {
+    for (auto& channel : scales) {
+        if (channel->outputs != nullptr) channel->outputs->release(outputBank);
+    }
+    scales.clear();
+    for (SensorBackend* sensor : sensors) {
+        delete sensor;
+    }
+    sensors.clear();
+    delete allScalesCache;
+    allScalesCache = nullptr;
+}
+
+// Block the stop signals in every thread we (or pigpio) start; main
+// collects them with sigwait()
+static void block_stop_signals(sigset_t& stopSignals) {
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+}
+
+// Compressing the dashboard takes a while on a Pi; the API is up meanwhile
+static void load_dashboard(const std::string& webRoot) {
+    if (!webAssetsPending) return;
+    StaticAssets* assets = new StaticAssets();
+    std::string webError;
+    if (assets->load(webRoot, &webError)) {
+        webAssets.store(assets, std::memory_order_release);
+        std::cout << "Serving " << assets->count() << " dashboard files from " << webRoot << std::endl;
+    } else {
+        std::cerr << "Continuing without the dashboard: " << webError << std::endl;
+        delete assets;
+    }
+    webAssetsPending = false;
+}
+
+// Aggregator mode: no sensors, only subscriptions to the configured
+// scales, merged at /api/fleet and /api/fleet/stream
+static int run_aggregator(const ServerConfig& serverConfig) {
+    sigset_t stopSignals;
+    block_stop_signals(stopSignals);
+    webAssetsPending = !serverConfig.web_root.empty();
     
-    return MHD_YES;
+    std::string fleetError;
+    if (!fleet.start(serverConfig.fleet, &fleetError)) {
+        std::cerr << "Failed to start the aggregator: " << fleetError << std::endl;
+        return 1;
+    }
+    
+    std::cout << "Fluid Measurement Aggregator, " << serverConfig.fleet.devices.size() << " scales" << std::endl;
+    std::cout << "Starting web server on port " << serverConfig.port
+              << " (" << engine_name(serverConfig.engine) << " engine)" << std::endl;
+    struct MHD_Daemon *daemon = start_http_daemon(
+        serverConfig, reinterpret_cast<MHD_AccessHandlerCallback>(handle_request), &fleet, track_connection);
+    if (daemon == NULL) {
+        std::cerr << "Failed to start web server" << std::endl;
+        fleet.stop();
+        return 1;
+    }
+    load_dashboard(serverConfig.web_root);
+    
+    std::cout << "Aggregator started. Send SIGINT or SIGTERM to stop." << std::endl;
+    int signal = 0;
+    sigwait(&stopSignals, &signal);
+    
+    fleet.stop();
+    MHD_stop_daemon(daemon);
+    delete webAssets.exchange(nullptr);
+    return 0;
 }
 
-int main() {
+int main(int argc, char** argv) {
+    uint64_t startUs = monotonic_us();
+    
+    ServerConfig serverConfig;
+    if (!parse_server_args(argc, argv, serverConfig)) {
+        return 1;
+    }
+    if (!serverConfig.fleet.devices.empty()) {
+        return run_aggregator(serverConfig);
+    }
     
-    // Check if Wi-Fi is configured
-    if (!is_wifi_configured()) {
+    std::vector<ScaleConfig> scaleConfigs = configured_scales(serverConfig);
+    std::vector<std::string> sensorSpecs;
+    bool hardware = false;
+    for (const ScaleConfig& config : scaleConfigs) {
+        std::string filterError;
+        FilterChain* chain = build_filter_chain(config.filter, &filterError);
+        if (chain == nullptr) {
+            std::cerr << "Bad filter setting for scale " << config.id << ": " << filterError << std::endl;
+            return 1;
+        }
+        delete chain;
+        OutputRuleSet* rules = build_output_rules(config.outputs, &filterError);
+        if (rules == nullptr) {
+            std::cerr << "Bad outputs setting for scale " << config.id << ": " << filterError << std::endl;
+            return 1;
+        }
+        delete rules;
+        sensorSpecs.push_back(config.sensor);
+        hardware = hardware || is_hardware_sensor(config.sensor);
+    }
+    
+    stableWindow = serverConfig.stable_window;
+    stableStddev = serverConfig.stable_stddev_g;
+    flowWindow = serverConfig.flow_window;
+    flowInflightS = serverConfig.flow_inflight_ms / 1000.0;
+    
+    // Check if Wi-Fi is configured; simulated sensors run on any box as is
+    if (hardware && !is_wifi_configured()) {
         std::cout << "No Wi-Fi configuration found. Starting setup mode..." << std::endl;
-        start_ap_mode();
+        start_ap_mode(serverConfig.wifi_scan_command, serverConfig.wifi_scan_interval_s);
         return 0;
     }
     
-    // Initialize pigpio
-    if (gpioInitialise() == -1) {
-        std::cerr << "Failed to initialize pigpio" << std::endl;
+    sigset_t stopSignals;
+    block_stop_signals(stopSignals);
+    
+    if (!serverConfig.history_file.empty() &&
+        !historyStore.open(serverConfig.history_file,
+                           static_cast<size_t>(serverConfig.history_size_mb) << 20,
+                           serverConfig.history_flush_s)) {
+        std::cerr << "Continuing without measurement history" << std::endl;
+    }
+    
+    webAssetsPending = !serverConfig.web_root.empty();
+    
+    // Initialize the sensors (pigpio for HX711s)
+    std::string sensorError;
+    std::vector<SensorBackend*> backendOfScale;
+    AcquisitionOptions acquisition;
+    acquisition.priority = static_cast<int>(serverConfig.acquisition_priority);
+    acquisition.cpu = serverConfig.acquisition_cpu;
+    if (!create_sensor_backends(sensorSpecs, acquisition, sensors, backendOfScale, &sensorError)) {
+        std::cerr << "Failed to start sensors: " << sensorError << std::endl;
+        return 1;
+    }
+    std::string outputError;
+    if (!outputBank.open(serverConfig.output_driver, &outputError)) {
+        std::cerr << "Failed to set up outputs: " << outputError << std::endl;
+        release_scales();
         return 1;
     }
+    std::cout << "Output pins: " << (outputBank.simulated() ? "simulated" : "GPIO registers") << std::endl;
+    for (SensorBackend* sensor : sensors) {
+        outputBank.reserve(sensor->gpio_pins());
+    }
+    std::string calibrationError;
+    if (!calibrationStore.load(serverConfig.calibration_file, &calibrationError)) {
+        std::cerr << "Ignoring saved calibration: " << calibrationError << std::endl;
+    }
+    for (unsigned i = 0; i < scaleConfigs.size(); i++) {
+        const ScaleConfig& config = scaleConfigs[i];
+        scales.emplace_back(new ScaleChannel(i, config.id, backendOfScale[i], stableWindow, stableStddev, flowWindow));
+        ScaleChannel& channel = *scales.back();
+        set_filter_chain(channel, config.filter, nullptr);
+        if (!set_output_rules(channel, config.outputs, &outputError)) {
+            std::cerr << "Bad outputs setting for scale " << config.id << ": " << outputError << std::endl;
+            release_scales();
+            return 1;
+        }
+        
+        // Carry on with the saved tare; without one, tare on the first samples
+        Calibration saved;
+        if (calibrationStore.find(config.id, saved) && channel.scale.set_gain(saved.gain) &&
+            channel.scale.set_scale(saved.factor)) {
+            channel.scale.set_offset(to_fixed(saved.offset));
+            channel.calibrated = true;
+            std::cout << "Scale " << config.id << ": sensor " << config.sensor << ", saved calibration" << std::endl;
+        } else {
+            channel.scale.set_scale(config.calibration);
+            std::cout << "Scale " << config.id << ": sensor " << config.sensor << ", tare pending" << std::endl;
+        }
+    }
+    allScalesCache = new ResponseCache("application/json", scales.size() * (SAMPLE_JSON_MAX + 64) + 16);
     
-    // Initialize the HX711
-    scale = new HX711(DOUT_PIN, CLK_PIN);
-    scale->set_scale(calibration_factor);
-    scale->tare();
+    if (!serverConfig.telemetry.target.empty()) {
+        TelemetrySettings settings = serverConfig.telemetry;
+        for (const ScaleConfig& config : scaleConfigs) {
+            settings.scale_ids.push_back(config.id);
+        }
+        std::string telemetryError;
+        if (!telemetry.start(settings, &telemetryError)) {
+            std::cerr << "Failed to start telemetry: " << telemetryError << std::endl;
+            release_scales();
+            return 1;
+        }
+        std::cout << "Telemetry: " << telemetry.description() << std::endl;
+    }
     
     std::cout << "HX711 Fluid Measurement System" << std::endl;
-    std::cout << "Starting web server on port " << PORT << std::endl;
+    std::cout << "Starting web server on port " << serverConfig.port
+              << " (" << engine_name(serverConfig.engine) << " engine)" << std::endl;
     
     // Create web server
-    struct MHD_Daemon *daemon = MHD_start_daemon(
-        MHD_USE_SELECT_INTERNALLY, PORT, NULL, NULL,
-        reinterpret_cast<MHD_AccessHandlerCallback>(handle_request), NULL, 
-        MHD_OPTION_END
-    );
+    struct MHD_Daemon *daemon = start_http_daemon(
+        serverConfig, reinterpret_cast<MHD_AccessHandlerCallback>(handle_request), NULL, track_connection);
     
     if (daemon == NULL) {
         std::cerr << "Failed to start web server" << std::endl;
-        delete scale;
+        release_scales();
+        return 1;
+    }
+    
+    if (!sampleStream.start()) {
+        std::cerr << "Failed to start event stream" << std::endl;
+        MHD_stop_daemon(daemon);
+        release_scales();
         return 1;
     }
     
-    // Start measurement thread
+    // Start measurement thread and interrupt-driven acquisition
     std::thread meas_thread(measurement_thread);
+    bool acquiring = true;
+    for (SensorBackend* sensor : sensors) {
+        acquiring = acquiring && sensor->start_acquisition(&sampleQueue);
+    }
+    if (!acquiring) {
+        std::cerr << "Failed to start acquisition" << std::endl;
+        for (SensorBackend* sensor : sensors) {
+            sensor->stop_acquisition();
+        }
+        running = false;
+        meas_thread.join();
+        sampleStream.stop();
+        MHD_stop_daemon(daemon);
+        telemetry.stop();
+        release_scales();
+        return 1;
+    }
     
-    std::cout << "Server started. Press Enter to stop." << std::endl;
-    getchar();
+    std::cout << "Serving requests " << (monotonic_us() - startUs) / 1000 << " ms after start" << std::endl;
+    
+    // Scales without a saved calibration tare on their first samples, before
+    // the dashboard is compressed so their first measurement waits on neither
+    for (auto& channel : scales) {
+        if (channel->calibrated) continue;
+        bool tared = false, saved = false;
+        std::string error;
+        for (int waited = 0; !tared && waited < BOOT_TARE_TIMEOUT_MS; waited += 10) {
+            tared = tare_scale(*channel, &saved, &error);
+            if (!tared) usleep(10000);
+        }
+        if (!tared) {
+            std::cerr << "Scale " << channel->id << " has no samples to tare on; waiting for /api/tare" << std::endl;
+        } else if (!saved) {
+            std::cerr << "Scale " << channel->id << " tared but not saved: " << error << std::endl;
+        }
+    }
+    
+    load_dashboard(serverConfig.web_root);
+    
+    std::cout << "Server started. Send SIGINT or SIGTERM to stop." << std::endl;
+    int signal = 0;
+    sigwait(&stopSignals, &signal);
     
     // Cleanup
+    for (SensorBackend* sensor : sensors) {
+        sensor->stop_acquisition();
+    }
     running = false;
     meas_thread.join();
+    sampleStream.stop();
     MHD_stop_daemon(daemon);
-    delete scale;
-    
-    gpioTerminate();
+    telemetry.stop();
+    delete webAssets.exchange(nullptr);
+    historyStore.close();
+    release_scales();
 
     return 0;
 }
@@ -0,0 +1,32 @@
+#include "gpio_registers.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define GPIO_BLOCK_SIZE 4096
+
+GpioRegisters::~GpioRegisters() {
+    if (gpio != nullptr) {
+        munmap(const_cast<uint32_t*>(gpio), GPIO_BLOCK_SIZE);
+    }
+}
+
+bool GpioRegisters::open() {
+    int fd = ::open("/dev/gpiomem", O_RDWR | O_SYNC | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    void* map = mmap(nullptr, GPIO_BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    gpio = static_cast<volatile uint32_t*>(map);
+    return true;
+}
+
+void GpioRegisters::set_output(unsigned pin) {
+    volatile uint32_t& select = gpio[GPFSEL0 + pin / 10];
+    unsigned shift = (pin % 10) * 3;
+    select = (select & ~(7u << shift)) | (1u << shift);
+}
@@ -0,0 +1,36 @@
+#ifndef GPIO_REGISTERS_H
+#define GPIO_REGISTERS_H
+
+#include <stdint.h>
+
+// GPIO bank 0 of the BCM2835/6/7 and BCM2711 (Pi 1-4, Zero), mapped from
+// /dev/gpiomem. Setting, clearing and sampling pins is then a single
+// load or store with no library call or syscall in between, which keeps
+// the HX711 clock pulses short and even. Needs no root, but the Pi 5 has
+// a different GPIO block and is not supported.
+class GpioRegisters {
+public:
+    ~GpioRegisters();
+
+    bool open();
+    bool is_open() const { return gpio != nullptr; }
+
+    void set(uint32_t mask) { gpio[GPSET0] = mask; }
+    void clear(uint32_t mask) { gpio[GPCLR0] = mask; }
+    uint32_t levels() const { return gpio[GPLEV0]; }
+
+    // Switch `pin` (0-31) to an output; its level is whatever was last set
+    void set_output(unsigned pin);
+
+private:
+    // Word offsets of the bank 0 registers; GPFSEL0 and the five after it
+    // hold three mode bits per pin, ten pins per word
+    static const unsigned GPFSEL0 = 0;
+    static const unsigned GPSET0 = 0x1c / 4;
+    static const unsigned GPCLR0 = 0x28 / 4;
+    static const unsigned GPLEV0 = 0x34 / 4;
+
+    volatile uint32_t* gpio = nullptr;
+};
+
+#endif
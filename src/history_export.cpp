@@ -0,0 +1,266 @@
+#include "history_export.h"
+#include <string.h>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+
+bool parse_export_format(const char* name, HistoryExportFormat& format) {
+    if (0 == strcmp(name, "gorilla")) format = EXPORT_GORILLA;
+    else if (0 == strcmp(name, "csv")) format = EXPORT_CSV;
+    else return false;
+    return true;
+}
+
+// Appends bits MSB first
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+
+    void write(uint64_t value, unsigned bits) {
+        if (bits > 32) {
+            write(value >> 32, bits - 32);
+            bits = 32;
+        }
+        pending = (pending << bits) | (value & ((static_cast<uint64_t>(1) << bits) - 1));
+        pendingBits += bits;
+        while (pendingBits >= 8) {
+            pendingBits -= 8;
+            out.push_back(static_cast<uint8_t>(pending >> pendingBits));
+        }
+        pending &= (static_cast<uint64_t>(1) << pendingBits) - 1;
+    }
+
+    // Pad the last byte with zeros
+    void finish() {
+        if (pendingBits > 0) write(0, 8 - pendingBits);
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint64_t pending = 0;  // fewer than 8 bits between writes
+    unsigned pendingBits = 0;
+};
+
+// A signed delta in the narrowest width that holds it
+static void write_delta(BitWriter& bits, int64_t delta) {
+    static const struct {
+        uint32_t prefix;
+        unsigned prefixBits;
+        unsigned width;
+    } widths[] = { { 0x2, 2, 7 }, { 0x6, 3, 9 }, { 0xe, 4, 12 }, { 0x1e, 5, 32 } };
+
+    if (delta == 0) {
+        bits.write(0, 1);
+        return;
+    }
+    for (const auto& w : widths) {
+        int64_t limit = static_cast<int64_t>(1) << (w.width - 1);
+        if (delta >= -limit && delta < limit) {
+            bits.write(w.prefix, w.prefixBits);
+            bits.write(static_cast<uint64_t>(delta), w.width);
+            return;
+        }
+    }
+    bits.write(0x1f, 5);
+    bits.write(static_cast<uint64_t>(delta), 64);
+}
+
+static uint32_t float_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Gorilla's XOR compression, for 32-bit floats
+static void write_floats(BitWriter& bits, const HistoryRecord* records, size_t count, float HistoryRecord::*field) {
+    uint32_t previous = float_bits(records[0].*field);
+    bits.write(previous, 32);
+    unsigned leading = 32, trailing = 0;  // no window yet
+    for (size_t i = 1; i < count; i++) {
+        uint32_t value = float_bits(records[i].*field);
+        uint32_t x = value ^ previous;
+        previous = value;
+        if (x == 0) {
+            bits.write(0, 1);
+            continue;
+        }
+        unsigned lead = __builtin_clz(x);
+        unsigned trail = __builtin_ctz(x);
+        if (leading < 32 && lead >= leading && trail >= trailing) {
+            bits.write(0x2, 2);
+            bits.write(x >> trailing, 32 - leading - trailing);
+        } else {
+            unsigned length = 32 - lead - trail;
+            bits.write(0x3, 2);
+            bits.write(lead, 5);
+            bits.write(length - 1, 5);
+            bits.write(x >> trail, length);
+            leading = lead;
+            trailing = trail;
+        }
+    }
+}
+
+static void write_u32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+// Append `column` with its length
+static void append_column(std::vector<uint8_t>& out, const std::vector<uint8_t>& column) {
+    write_u32(out, column.size());
+    out.insert(out.end(), column.begin(), column.end());
+}
+
+void encode_history_block(const HistoryRecord* records, size_t count, std::vector<uint8_t>& out) {
+    write_u32(out, count);
+    if (count == 0) {
+        return;
+    }
+
+    std::vector<uint8_t> column;
+    column.reserve(count * 9);  // the widest column, timestamps, at its worst
+    {
+        BitWriter bits(column);
+        bits.write(records[0].timestamp_ms, 64);
+        int64_t previousDelta = 0;
+        for (size_t i = 1; i < count; i++) {
+            int64_t delta = records[i].timestamp_ms - records[i - 1].timestamp_ms;
+            write_delta(bits, delta - previousDelta);
+            previousDelta = delta;
+        }
+        bits.finish();
+    }
+    append_column(out, column);
+
+    for (float HistoryRecord::*field : { &HistoryRecord::weight_g, &HistoryRecord::net_g }) {
+        column.clear();
+        BitWriter bits(column);
+        write_floats(bits, records, count, field);
+        bits.finish();
+        append_column(out, column);
+    }
+
+    column.clear();
+    {
+        BitWriter bits(column);
+        bits.write(static_cast<uint32_t>(records[0].raw), 32);
+        for (size_t i = 1; i < count; i++) {
+            write_delta(bits, static_cast<int64_t>(records[i].raw) - records[i - 1].raw);
+        }
+        bits.finish();
+    }
+    append_column(out, column);
+
+    column.clear();
+    {
+        BitWriter bits(column);
+        bits.write(records[0].flags, 32);
+        for (size_t i = 1; i < count; i++) {
+            if (records[i].flags == records[i - 1].flags) {
+                bits.write(0, 1);
+            } else {
+                bits.write(1, 1);
+                bits.write(records[i].flags, 32);
+            }
+        }
+        bits.finish();
+    }
+    append_column(out, column);
+}
+
+// `value` and the character after it, numbers in the shortest form that
+// reads back to the same value
+template <typename T>
+static void append_field(std::vector<uint8_t>& out, T value, char separator) {
+    char text[32];
+    char* end = std::to_chars(text, text + sizeof(text) - 1, value).ptr;
+    *end++ = separator;
+    out.insert(out.end(), text, end);
+}
+
+static void append_csv_row(std::vector<uint8_t>& out, const HistoryRecord& r) {
+    append_field(out, static_cast<long long>(r.timestamp_ms), ',');
+    append_field(out, r.weight_g, ',');
+    append_field(out, r.net_g, ',');
+    append_field(out, r.raw, ',');
+    append_field(out, r.flags & HISTORY_FLAG_STABLE, '\n');
+}
+
+HistoryExport::HistoryExport(const HistoryStore& store, int64_t from_ms, int64_t to_ms, HistoryExportFormat format)
+    : store(store), format(format), cursor(store.raw_cursor(from_ms, to_ms)), block(HISTORY_EXPORT_BLOCK) {
+    pending.reserve(format == EXPORT_CSV ? HISTORY_EXPORT_BLOCK * 80 : HISTORY_EXPORT_BLOCK * 24);
+}
+
+// Encode the next block, or the trailer once the records run out
+void HistoryExport::refill() {
+    pending.clear();
+    pendingAt = 0;
+    if (!started) {
+        started = true;
+        if (format == EXPORT_CSV) {
+            static const char header[] = "timestamp_ms,weight_g,net_g,raw,stable\n";
+            pending.insert(pending.end(), header, header + sizeof(header) - 1);
+        } else {
+            pending.insert(pending.end(), HISTORY_EXPORT_MAGIC, HISTORY_EXPORT_MAGIC + 4);
+        }
+    }
+
+    size_t count = store.read_raw(cursor, block.data(), block.size());
+    exported += count;
+    if (count == 0) {
+        finished = true;
+        if (format == EXPORT_GORILLA) encode_history_block(nullptr, 0, pending);
+        return;
+    }
+    if (format == EXPORT_CSV) {
+        for (size_t i = 0; i < count; i++) {
+            append_csv_row(pending, block[i]);
+        }
+    } else {
+        encode_history_block(block.data(), count, pending);
+    }
+}
+
+size_t HistoryExport::read(char* buf, size_t max) {
+    if (pendingAt == pending.size()) {
+        if (finished) return 0;
+        refill();
+    }
+    size_t n = std::min(max, pending.size() - pendingAt);
+    memcpy(buf, pending.data() + pendingAt, n);
+    pendingAt += n;
+    return n;
+}
+
+static ssize_t read_export(void* cls, uint64_t pos, char* buf, size_t max) {
+    size_t n = static_cast<HistoryExport*>(cls)->read(buf, max);
+    return n > 0 ? static_cast<ssize_t>(n) : MHD_CONTENT_READER_END_OF_STREAM;
+}
+
+static void close_export(void* cls) {
+    delete static_cast<HistoryExport*>(cls);
+}
+
+MHD_Result serve_history_export(struct MHD_Connection* connection, const HistoryStore& store,
+                                int64_t from_ms, int64_t to_ms, HistoryExportFormat format) {
+    HistoryExport* download = new HistoryExport(store, from_ms, to_ms, format);
+    struct MHD_Response* response = MHD_create_response_from_callback(
+        MHD_SIZE_UNKNOWN, HISTORY_EXPORT_CHUNK, read_export, download, close_export);
+    if (response == nullptr) {
+        delete download;
+        return MHD_NO;
+    }
+
+    char disposition[96];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=\"history-%lld-%lld.%s\"",
+             static_cast<long long>(from_ms), static_cast<long long>(to_ms),
+             format == EXPORT_CSV ? "csv" : "fsh");
+    MHD_add_response_header(response, "Content-Type", format == EXPORT_CSV ? "text/csv" : "application/octet-stream");
+    MHD_add_response_header(response, "Content-Disposition", disposition);
+    MHD_add_response_header(response, "Cache-Control", "no-store");
+    MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret;
+}
@@ -0,0 +1,70 @@
+#ifndef HISTORY_EXPORT_H
+#define HISTORY_EXPORT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <microhttpd.h>
+#include "history_store.h"
+
+#define HISTORY_EXPORT_BLOCK 1024         // records encoded at a time
+#define HISTORY_EXPORT_CHUNK (32 * 1024)  // bytes handed to libmicrohttpd at a time
+#define HISTORY_EXPORT_MAGIC "FSH1"
+
+enum HistoryExportFormat {
+    EXPORT_GORILLA,  // compressed columns, see encode_history_block()
+    EXPORT_CSV
+};
+
+// "gorilla" or "csv"
+bool parse_export_format(const char* name, HistoryExportFormat& format);
+
+// Compressed export. The stream is the 4 bytes HISTORY_EXPORT_MAGIC and
+// then blocks of up to HISTORY_EXPORT_BLOCK records, each decodable on its
+// own, ending with a block of 0 records (so a cut-off download shows).
+// A block is a little-endian uint32 record count followed by five columns,
+// each a uint32 byte length and a bit string, MSB first, padded to a byte:
+//   timestamp_ms  first value in 64 bits, then the delta of the deltas
+//   weight_g      first value in 32 bits, then the XOR with the previous
+//   net_g         value as in Gorilla, for 32-bit floats: 0 = same,
+//                 10 = meaningful bits in the previous window, 11 = 5 bits
+//                 of leading zeros, 5 bits of length - 1, then the bits
+//   raw           first value in 32 bits, then the delta from the previous
+//   flags         first value in 32 bits, then 0 = same, 1 + 32 bits
+// Deltas are two's complement, prefixed by their width: 0 = zero,
+// 10 = 7 bits, 110 = 9, 1110 = 12, 11110 = 32, 11111 = 64.
+// Appends the block to `out`.
+void encode_history_block(const HistoryRecord* records, size_t count, std::vector<uint8_t>& out);
+
+// One download of the raw history in [from_ms, to_ms], encoded a block at
+// a time as libmicrohttpd asks for more, so memory stays the same however
+// long the range is
+class HistoryExport {
+public:
+    HistoryExport(const HistoryStore& store, int64_t from_ms, int64_t to_ms, HistoryExportFormat format);
+
+    // Copy the next bytes of the download into `buf`; 0 at the end
+    size_t read(char* buf, size_t max);
+
+    uint64_t records() const { return exported; }
+
+private:
+    void refill();
+
+    const HistoryStore& store;
+    HistoryExportFormat format;
+    HistoryCursor cursor;
+    std::vector<HistoryRecord> block;
+    std::vector<uint8_t> pending;  // encoded, not yet read
+    size_t pendingAt = 0;
+    bool started = false;
+    bool finished = false;
+    uint64_t exported = 0;
+};
+
+// Queue the export of [from_ms, to_ms] as a streaming response
+MHD_Result serve_history_export(struct MHD_Connection* connection, const HistoryStore& store,
+                                int64_t from_ms, int64_t to_ms, HistoryExportFormat format);
+
+#endif
@@ -0,0 +1,304 @@
+#include "history_store.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// Rollup intervals and how far back each one reaches
+static const struct {
+    const char* suffix;
+    int64_t interval_ms;
+    uint64_t retention;  // intervals kept
+} rollupTiers[ROLLUP_TIERS] = {
+    { ".1s", 1000, 48 * 3600 },           // 2 days
+    { ".1m", 60 * 1000, 90 * 24 * 60 },    // 90 days
+    { ".1h", 3600 * 1000, 5 * 365 * 24 },  // 5 years
+};
+
+// A clock that has run steadily behind the newest record for this long is
+// taken to be right, and the history is re-based onto it
+#define HISTORY_REBASE_MS (60 * 1000)
+
+// Folds records of any resolution, in time order, into step-sized buckets
+class HistoryStore::Bucketer {
+public:
+    Bucketer(int64_t step, std::vector<HistoryPoint>& points)
+        : step(step), out(points) {
+        bucket.count = 0;
+    }
+
+    void add(int64_t timestamp_ms, float mean, float min, float max, uint32_t count) {
+        int64_t start = timestamp_ms - timestamp_ms % step;
+        if (bucket.count > 0 && start != bucket.timestamp_ms) {
+            finish();
+        }
+        if (bucket.count == 0) {
+            bucket.timestamp_ms = start;
+            bucket.min_g = min;
+            bucket.max_g = max;
+            sum = 0;
+        }
+        bucket.min_g = std::min(bucket.min_g, min);
+        bucket.max_g = std::max(bucket.max_g, max);
+        sum += static_cast<double>(mean) * count;
+        bucket.count += count;
+    }
+
+    void finish() {
+        if (bucket.count == 0) return;
+        bucket.mean_g = sum / bucket.count;
+        out.push_back(bucket);
+        bucket.count = 0;
+    }
+
+private:
+    int64_t step;
+    std::vector<HistoryPoint>& out;
+    HistoryPoint bucket;
+    double sum = 0;
+};
+
+HistoryStore::HistoryStore() {
+    for (int i = 0; i < ROLLUP_TIERS; i++) {
+        tiers[i].interval_ms = rollupTiers[i].interval_ms;
+        tiers[i].current.count = 0;
+        tiers[i].sum = 0;
+    }
+}
+
+HistoryStore::~HistoryStore() {
+    close();
+}
+
+bool HistoryStore::open(const std::string& path, size_t size_bytes, unsigned flush_s) {
+    if (!raw.open(path, size_bytes, sizeof(HistoryRecord))) {
+        return false;
+    }
+    uint64_t written = raw.written();
+    lastRawMs = written > 0 ? raw.timestamp_at(written - 1) : INT64_MIN;
+    behindSinceMs = INT64_MIN;
+    for (int i = 0; i < ROLLUP_TIERS; i++) {
+        size_t tierBytes = 4096 + rollupTiers[i].retention * sizeof(RollupRecord);
+        if (!tiers[i].ring.open(path + rollupTiers[i].suffix, tierBytes, sizeof(RollupRecord))) {
+            // Queries fall back to the finer tiers
+            std::cerr << "History rollup " << rollupTiers[i].suffix << " disabled" << std::endl;
+        }
+        tiers[i].current.count = 0;
+    }
+
+    flushSeconds = flush_s > 0 ? flush_s : DEFAULT_HISTORY_FLUSH_S;
+    flushing = true;
+    flushThread = std::thread(&HistoryStore::flusher, this);
+    return true;
+}
+
+void HistoryStore::close() {
+    if (!raw.is_open()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        flushing = false;
+    }
+    flushWake.notify_one();
+    flushThread.join();
+
+    // Keep the partial intervals so a restart leaves no hole in the rollups
+    for (Tier& tier : tiers) {
+        if (tier.ring.is_open() && tier.current.count > 0) {
+            tier.current.mean_g = tier.sum / tier.current.count;
+            tier.ring.append(&tier.current);
+        }
+        tier.current.count = 0;
+        tier.ring.close();
+    }
+    raw.close();
+}
+
+void HistoryStore::append(const HistoryRecord& record) {
+    // A clock stepping backwards (no RTC, before NTP) must not break the
+    // time order the binary search relies on: until it catches up, samples
+    // are stamped with the last timestamp, and the rollups below fold them
+    // into the open interval. One far-future reading would pin that for
+    // good, so a clock that stays behind is believed after a while.
+    if (record.timestamp_ms >= lastRawMs) {
+        behindSinceMs = INT64_MIN;
+    } else if (behindSinceMs == INT64_MIN || record.timestamp_ms < behindSinceMs) {
+        behindSinceMs = record.timestamp_ms;
+    } else if (record.timestamp_ms - behindSinceMs >= HISTORY_REBASE_MS) {
+        rebase(record.timestamp_ms);
+    }
+    HistoryRecord stamped = record;
+    stamped.timestamp_ms = std::max(record.timestamp_ms, lastRawMs);
+    lastRawMs = stamped.timestamp_ms;
+    raw.append(&stamped);
+
+    float value = record.net_g;
+    for (Tier& tier : tiers) {
+        if (!tier.ring.is_open()) continue;
+        RollupRecord& current = tier.current;
+
+        int64_t start = stamped.timestamp_ms - stamped.timestamp_ms % tier.interval_ms;
+        if (current.count > 0 && start > current.timestamp_ms) {
+            current.mean_g = tier.sum / current.count;
+            tier.ring.append(&current);
+            current.count = 0;
+        }
+        if (current.count == 0) {
+            current.timestamp_ms = start;
+            current.min_g = value;
+            current.max_g = value;
+            tier.sum = 0;
+        }
+        current.min_g = std::min(current.min_g, value);
+        current.max_g = std::max(current.max_g, value);
+        tier.sum += value;
+        current.count++;
+    }
+}
+
+// Pull every timestamp later than `now_ms` back to it: the newest raw
+// records, the open rollup intervals and any closed ones ahead of it
+void HistoryStore::rebase(int64_t now_ms) {
+    std::cerr << "History: clock has stayed " << (lastRawMs - now_ms) / 1000
+              << " s behind the newest record, re-basing onto it" << std::endl;
+    raw.clamp_tail(now_ms);
+    lastRawMs = now_ms;
+    behindSinceMs = INT64_MIN;
+    for (Tier& tier : tiers) {
+        if (!tier.ring.is_open()) continue;
+        int64_t start = now_ms - now_ms % tier.interval_ms;
+        tier.ring.clamp_tail(start);
+        if (tier.current.count > 0 && tier.current.timestamp_ms > start) {
+            tier.current.timestamp_ms = start;
+        }
+    }
+}
+
+void HistoryStore::query(int64_t from_ms, int64_t to_ms, int64_t step_ms,
+                         std::vector<HistoryPoint>& out) const {
+    out.clear();
+    if (!raw.is_open() || to_ms < from_ms) {
+        return;
+    }
+    step_ms = std::max<int64_t>(step_ms, 1);
+
+    // Coarsest tier whose intervals tile the steps exactly
+    int level = -1;
+    for (int i = 0; i < ROLLUP_TIERS; i++) {
+        if (step_ms % tiers[i].interval_ms == 0) level = i;
+    }
+
+    Bucketer bucketer(step_ms, out);
+    collect(level, from_ms, to_ms, bucketer);
+    bucketer.finish();
+}
+
+HistoryCursor HistoryStore::raw_cursor(int64_t from_ms, int64_t to_ms) const {
+    HistoryCursor cursor;
+    cursor.to_ms = to_ms;
+    if (!raw.is_open() || to_ms < from_ms) {
+        return cursor;
+    }
+    cursor.end = raw.written();
+    cursor.next = raw.lower_bound(from_ms, raw.first_readable(cursor.end), cursor.end);
+    return cursor;
+}
+
+size_t HistoryStore::read_raw(HistoryCursor& cursor, HistoryRecord* out, size_t max) const {
+    if (!raw.is_open()) {
+        return 0;
+    }
+    cursor.next = std::max(cursor.next, raw.first_readable(raw.written()));
+    size_t count = 0;
+    while (count < max && cursor.next < cursor.end) {
+        const HistoryRecord& r = raw.at<HistoryRecord>(cursor.next);
+        if (r.timestamp_ms > cursor.to_ms) {
+            cursor.next = cursor.end;
+            break;
+        }
+        out[count++] = r;
+        cursor.next++;
+    }
+    return count;
+}
+
+int64_t HistoryStore::rollup_step(int64_t step_ms) {
+    for (int i = ROLLUP_TIERS - 1; i >= 0; i--) {
+        int64_t interval = rollupTiers[i].interval_ms;
+        if (step_ms >= interval) {
+            return (step_ms + interval - 1) / interval * interval;
+        }
+    }
+    return step_ms;
+}
+
+// Feed [from_ms, to_ms] from `level` (-1 = raw samples) into `out` in time
+// order. Intervals the tier only partly covers - at the start of the range,
+// and from its last completed interval to the end - come from the next
+// finer level.
+void HistoryStore::collect(int level, int64_t from_ms, int64_t to_ms, Bucketer& out) const {
+    if (from_ms > to_ms) {
+        return;
+    }
+
+    if (level < 0) {
+        uint64_t end = raw.written();
+        for (uint64_t i = raw.lower_bound(from_ms, raw.first_readable(end), end); i < end; i++) {
+            const HistoryRecord& r = raw.at<HistoryRecord>(i);
+            if (r.timestamp_ms > to_ms) break;
+            out.add(r.timestamp_ms, r.net_g, r.net_g, r.net_g, 1);
+        }
+        return;
+    }
+
+    const Tier& tier = tiers[level];
+    if (!tier.ring.is_open()) {
+        collect(level - 1, from_ms, to_ms, out);
+        return;
+    }
+
+    int64_t interval = tier.interval_ms;
+    int64_t aligned = (from_ms + interval - 1) / interval * interval;
+    collect(level - 1, from_ms, std::min(aligned - 1, to_ms), out);
+
+    // Before the oldest rollup still kept, only the finer levels know
+    uint64_t end = tier.ring.written();
+    uint64_t first = tier.ring.first_readable(end);
+    if (first < end && tier.ring.timestamp_at(first) > aligned) {
+        int64_t oldest = tier.ring.timestamp_at(first);
+        collect(level - 1, aligned, std::min(oldest - 1, to_ms), out);
+        aligned = oldest;
+    }
+    if (aligned > to_ms) {
+        return;
+    }
+
+    // Whole intervals only, i.e. those ending at or before to_ms
+    int64_t lastStart = to_ms + 1 - interval;
+    int64_t covered = aligned;
+    for (uint64_t i = tier.ring.lower_bound(aligned, first, end); i < end; i++) {
+        const RollupRecord& r = tier.ring.at<RollupRecord>(i);
+        if (r.timestamp_ms > lastStart) break;
+        out.add(r.timestamp_ms, r.mean_g, r.min_g, r.max_g, r.count);
+        covered = r.timestamp_ms + interval;
+    }
+
+    collect(level - 1, covered, to_ms, out);
+}
+
+// msync every file's dirty range every flushSeconds, and once more on the
+// way out
+void HistoryStore::flusher() {
+    bool keepGoing = true;
+    while (keepGoing) {
+        {
+            std::unique_lock<std::mutex> lock(flushMutex);
+            flushWake.wait_for(lock, std::chrono::seconds(flushSeconds), [this] { return !flushing; });
+            keepGoing = flushing;
+        }
+        raw.flush();
+        for (Tier& tier : tiers) {
+            if (tier.ring.is_open()) tier.ring.flush();
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mapped_ring.h"
+
+#define DEFAULT_HISTORY_FILE "history.dat"
+#define DEFAULT_HISTORY_SIZE_MB 16
+#define DEFAULT_HISTORY_FLUSH_S 30
+
+// One stored measurement
+struct HistoryRecord {
+    int64_t timestamp_ms;  // wall clock
+    float weight_g;
+    float net_g;
+    int32_t raw;
+    uint32_t flags;        // HISTORY_FLAG_*
+};
+
+#define HISTORY_FLAG_STABLE 1
+
+// Summary of the fluid weight over one rollup interval
+struct RollupRecord {
+    int64_t timestamp_ms;  // start of the interval, aligned to its length
+    float mean_g;
+    float min_g;
+    float max_g;
+    uint32_t count;        // raw samples folded in
+};
+
+// Downsampled bucket returned by queries
+struct HistoryPoint {
+    int64_t timestamp_ms;  // start of the bucket
+    float mean_g;
+    float min_g;
+    float max_g;
+    uint32_t count;
+};
+
+#define ROLLUP_TIERS 3
+
+// Where a chunked read of the raw samples has got to
+struct HistoryCursor {
+    uint64_t next = 0;   // index of the next record to read
+    uint64_t end = 0;    // records written when the read began
+    int64_t to_ms = 0;   // last timestamp wanted
+};
+
+// Measurement history: every raw sample in a circular memory-mapped file,
+// plus 1 s, 1 min and 1 h min/max/mean rollups maintained incrementally
+// in files of their own (`path`.1s, .1m, .1h) that reach much further
+// back. Appends are plain stores into the mappings; a background thread
+// msyncs the dirty ranges every `flush_s` seconds, so the SD card sees
+// batched writes and the sampler never waits on I/O.
+//
+// One writer thread; queries may run concurrently from any thread.
+class HistoryStore {
+public:
+    HistoryStore();
+    ~HistoryStore();
+
+    // Open the raw file at `path` sized to `size_bytes`, and the rollup
+    // files next to it. Existing data is kept if the layout matches.
+    bool open(const std::string& path, size_t size_bytes, unsigned flush_s);
+    void close();
+    bool is_open() const { return raw.is_open(); }
+
+    // Writer only
+    void append(const HistoryRecord& record);
+
+    // Bucket [from_ms, to_ms] into `step_ms` buckets aligned to multiples
+    // of the step, reading the coarsest tier whose interval divides the
+    // step and finer tiers only for the partial intervals at either end.
+    // Work is proportional to the number of points returned, not to the
+    // length of the range. Empty buckets are left out.
+    void query(int64_t from_ms, int64_t to_ms, int64_t step_ms,
+               std::vector<HistoryPoint>& out) const;
+
+    // Read every raw sample in [from_ms, to_ms] in chunks, as far as they
+    // were written when raw_cursor() was called. Each read_raw() copies up
+    // to `max` records into `out` and returns how many, 0 at the end.
+    // Records the writer overwrites between reads are skipped, so a slow
+    // reader loses the oldest samples rather than holding up the writer.
+    HistoryCursor raw_cursor(int64_t from_ms, int64_t to_ms) const;
+    size_t read_raw(HistoryCursor& cursor, HistoryRecord* out, size_t max) const;
+
+    // `step_ms` rounded up to whole intervals of the coarsest tier below it,
+    // for callers free to pick a step that the rollups can answer
+    static int64_t rollup_step(int64_t step_ms);
+
+    uint64_t total_written() const { return raw.written(); }
+    uint64_t capacity() const { return raw.capacity(); }
+
+private:
+    struct Tier {
+        int64_t interval_ms;
+        MappedRing ring;
+        RollupRecord current;  // interval being accumulated, writer only
+        double sum;
+    };
+
+    class Bucketer;
+
+    void collect(int level, int64_t from_ms, int64_t to_ms, Bucketer& out) const;
+    void rebase(int64_t now_ms);
+    void flusher();
+
+    MappedRing raw;
+    int64_t lastRawMs = INT64_MIN;  // newest raw timestamp, writer only
+    int64_t behindSinceMs = INT64_MIN;  // clock reading when it fell behind lastRawMs, writer only
+    Tier tiers[ROLLUP_TIERS];
+
+    unsigned flushSeconds = DEFAULT_HISTORY_FLUSH_S;
+    bool flushing = false;
+    std::mutex flushMutex;
+    std::condition_variable flushWake;
+    std::thread flushThread;
+};
+
+#endif
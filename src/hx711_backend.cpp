@@ -0,0 +1,227 @@
+#include "hx711_backend.h"
+#include <pigpio.h>
+#include <iostream>
+
+// Minimum length of each clock phase; the datasheet asks for 0.2 µs
+#define CLK_PHASE_NS 1000
+
+// Hx711Backend instances alive; pigpio is shut down with the last one
+static int pigpioUsers = 0;
+
+// Busy-wait until `ns` after `since`; far too short to sleep
+static inline void hold_until(uint64_t since, uint64_t ns) {
+    while (monotonic_ns() - since < ns) {
+    }
+}
+
+Hx711Backend* Hx711Backend::open(int clk, const AcquisitionOptions& options, std::string* error) {
+    if (pigpioUsers == 0 && gpioInitialise() < 0) {
+        *error = "failed to initialise pigpio";
+        return nullptr;
+    }
+    pigpioUsers++;
+    return new Hx711Backend(clk, options);
+}
+
+Hx711Backend::Hx711Backend(int clk, const AcquisitionOptions& acquisition) : CLK(clk), options(acquisition) {
+    gpioSetMode(CLK, PI_OUTPUT);
+    gpioWrite(CLK, 0);
+    if (!registers.open()) {
+        std::cerr << "No /dev/gpiomem; clocking HX711s through pigpio calls" << std::endl;
+    }
+}
+
+Hx711Backend::~Hx711Backend() {
+    stop_acquisition();
+    if (--pigpioUsers == 0) {
+        gpioTerminate();
+    }
+}
+
+void Hx711Backend::add_channel(int dout, unsigned scale) {
+    gpioSetMode(dout, PI_INPUT);
+    channels.push_back(Channel{dout, scale});
+    doutMask |= 1u << dout;
+}
+
+bool Hx711Backend::has_dout(int dout) const {
+    return (doutMask & (1u << dout)) != 0;
+}
+
+uint32_t Hx711Backend::levels() {
+    return registers.is_open() ? registers.levels() : gpioRead_Bits_0_31();
+}
+
+// Clock one frame out of every chip. All DOUT pins must already be low.
+// Returns false, leaving `values` alone, if a pulse stayed high long
+// enough for the chips to power down mid-frame.
+bool Hx711Backend::read_frame(long* values) {
+    uint32_t clkMask = 1u << CLK;
+    uint32_t bits[24];
+    bool intact = true;
+    uint64_t frameStart = monotonic_ns();
+
+    // 24 data bits, then 1-3 more pulses to select the next gain. All
+    // data pins are sampled after each falling edge.
+    for (int i = 0; i < 24 + GAIN; i++) {
+        uint64_t rise = monotonic_ns();
+        if (registers.is_open()) {
+            registers.set(clkMask);
+            hold_until(rise, CLK_PHASE_NS);
+            registers.clear(clkMask);
+        } else {
+            gpioWrite(CLK, 1);
+            gpioDelay(1);
+            gpioWrite(CLK, 0);
+        }
+        uint64_t fall = monotonic_ns();
+        if (fall - rise > HX711_CLK_HIGH_MAX_NS) {
+            intact = false;
+        }
+        hold_until(fall, CLK_PHASE_NS);
+        if (i < 24) {
+            bits[i] = levels();
+        }
+    }
+    lastFrameEndTick = gpioTick();
+
+    uint32_t duration = static_cast<uint32_t>(monotonic_ns() - frameStart);
+    lastFrameNs.store(duration, std::memory_order_relaxed);
+    if (duration > maxFrameNs.load(std::memory_order_relaxed)) {
+        maxFrameNs.store(duration, std::memory_order_relaxed);
+    }
+    totalFrameNs.fetch_add(duration, std::memory_order_relaxed);
+    readTime.observe(duration);
+    if (!intact) {
+        discarded.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    frames.fetch_add(1, std::memory_order_relaxed);
+
+    for (size_t c = 0; c < channels.size(); c++) {
+        unsigned long value = 0;
+        for (int i = 0; i < 24; i++) {
+            value = (value << 1) | ((bits[i] >> channels[c].dout) & 1);
+        }
+
+        // Convert 24-bit two's complement to signed 32-bit
+        if (value & 0x800000) {
+            value |= 0xFF000000;
+        }
+        values[c] = static_cast<long>(static_cast<int32_t>(value));
+    }
+    return true;
+}
+
+// pigpio alert callback: DOUT falls when a conversion is ready. The
+// watchdog timeout (level PI_TIMEOUT) catches an edge that was missed
+// while we were not listening, since DOUT then stays low indefinitely.
+// Clocking is left to the acquisition thread.
+void Hx711Backend::on_dout_edge(int gpio, int level, uint32_t tick, void* userdata) {
+    Hx711Backend* self = static_cast<Hx711Backend*>(userdata);
+    if (level == 1) return;
+
+    {
+        std::lock_guard<std::mutex> lock(self->frameMutex);
+        if (!self->acquiring) return;
+        // Edges produced while we were clocking are delivered late; ignore them
+        if (level == 0 && static_cast<int32_t>(tick - self->lastFrameEndTick) < 0) return;
+        if (!self->edgePending) self->edgeTick = tick;
+        self->edgePending = true;
+    }
+    self->edge.notify_one();
+}
+
+// Clock out a frame whenever an edge says one may be ready. With several
+// chips the burst waits for the last one to become ready.
+void Hx711Backend::acquisition_thread() {
+    apply_acquisition_options(options);
+    long values[32];
+
+    std::unique_lock<std::mutex> lock(frameMutex);
+    while (acquiring) {
+        edge.wait(lock, [this] { return edgePending || !acquiring; });
+        edgePending = false;
+        if (!acquiring || !is_ready()) continue;
+        readyWait.observe(static_cast<uint64_t>(gpioTick() - edgeTick) * 1000);
+
+        RawSample sample;
+        sample.timestamp_us = monotonic_us();
+        if (!read_frame(values)) continue;
+        for (size_t c = 0; c < channels.size(); c++) {
+            sample.value = values[c];
+            sample.scale = channels[c].scale;
+            queue->push(sample);
+        }
+    }
+}
+
+bool Hx711Backend::is_ready() {
+    return (levels() & doutMask) == 0;
+}
+
+// The pulses after the data bits pick the gain of the conversion after
+// the one being read
+bool Hx711Backend::set_gain(int gain) {
+    std::lock_guard<std::mutex> lock(frameMutex);
+    switch (gain) {
+    case 128:
+        GAIN = 1; break;
+    case 64:
+        GAIN = 3; break;
+    case 32:
+        GAIN = 2; break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+// Start pushing every conversion into the queue as the chips produce them
+bool Hx711Backend::start_acquisition(SampleQueue* q) {
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        queue = q;
+        acquiring = true;
+        edgePending = true;  // a conversion may be waiting already
+        edgeTick = gpioTick();
+    }
+    thread = std::thread(&Hx711Backend::acquisition_thread, this);
+
+    for (const Channel& channel : channels) {
+        if (gpioSetAlertFuncEx(channel.dout, on_dout_edge, this) != 0) {
+            stop_acquisition();
+            return false;
+        }
+        // At 10 SPS a conversion is due every 100 ms; anything longer means
+        // we missed the falling edge
+        gpioSetWatchdog(channel.dout, 250);
+    }
+    return true;
+}
+
+void Hx711Backend::stop_acquisition() {
+    for (const Channel& channel : channels) {
+        gpioSetWatchdog(channel.dout, 0);
+        gpioSetAlertFuncEx(channel.dout, nullptr, nullptr);
+    }
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        acquiring = false;
+        queue = nullptr;
+    }
+    edge.notify_one();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+AcquisitionStats Hx711Backend::stats() const {
+    AcquisitionStats stats;
+    stats.frames = frames.load(std::memory_order_relaxed);
+    stats.discarded = discarded.load(std::memory_order_relaxed);
+    stats.last_frame_ns = lastFrameNs.load(std::memory_order_relaxed);
+    stats.max_frame_ns = maxFrameNs.load(std::memory_order_relaxed);
+    stats.total_frame_ns = totalFrameNs.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,88 @@
+#ifndef HX711_BACKEND_H
+#define HX711_BACKEND_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "sensor_backend.h"
+#include "gpio_registers.h"
+
+// The chip powers down if CLK stays high for 60 µs; frames with a pulse
+// this long are discarded
+#define HX711_CLK_HIGH_MAX_NS 50000
+
+// HX711s sharing one clock line. Every clock pulse samples all their DOUT
+// pins with a single register read, so one 25-27 pulse burst reads every
+// chip at once.
+//
+// DOUT falling edges raise a pigpio alert, which only wakes the backend's
+// own acquisition thread; that thread clocks the frame out once all chips
+// have a conversion ready. It can run at SCHED_FIFO priority pinned to a
+// CPU, and drives the pins through /dev/gpiomem when that is available
+// (pigpio calls otherwise). Each pulse's high phase is timed, and a frame
+// where the thread was preempted long enough to power the chip down is
+// dropped rather than delivered corrupted.
+class Hx711Backend : public SensorBackend {
+public:
+    // Initialises pigpio (once for all backends); nullptr with `error` set
+    // if that fails
+    static Hx711Backend* open(int clk, const AcquisitionOptions& options, std::string* error);
+    ~Hx711Backend();
+
+    // Add a chip before acquisition starts; its samples are tagged `scale`
+    void add_channel(int dout, unsigned scale);
+    bool has_dout(int dout) const;
+
+    bool start_acquisition(SampleQueue* queue) override;
+    void stop_acquisition() override;
+
+    AcquisitionStats stats() const override;
+
+    // Every chip has a conversion ready
+    bool is_ready();
+
+    bool set_gain(int gain) override;
+    uint32_t gpio_pins() const override { return doutMask | (1u << CLK); }
+
+private:
+    struct Channel {
+        int dout;
+        unsigned scale;
+    };
+
+    Hx711Backend(int clk, const AcquisitionOptions& options);
+
+    uint32_t levels();
+    bool read_frame(long* values);
+    void acquisition_thread();
+    static void on_dout_edge(int gpio, int level, uint32_t tick, void* userdata);
+
+    int CLK;
+    int GAIN = 1;  // extra clock pulses after the 24 data bits: 1 = channel A, gain 128
+    std::vector<Channel> channels;
+    uint32_t doutMask = 0;
+    GpioRegisters registers;
+    AcquisitionOptions options;
+
+    // Interrupt-driven acquisition state
+    SampleQueue* queue = nullptr;
+    std::mutex frameMutex;          // serialises clocking between callers
+    std::condition_variable edge;
+    bool edgePending = false;
+    bool acquiring = false;
+    std::thread thread;
+    uint32_t lastFrameEndTick = 0;  // edges before this tick came from our own clocking
+    uint32_t edgeTick = 0;          // of the edge that set edgePending
+
+    // Instrumentation, written by whoever clocks under frameMutex
+    std::atomic<unsigned long> frames{0};
+    std::atomic<unsigned long> discarded{0};
+    std::atomic<uint32_t> lastFrameNs{0};
+    std::atomic<uint32_t> maxFrameNs{0};
+    std::atomic<uint64_t> totalFrameNs{0};
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include "mapped_ring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+
+#define RING_MAGIC "FSHIST1"
+#define RING_VERSION 1
+#define RING_HEADER_BYTES 4096  // one page ahead of the records
+
+// Records this close behind the writer may be overwritten mid-read
+#define RING_GUARD_RECORDS 256
+
+struct MappedRing::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    uint64_t written;  // records ever appended; next goes to written % capacity
+};
+
+MappedRing::~MappedRing() {
+    close();
+}
+
+bool MappedRing::open(const std::string& path, size_t size_bytes, uint32_t record_size) {
+    long page = sysconf(_SC_PAGESIZE);
+    size_t size = std::max<size_t>(size_bytes / page * page, RING_HEADER_BYTES + 4 * page);
+    uint64_t capacity = (size - RING_HEADER_BYTES) / record_size;
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Cannot open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != size) {
+        // Reserve the blocks up front so appends never hit a full card
+        int rc = ftruncate(fd, size) == 0 ? posix_fallocate(fd, 0, size) : errno;
+        if (rc != 0 && rc != EOPNOTSUPP) {
+            std::cerr << "Cannot size " << path << ": " << strerror(rc) << std::endl;
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+    }
+
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        std::cerr << "Cannot map " << path << ": " << strerror(errno) << std::endl;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    mappedBytes = size;
+    header = static_cast<Header*>(map);
+    records = static_cast<char*>(map) + RING_HEADER_BYTES;
+    recordSize = record_size;
+    slots = capacity;
+
+    if (memcmp(header->magic, RING_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != RING_VERSION ||
+        header->record_size != record_size ||
+        header->capacity != capacity) {
+        // New file, or one laid out differently: start over
+        memset(header, 0, RING_HEADER_BYTES);
+        memcpy(header->magic, RING_MAGIC, sizeof(header->magic));
+        header->version = RING_VERSION;
+        header->record_size = record_size;
+        header->capacity = capacity;
+        header->written = 0;
+        msync(header, RING_HEADER_BYTES, MS_SYNC);
+    }
+    flushedUpTo = header->written;
+    return true;
+}
+
+void MappedRing::close() {
+    if (header == nullptr) {
+        return;
+    }
+    flush();
+    munmap(header, mappedBytes);
+    ::close(fd);
+    header = nullptr;
+    records = nullptr;
+    fd = -1;
+}
+
+void MappedRing::append(const void* record) {
+    uint64_t index = header->written;  // only this thread changes it
+    memcpy(records + (index % slots) * recordSize, record, recordSize);
+    __atomic_store_n(&header->written, index + 1, __ATOMIC_RELEASE);
+}
+
+void MappedRing::clamp_tail(int64_t ms) {
+    uint64_t end = header->written;
+    uint64_t oldest = end > slots ? end - slots : 0;
+    uint64_t first = end;
+    while (first > oldest && timestamp_at(first - 1) > ms) {
+        first--;
+    }
+    // Oldest first, so a concurrent binary search always sees them in order
+    for (uint64_t i = first; i < end; i++) {
+        __atomic_store_n(reinterpret_cast<int64_t*>(records + (i % slots) * recordSize), ms, __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t MappedRing::written() const {
+    return header != nullptr ? __atomic_load_n(&header->written, __ATOMIC_ACQUIRE) : 0;
+}
+
+uint64_t MappedRing::first_readable(uint64_t written) const {
+    uint64_t keep = slots > RING_GUARD_RECORDS ? slots - RING_GUARD_RECORDS : 1;
+    return written > keep ? written - keep : 0;
+}
+
+uint64_t MappedRing::lower_bound(int64_t ms, uint64_t first, uint64_t end) const {
+    while (first < end) {
+        uint64_t middle = first + (end - first) / 2;
+        if (timestamp_at(middle) < ms) {
+            first = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return first;
+}
+
+// Write back what was appended since the last call, one msync per
+// contiguous range
+void MappedRing::flush() {
+    uint64_t end = written();
+    if (end == flushedUpTo) {
+        return;
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    char* base = reinterpret_cast<char*>(header);  // msync wants page-aligned addresses
+    uint64_t pending = std::min<uint64_t>(end - flushedUpTo, slots);
+    uint64_t first = (end - pending) % slots;
+    uint64_t last = first + pending;  // may run past the end of the ring
+    uint64_t ranges[2][2] = { { first, std::min(last, slots) }, { 0, last > slots ? last - slots : 0 } };
+    for (auto& range : ranges) {
+        if (range[1] <= range[0]) continue;
+        size_t startByte = (RING_HEADER_BYTES + range[0] * recordSize) / page * page;
+        size_t endByte = RING_HEADER_BYTES + range[1] * recordSize;
+        msync(base + startByte, endByte - startByte, MS_SYNC);
+    }
+    msync(header, RING_HEADER_BYTES, MS_SYNC);
+    flushedUpTo = end;
+}
@@ -0,0 +1,65 @@
+#ifndef MAPPED_RING_H
+#define MAPPED_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// Fixed-size circular file of fixed-size records, accessed through mmap.
+// Every record type stored here must start with an int64_t timestamp in
+// milliseconds, appended in non-decreasing order, so ranges can be found
+// by binary search. The file is sized (and its blocks allocated) when it
+// is opened and never grows.
+//
+// One writer thread appends; any thread may read. flush() is meant for a
+// single background thread and msyncs only what changed since last time.
+class MappedRing {
+public:
+    ~MappedRing();
+
+    // Map `path`, creating or resizing it to `size_bytes`. Existing records
+    // are kept if the file was laid out for the same record size and capacity.
+    bool open(const std::string& path, size_t size_bytes, uint32_t record_size);
+    void close();
+    bool is_open() const { return header != nullptr; }
+
+    // Writer only
+    void append(const void* record);
+    // Lower the timestamps of the newest records that are later than `ms`
+    // to `ms`, so appends from a clock re-based backwards keep the order
+    void clamp_tail(int64_t ms);
+
+    // Records ever appended; index i lives at i % capacity()
+    uint64_t written() const;
+    uint64_t capacity() const { return slots; }
+
+    // Oldest index that is safe to read while the writer keeps going
+    uint64_t first_readable(uint64_t written) const;
+
+    // First index in [first, end) with timestamp >= ms
+    uint64_t lower_bound(int64_t ms, uint64_t first, uint64_t end) const;
+
+    template <typename T>
+    const T& at(uint64_t index) const {
+        return *reinterpret_cast<const T*>(records + (index % slots) * recordSize);
+    }
+
+    int64_t timestamp_at(uint64_t index) const {
+        return at<int64_t>(index);
+    }
+
+    void flush();
+
+private:
+    struct Header;
+
+    int fd = -1;
+    size_t mappedBytes = 0;
+    Header* header = nullptr;
+    char* records = nullptr;
+    uint32_t recordSize = 0;
+    uint64_t slots = 0;
+    uint64_t flushedUpTo = 0;  // flush() only
+};
+
+#endif
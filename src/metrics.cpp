@@ -0,0 +1,66 @@
+#include "metrics.h"
+#include <stdio.h>
+
+// Upper bounds in ns; the last bucket is +Inf
+static const uint64_t bucketBoundsNs[LATENCY_BUCKETS] = {
+    1000, 2500, 5000,
+    10000, 25000, 50000,
+    100000, 250000, 500000,
+    1000000, 2500000, 5000000,
+    10000000, 25000000, 50000000,
+    100000000, 250000000, 500000000,
+    1000000000
+};
+
+void LatencyHistogram::observe(uint64_t ns) {
+    unsigned bucket = 0;
+    while (bucket < LATENCY_BUCKETS && ns > bucketBoundsNs[bucket]) {
+        bucket++;
+    }
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    sumNs.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::render(std::string& out, const char* name, const char* labels) const {
+    const char* comma = labels[0] != '\0' ? "," : "";
+    char line[256];
+    uint64_t cumulative = 0;
+    for (unsigned i = 0; i <= LATENCY_BUCKETS; i++) {
+        cumulative += counts[i].load(std::memory_order_relaxed);
+        int n;
+        if (i < LATENCY_BUCKETS) {
+            n = snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, comma,
+                         bucketBoundsNs[i] / 1e9, static_cast<unsigned long long>(cumulative));
+        } else {
+            n = snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, comma,
+                         static_cast<unsigned long long>(cumulative));
+        }
+        out.append(line, n);
+    }
+    const char* open = labels[0] != '\0' ? "{" : "";
+    const char* close = labels[0] != '\0' ? "}" : "";
+    int n = snprintf(line, sizeof(line), "%s_sum%s%s%s %.9g\n%s_count%s%s%s %llu\n",
+                     name, open, labels, close, sumNs.load(std::memory_order_relaxed) / 1e9,
+                     name, open, labels, close, static_cast<unsigned long long>(cumulative));
+    out.append(line, n);
+}
+
+void append_metric_header(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void append_metric(std::string& out, const char* name, const char* labels, double value) {
+    char line[256];
+    int n = labels[0] != '\0'
+        ? snprintf(line, sizeof(line), "%s{%s} %.15g\n", name, labels, value)
+        : snprintf(line, sizeof(line), "%s %.15g\n", name, value);
+    out.append(line, n);
+}
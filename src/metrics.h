@@ -0,0 +1,35 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// Latency buckets: 1 µs to 1 s in 1-2.5-5 steps, plus +Inf
+#define LATENCY_BUCKETS 19
+
+// Prometheus histogram of durations. observe() is two relaxed atomic adds
+// and no lock, so it can sit on the sampling and request paths; each
+// histogram has its own cache lines so threads recording into different
+// ones do not contend. A scrape may see the sum and the buckets from
+// slightly different moments, which Prometheus tolerates.
+class alignas(64) LatencyHistogram {
+public:
+    void observe(uint64_t ns);
+
+    // Append the _bucket, _sum and _count series of `name` (in seconds).
+    // `labels` is empty or `key="value",...` without braces.
+    void render(std::string& out, const char* name, const char* labels) const;
+
+private:
+    std::atomic<uint64_t> counts[LATENCY_BUCKETS + 1] = {};  // per bucket, not cumulative
+    std::atomic<uint64_t> sumNs{0};
+};
+
+// # HELP and # TYPE lines introducing a metric family
+void append_metric_header(std::string& out, const char* name, const char* type, const char* help);
+
+// One `name{labels} value` line
+void append_metric(std::string& out, const char* name, const char* labels, double value);
+
+#endif
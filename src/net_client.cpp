@@ -0,0 +1,217 @@
+#include "net_client.h"
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+bool split_host_port(const std::string& text, unsigned fallback, std::string& host, unsigned& port) {
+    size_t colon = text.rfind(':');
+    size_t bracket = text.rfind(']');
+    port = fallback;
+    host = text;
+    if (colon != std::string::npos && (bracket == std::string::npos || colon > bracket)) {
+        const char* digits = text.c_str() + colon + 1;
+        char* end = nullptr;
+        unsigned long parsed = strtoul(digits, &end, 10);
+        if (*digits < '0' || *digits > '9' || *end != '\0' || parsed == 0 || parsed > 65535) return false;
+        port = parsed;
+        host = text.substr(0, colon);
+    }
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+    return !host.empty() && port != 0;
+}
+
+// What the lookup thread and the object asking share; whichever lets go
+// last closes the eventfd
+struct HostLookup::Shared {
+    std::mutex mutex;
+    int doneFd = -1;
+    bool finished = false;
+    int rc = 0;
+    ResolvedAddress address;
+
+    ~Shared() {
+        if (doneFd >= 0) close(doneFd);
+    }
+};
+
+bool HostLookup::start(const std::string& host, unsigned port, std::string* error) {
+    cancel();
+    std::shared_ptr<Shared> lookup = std::make_shared<Shared>();
+    lookup->doneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (lookup->doneFd < 0) {
+        *error = std::string("eventfd: ") + strerror(errno);
+        return false;
+    }
+    try {
+        std::thread([lookup, host, port]() {
+            addrinfo hints = {};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* found = nullptr;
+            int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found);
+            {
+                std::lock_guard<std::mutex> lock(lookup->mutex);
+                lookup->finished = true;
+                lookup->rc = rc;
+                if (rc == 0) {
+                    lookup->address.family = found->ai_family;
+                    memcpy(&lookup->address.address, found->ai_addr, found->ai_addrlen);
+                    lookup->address.length = found->ai_addrlen;
+                }
+            }
+            if (found != nullptr) freeaddrinfo(found);
+            uint64_t one = 1;
+            if (write(lookup->doneFd, &one, sizeof(one)) < 0) {
+                // cannot fail on an eventfd this fresh
+            }
+        }).detach();
+    } catch (const std::system_error& e) {
+        *error = std::string("resolver thread: ") + e.what();
+        return false;
+    }
+    shared = lookup;
+    return true;
+}
+
+void HostLookup::cancel() {
+    shared.reset();
+}
+
+int HostLookup::fd() const {
+    return shared != nullptr ? shared->doneFd : -1;
+}
+
+bool HostLookup::result(ResolvedAddress& out, std::string* error) {
+    if (shared == nullptr) {
+        *error = "no lookup";
+        return false;
+    }
+    std::shared_ptr<Shared> lookup = shared;
+    std::lock_guard<std::mutex> lock(lookup->mutex);
+    if (!lookup->finished) {
+        *error = "still resolving";
+        return false;
+    }
+    shared.reset();
+    if (lookup->rc != 0) {
+        *error = gai_strerror(lookup->rc);
+        return false;
+    }
+    out = lookup->address;
+    return true;
+}
+
+int ReconnectingClient::fd() const {
+    return state == RESOLVING ? lookup.fd() : sock;
+}
+
+short ReconnectingClient::events() const {
+    switch (state) {
+    case IDLE: return 0;
+    case RESOLVING: return POLLIN;
+    case CONNECTING: return POLLOUT;
+    case OPEN: return session_events();
+    }
+    return 0;
+}
+
+int64_t ReconnectingClient::deadline_ms() const {
+    switch (state) {
+    case IDLE: return nextAttemptMs;
+    case RESOLVING:
+    case CONNECTING: return stateSinceMs + connectTimeoutMs;
+    case OPEN: return session_deadline_ms();
+    }
+    return -1;
+}
+
+void ReconnectingClient::service(short revents, int64_t now_ms) {
+    switch (state) {
+    case IDLE:
+        if (now_ms >= nextAttemptMs) begin_lookup(now_ms);
+        break;
+    case RESOLVING:
+        if (revents & POLLIN) {
+            begin_connect(now_ms);
+        } else if (now_ms >= stateSinceMs + connectTimeoutMs) {
+            fail(now_ms, "name lookup timed out");
+        }
+        break;
+    case CONNECTING:
+        if (revents & (POLLOUT | POLLERR | POLLHUP)) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0) {
+                fail(now_ms, strerror(error));
+                return;
+            }
+            state = OPEN;
+            stateSinceMs = now_ms;
+            opened(now_ms);
+        } else if (now_ms >= stateSinceMs + connectTimeoutMs) {
+            fail(now_ms, "connect timed out");
+        }
+        break;
+    case OPEN:
+        session_service(revents, now_ms);
+        break;
+    }
+}
+
+void ReconnectingClient::disconnect() {
+    lookup.cancel();
+    if (sock >= 0) close(sock);
+    sock = -1;
+}
+
+void ReconnectingClient::begin_lookup(int64_t now_ms) {
+    std::string error;
+    if (!lookup.start(host, port, &error)) {
+        fail(now_ms, error.c_str());
+        return;
+    }
+    state = RESOLVING;
+    stateSinceMs = now_ms;
+}
+
+void ReconnectingClient::begin_connect(int64_t now_ms) {
+    ResolvedAddress address;
+    std::string error;
+    if (!lookup.result(address, &error)) {
+        fail(now_ms, error.c_str());
+        return;
+    }
+    sock = socket(address.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0 || (connect(sock, reinterpret_cast<sockaddr*>(&address.address), address.length) < 0 &&
+                     errno != EINPROGRESS)) {
+        fail(now_ms, strerror(errno));
+        return;
+    }
+    state = CONNECTING;
+    stateSinceMs = now_ms;
+}
+
+bool ReconnectingClient::fail(int64_t now_ms, const char* reason) {
+    if (state != IDLE || lastError != reason) {
+        std::cerr << label << ": " << reason << ", retrying in " << backoffMs / 1000 << " s" << std::endl;
+    }
+    bool newError = lastError != reason;
+    lastError = reason;
+    disconnect();
+    state = IDLE;
+    stateSinceMs = now_ms;
+    nextAttemptMs = now_ms + backoffMs;
+    backoffMs = std::min(backoffMs * 2, maxBackoffMs);
+    closed(now_ms, newError);
+    return false;
+}
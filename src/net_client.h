@@ -0,0 +1,114 @@
+#ifndef NET_CLIENT_H
+#define NET_CLIENT_H
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+
+// An address to connect() to
+struct ResolvedAddress {
+    int family = 0;
+    sockaddr_storage address;
+    socklen_t length = 0;
+};
+
+// HOST[:PORT], with IPv6 literals in brackets. The port is `fallback`
+// when none is given; false if it is malformed or the host is empty.
+bool split_host_port(const std::string& text, unsigned fallback, std::string& host, unsigned& port);
+
+// Resolves a host name for a TCP connection on a thread of its own, so
+// the event loop asking never waits on DNS. fd() becomes readable when
+// the lookup is over. A lookup still running when it is cancelled or the
+// object goes away is abandoned and its thread finishes on its own.
+class HostLookup {
+public:
+    ~HostLookup() { cancel(); }
+
+    // Start resolving host:port, abandoning any lookup in progress. False
+    // with *error set if the thread cannot be started.
+    bool start(const std::string& host, unsigned port, std::string* error);
+    void cancel();
+
+    // Readable once the lookup is over; -1 when there is none
+    int fd() const;
+
+    // Once fd() is readable: true with the first address found, or false
+    // with *error set. Either way the lookup is done with then.
+    bool result(ResolvedAddress& out, std::string* error);
+
+private:
+    struct Shared;
+    std::shared_ptr<Shared> shared;
+};
+
+// A TCP connection that keeps itself up: look the host up with a
+// HostLookup, connect without blocking, then hand the socket to the
+// subclass's session. Any failure closes it and retries after a backoff
+// doubling from 1 s to max_backoff_s. Driven from an event loop through
+// fd(), events(), deadline_ms() and service(), like the telemetry
+// transports and fleet devices built on it.
+class ReconnectingClient {
+public:
+    ReconnectingClient(const std::string& host, unsigned port, int64_t connect_timeout_ms, unsigned max_backoff_s)
+        : host(host), port(port), connectTimeoutMs(connect_timeout_ms), maxBackoffMs(max_backoff_s * 1000) {}
+    virtual ~ReconnectingClient() { disconnect(); }
+
+    // Socket or lookup to poll and the events wanted, -1 and 0 for none
+    int fd() const;
+    short events() const;
+
+    // When service() next needs calling without any event, -1 for never
+    int64_t deadline_ms() const;
+
+    // Handle poll results and timers
+    void service(short revents, int64_t now_ms);
+
+    // Close the socket and abandon any lookup, when shutting down
+    void disconnect();
+
+protected:
+    // The socket has just connected; start the session on it
+    virtual void opened(int64_t now_ms) = 0;
+
+    // Once connected: what to poll for, when session_service() needs
+    // calling regardless, and handling either
+    virtual short session_events() const = 0;
+    virtual int64_t session_deadline_ms() const = 0;
+    virtual void session_service(short revents, int64_t now_ms) = 0;
+
+    // The connection failed and has been closed; drop whatever the
+    // session kept. `new_error` if the reason differs from the last one.
+    virtual void closed(int64_t now_ms, bool new_error) {}
+
+    // Close the connection and retry after the backoff, logging the reason
+    // under `label`. Returns false, so callers can `return fail(...)`.
+    bool fail(int64_t now_ms, const char* reason);
+
+    // The session worked: the next failure retries after 1 s again
+    void reset_backoff() { backoffMs = 1000; }
+
+    const std::string& last_error() const { return lastError; }
+
+    const std::string host;
+    const unsigned port;
+    std::string label;  // how log lines name the connection
+    int sock = -1;      // connected socket while the session runs
+
+private:
+    enum State { IDLE, RESOLVING, CONNECTING, OPEN };
+
+    void begin_lookup(int64_t now_ms);
+    void begin_connect(int64_t now_ms);
+
+    const int64_t connectTimeoutMs;
+    const int64_t maxBackoffMs;
+    HostLookup lookup;
+    State state = IDLE;
+    int64_t stateSinceMs = 0;
+    int64_t nextAttemptMs = 0;
+    int64_t backoffMs = 1000;
+    std::string lastError = "not connected yet";
+};
+
+#endif
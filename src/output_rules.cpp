@@ -0,0 +1,236 @@
+#include "output_rules.h"
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+#include "sample_queue.h"
+#include "spec_parse.h"
+
+const char* output_condition_name(OutputCondition condition) {
+    switch (condition) {
+    case OUTPUT_ABOVE: return "above";
+    case OUTPUT_BELOW: return "below";
+    case OUTPUT_TARGET: return "target";
+    }
+    return "unknown";
+}
+
+bool OutputBank::open(const std::string& driver, std::string* error) {
+    if (driver == "sim") {
+        return true;
+    }
+    if (driver != "gpio" && driver != "auto") {
+        *error = "unknown output driver '" + driver + "' (auto, gpio, sim)";
+        return false;
+    }
+    if (!registers.open() && driver == "gpio") {
+        *error = "cannot map /dev/gpiomem for the output pins";
+        return false;
+    }
+    return true;
+}
+
+void OutputBank::reserve(uint32_t pins) {
+    std::lock_guard<std::mutex> lock(pinMutex);
+    reserved |= pins;
+}
+
+bool OutputBank::assign(unsigned scale, uint32_t pins, std::string* error) {
+    std::lock_guard<std::mutex> lock(pinMutex);
+    if (requested.size() <= scale) {
+        requested.resize(scale + 1, 0);
+        active.resize(scale + 1, 0);
+    }
+    uint32_t others = 0;
+    for (size_t i = 0; i < requested.size(); i++) {
+        if (i != scale) others |= requested[i] | active[i];
+    }
+    for (unsigned gpio = 0; gpio <= OUTPUT_GPIO_MAX; gpio++) {
+        uint32_t mask = 1u << gpio;
+        if (!(pins & mask)) continue;
+        if (reserved & mask) {
+            *error = "GPIO " + std::to_string(gpio) + " is a sensor pin";
+            return false;
+        }
+        if (others & mask) {
+            *error = "GPIO " + std::to_string(gpio) + " is driven by another scale's output rules";
+            return false;
+        }
+    }
+    requested[scale] = pins;
+    return true;
+}
+
+void OutputBank::claimed(unsigned scale, uint32_t pins) {
+    std::lock_guard<std::mutex> lock(pinMutex);
+    if (active.size() <= scale) {
+        requested.resize(scale + 1, 0);
+        active.resize(scale + 1, 0);
+    }
+    active[scale] = pins;
+}
+
+void OutputBank::claim(unsigned gpio, bool high) {
+    write(gpio, high);
+    if (registers.is_open()) {
+        registers.set_output(gpio);
+    }
+}
+
+void OutputBank::write(unsigned gpio, bool high) {
+    uint32_t mask = 1u << gpio;
+    if (registers.is_open()) {
+        if (high) registers.set(mask);
+        else registers.clear(mask);
+    }
+    if (high) written.fetch_or(mask, std::memory_order_relaxed);
+    else written.fetch_and(~mask, std::memory_order_relaxed);
+}
+
+void OutputBank::record(const OutputTrigger& trigger) {
+    latencyTime.observe(trigger.latency_ns);
+    std::lock_guard<std::mutex> lock(logMutex);
+    log[logged % OUTPUT_LOG_SIZE] = trigger;
+    logged++;
+}
+
+size_t OutputBank::triggers(OutputTrigger* out, size_t max) const {
+    std::lock_guard<std::mutex> lock(logMutex);
+    size_t count = std::min<uint64_t>(std::min<uint64_t>(logged, OUTPUT_LOG_SIZE), max);
+    for (size_t i = 0; i < count; i++) {
+        out[i] = log[(logged - count + i) % OUTPUT_LOG_SIZE];
+    }
+    return count;
+}
+
+uint64_t OutputBank::trigger_count() const {
+    std::lock_guard<std::mutex> lock(logMutex);
+    return logged;
+}
+
+uint32_t OutputRuleSet::pins() const {
+    uint32_t mask = 0;
+    for (const Rule& rule : rules) {
+        mask |= 1u << rule.gpio;
+    }
+    return mask;
+}
+
+void OutputRuleSet::claim(OutputBank& bank) {
+    for (Rule& rule : rules) {
+        bank.claim(rule.gpio, rule.activeLow);
+    }
+}
+
+void OutputRuleSet::release(OutputBank& bank) {
+    for (Rule& rule : rules) {
+        if (rule.fired) drive(rule, false, bank);
+    }
+}
+
+void OutputRuleSet::drive(Rule& rule, bool active, OutputBank& bank) {
+    bank.write(rule.gpio, active != rule.activeLow);
+    rule.fired = active;
+}
+
+void OutputRuleSet::evaluate(const Sample& sample, const FlowEstimator& flow, unsigned scale, OutputBank& bank) {
+    for (size_t i = 0; i < rules.size(); i++) {
+        Rule& rule = rules[i];
+        fixed_t threshold = rule.condition == OUTPUT_TARGET ? sample.target_g : rule.grams;
+        if (rule.condition == OUTPUT_TARGET && threshold <= 0) {
+            if (rule.fired) drive(rule, false, bank);  // target cleared
+            continue;
+        }
+
+        // How far the weight is past the threshold, in the rule's direction
+        int direction = rule.condition == OUTPUT_BELOW ? -1 : 1;
+        fixed_t past = direction * (sample.net_g - threshold);
+        if (rule.fired) {
+            // Measured from where a predicted crossing fired, so a long lead
+            // does not re-arm the rule straight away
+            fixed_t rearm = std::max<fixed_t>(std::abs(threshold) / OUTPUT_REARM_DIVISOR, OUTPUT_REARM_MIN_G * FIXED_ONE);
+            if (past < std::min<fixed_t>(rule.firedPast, 0) - rearm) drive(rule, false, bank);
+            continue;
+        }
+
+        // Predictions only hold while the flow is steady: a container set
+        // down or knocked gives a steep slope the weights do not follow
+        bool steady = flow.residual() <= OUTPUT_PREDICT_MAX_RESIDUAL_G;
+        bool predicted = false;
+        if (past < 0 && !steady) {
+            predicted = false;
+        } else if (past < 0 && rule.condition == OUTPUT_TARGET) {
+            // The sample's prediction already allows for the fluid in flight
+            predicted = sample.time_to_cutoff_s >= 0 && sample.time_to_cutoff_s <= rule.lead_s;
+        } else if (past < 0 && rule.lead_s > 0) {
+            double rate = direction * flow.rate();
+            double remaining = direction * (from_fixed(threshold) - flow.fitted());
+            predicted = rate >= FLOW_MIN_RATE_GPS && remaining <= rate * rule.lead_s;
+        }
+        if (past < 0 && !predicted) continue;
+
+        drive(rule, true, bank);
+        uint64_t writtenNs = monotonic_ns();
+        rule.firedPast = past;
+
+        OutputTrigger trigger;
+        trigger.wall_ms = wall_clock_ms();
+        trigger.scale = scale;
+        trigger.rule = i;
+        trigger.gpio = rule.gpio;
+        trigger.condition = rule.condition;
+        trigger.threshold_g = threshold;
+        trigger.net_g = sample.net_g;
+        trigger.predicted = predicted;
+        uint64_t sampleNs = sample.timestamp_us * 1000;
+        trigger.latency_ns = writtenNs > sampleNs ? writtenNs - sampleNs : 0;
+        bank.record(trigger);
+    }
+}
+
+OutputRuleSet* build_output_rules(const std::string& spec, std::string* error) {
+    std::unique_ptr<OutputRuleSet> set(new OutputRuleSet);
+    set->description = spec;
+
+    for (const std::string& text : split(spec, ',')) {
+        std::vector<std::string> args = split(text, ':');
+        if (args.empty()) continue;
+        if (args[0] == "none" && args.size() == 1) continue;
+
+        OutputRuleSet::Rule rule = {};
+        std::string pin = args[0];
+        rule.activeLow = !pin.empty() && pin[0] == '!';
+        if (rule.activeLow) pin.erase(0, 1);
+        double gpio = -1, grams = 0, lead_ms = 0;
+        size_t leadAt = 0;
+        bool valid = args.size() >= 2 && parse_number(pin, gpio) && gpio >= 0 && gpio <= OUTPUT_GPIO_MAX &&
+                     gpio == std::floor(gpio);
+        if (valid && (args[1] == "above" || args[1] == "below")) {
+            rule.condition = args[1] == "above" ? OUTPUT_ABOVE : OUTPUT_BELOW;
+            valid = (args.size() == 3 || args.size() == 4) && parse_number(args[2], grams) && std::fabs(grams) < 1e9;
+            rule.grams = to_fixed(grams);
+            leadAt = 3;
+        } else if (valid && args[1] == "target") {
+            rule.condition = OUTPUT_TARGET;
+            valid = args.size() == 2 || args.size() == 3;
+            leadAt = 2;
+        } else {
+            valid = false;
+        }
+        if (valid && args.size() > leadAt) {
+            valid = parse_number(args[leadAt], lead_ms) && lead_ms >= 0;
+        }
+        if (!valid) {
+            if (error != nullptr) *error = "invalid output rule '" + text + "'";
+            return nullptr;
+        }
+        if (set->rules.size() == OUTPUT_RULES_MAX) {
+            if (error != nullptr) *error = "at most " + std::to_string(OUTPUT_RULES_MAX) + " output rules per scale";
+            return nullptr;
+        }
+        rule.gpio = static_cast<unsigned>(gpio);
+        rule.lead_s = lead_ms / 1000.0;
+        set->rules.push_back(rule);
+    }
+    return set.release();
+}
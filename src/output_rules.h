@@ -0,0 +1,142 @@
+#ifndef OUTPUT_RULES_H
+#define OUTPUT_RULES_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "gpio_registers.h"
+#include "sample_ring.h"
+#include "flow_rate.h"
+#include "metrics.h"
+
+#define DEFAULT_OUTPUT_DRIVER "auto"
+#define OUTPUT_RULES_MAX 8            // per scale
+#define OUTPUT_GPIO_MAX 27            // highest BCM pin on the header
+#define OUTPUT_LOG_SIZE 64            // triggers kept for /api/triggers
+#define OUTPUT_REARM_DIVISOR 10       // re-arm once back a tenth of the threshold...
+#define OUTPUT_REARM_MIN_G 1          // ...but at least this many grams
+#define OUTPUT_PREDICT_MAX_RESIDUAL_G 2.0  // no predictions while the flow fit is this poor
+
+enum OutputCondition {
+    OUTPUT_ABOVE,   // net weight rises to the threshold
+    OUTPUT_BELOW,   // net weight falls to the threshold
+    OUTPUT_TARGET   // net weight reaches the fill cutoff for the scale's target
+};
+
+const char* output_condition_name(OutputCondition condition);
+
+// One rule firing, as logged
+struct OutputTrigger {
+    int64_t wall_ms = 0;
+    unsigned scale = 0;          // index of the scale
+    unsigned rule = 0;           // position in the scale's rule spec
+    unsigned gpio = 0;
+    OutputCondition condition = OUTPUT_ABOVE;
+    fixed_t threshold_g = 0;
+    fixed_t net_g = 0;           // filtered net weight of the sample that fired it
+    bool predicted = false;      // fired on the predicted crossing, not the crossing
+    uint64_t latency_ns = 0;     // sample timestamp to the pin being written
+};
+
+// The output pins and the trigger log, shared by every scale. Pins are
+// written straight to the GPIO registers, or only recorded when simulated
+// so rules can be exercised and timed on any box. Levels and the log are
+// safe to read from any thread.
+class OutputBank {
+public:
+    // "gpio" needs /dev/gpiomem, "sim" never touches a pin, "auto" uses the
+    // registers when they can be mapped
+    bool open(const std::string& driver, std::string* error);
+    bool simulated() const { return !registers.is_open(); }
+
+    // Pins the sensors use, which no rule may drive
+    void reserve(uint32_t pins);
+
+    // Take `pins` for the next rules of scale `scale`, in place of what its
+    // previous rules took. False with *error set if a sensor uses one of
+    // them, or another scale's rules (in use or still pending) hold it.
+    bool assign(unsigned scale, uint32_t pins, std::string* error);
+
+    // measurement_thread: scale `scale` now drives `pins`
+    void claimed(unsigned scale, uint32_t pins);
+
+    // Make `gpio` an output, driven to `high` first so it does not glitch
+    void claim(unsigned gpio, bool high);
+    void write(unsigned gpio, bool high);
+    uint32_t levels() const { return written.load(std::memory_order_relaxed); }
+
+    void record(const OutputTrigger& trigger);
+
+    // Up to `max` of the latest triggers, oldest first
+    size_t triggers(OutputTrigger* out, size_t max) const;
+    uint64_t trigger_count() const;
+    const LatencyHistogram& latency() const { return latencyTime; }
+
+private:
+    GpioRegisters registers;
+    std::atomic<uint32_t> written{0};  // last level written to each pin
+
+    std::mutex pinMutex;
+    uint32_t reserved = 0;            // sensor pins
+    std::vector<uint32_t> requested;  // per scale, pins of its latest rules
+    std::vector<uint32_t> active;     // per scale, pins of the rules it runs
+
+    mutable std::mutex logMutex;
+    OutputTrigger log[OUTPUT_LOG_SIZE];
+    uint64_t logged = 0;
+    LatencyHistogram latencyTime;
+};
+
+// A scale's output rules and whether each has fired. Built from a spec by
+// build_output_rules() and then used only by measurement_thread.
+class OutputRuleSet {
+public:
+    const std::string& spec() const { return description; }
+
+    // The pins the rules drive, one bit each
+    uint32_t pins() const;
+
+    // Set every rule's pin to its inactive level and make it an output
+    void claim(OutputBank& bank);
+
+    // Return the pins of fired rules to their inactive level
+    void release(OutputBank& bank);
+
+    // Check every rule against a processed sample of scale `scale`. A rule
+    // fires once, drives its pin and logs the trigger, then re-arms and
+    // releases the pin when the weight goes back past its threshold.
+    void evaluate(const Sample& sample, const FlowEstimator& flow, unsigned scale, OutputBank& bank);
+
+private:
+    friend OutputRuleSet* build_output_rules(const std::string&, std::string*);
+
+    struct Rule {
+        unsigned gpio;
+        OutputCondition condition;
+        fixed_t grams;      // threshold; OUTPUT_TARGET takes the scale's target
+        double lead_s;      // also fire when the crossing is predicted this soon
+        bool activeLow;
+        bool fired;
+        fixed_t firedPast;  // how far past the threshold the weight was then
+    };
+
+    void drive(Rule& rule, bool active, OutputBank& bank);
+
+    std::vector<Rule> rules;
+    std::string description;
+};
+
+// Parse rules like "17:target,!18:above:500:250". Rules, comma separated:
+//   GPIO:above:GRAMS[:LEAD_MS]   net weight reaches GRAMS from below
+//   GPIO:below:GRAMS[:LEAD_MS]   net weight reaches GRAMS from above
+//   GPIO:target[:LEAD_MS]        net weight reaches the cutoff for the
+//                                target set through /api/target
+// GPIO is a BCM pin number, driven high when the rule fires; !GPIO drives
+// it low instead. LEAD_MS fires that long before the crossing the flow
+// rate predicts (for target, before the cutoff). An empty spec or "none"
+// has no rules. Returns nullptr and sets *error if the spec is invalid.
+OutputRuleSet* build_output_rules(const std::string& spec, std::string* error);
+
+#endif
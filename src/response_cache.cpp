@@ -0,0 +1,145 @@
+#include "response_cache.h"
+#include <time.h>
+#include <string.h>
+#include <charconv>
+
+ResponseCache::ResponseCache(const char* type, size_t max) : contentType(type), bodyMax(max) {
+    // ETags carry the process start time so a restarted server never
+    // answers 304 for a version number from its previous life
+    char* end = std::to_chars(etagPrefix, etagPrefix + sizeof(etagPrefix) - 1,
+                              static_cast<unsigned long>(time(nullptr)), 16).ptr;
+    *end = '\0';
+
+    for (Slot& slot : slots) {
+        char* block = new char[sizeof(Slot*) + bodyMax];
+        *reinterpret_cast<Slot**>(block) = &slot;
+        slot.body = block + sizeof(Slot*);
+        slot.etag[0] = '\0';
+        slot.state.store(SLOT_FREE);
+        slot.users.store(0);
+        slot.ok = nullptr;
+        slot.notModified = nullptr;
+    }
+
+    unavailable = MHD_create_response_from_buffer(0, (void*)"", MHD_RESPMEM_PERSISTENT);
+    if (unavailable != nullptr) {
+        MHD_add_response_header(unavailable, "Access-Control-Allow-Origin", "*");
+        MHD_add_response_header(unavailable, "Retry-After", "1");
+    }
+}
+
+ResponseCache::~ResponseCache() {
+    for (Slot& slot : slots) {
+        if (slot.ok != nullptr) MHD_destroy_response(slot.ok);
+        if (slot.notModified != nullptr) MHD_destroy_response(slot.notModified);
+        delete[] (slot.body - sizeof(Slot*));
+    }
+    if (unavailable != nullptr) MHD_destroy_response(unavailable);
+}
+
+// libmicrohttpd is done with a body: the last connection sending it closed
+void ResponseCache::release_body(void* body) {
+    Slot* slot = reinterpret_cast<Slot**>(body)[-1];
+    slot->state.store(SLOT_FREE);
+}
+
+// Drop our reference to retired responses once no serve() call holds them
+void ResponseCache::reclaim_retired() {
+    for (Slot& slot : slots) {
+        if (slot.state.load() != SLOT_RETIRED || slot.users.load() != 0) continue;
+
+        slot.state.store(SLOT_DRAINING);
+        MHD_destroy_response(slot.notModified);
+        slot.notModified = nullptr;
+        struct MHD_Response* ok = slot.ok;
+        slot.ok = nullptr;
+        // May call release_body() right here if no connection still has it
+        MHD_destroy_response(ok);
+    }
+}
+
+char* ResponseCache::begin_update() {
+    reclaim_retired();
+    pending = nullptr;
+    for (Slot& slot : slots) {
+        if (slot.state.load() == SLOT_FREE) {
+            pending = &slot;
+            return slot.body;
+        }
+    }
+    skipped++;
+    return nullptr;
+}
+
+bool ResponseCache::commit_update(uint64_t version, size_t length) {
+    Slot* slot = pending;
+    pending = nullptr;
+    if (slot == nullptr || length == 0 || length > bodyMax) {
+        return false;  // slot is still free
+    }
+
+    char* etag = slot->etag;
+    char* etagEnd = etag + sizeof(slot->etag) - 2;
+    *etag++ = '"';
+    size_t prefixLength = strlen(etagPrefix);
+    memcpy(etag, etagPrefix, prefixLength);
+    etag += prefixLength;
+    *etag++ = '-';
+    etag = std::to_chars(etag, etagEnd, version).ptr;
+    *etag++ = '"';
+    *etag = '\0';
+
+    slot->ok = MHD_create_response_from_buffer_with_free_callback(length, slot->body, &ResponseCache::release_body);
+    slot->notModified = MHD_create_response_from_buffer(0, (void*)"", MHD_RESPMEM_PERSISTENT);
+    if (slot->ok == nullptr || slot->notModified == nullptr) {
+        if (slot->notModified != nullptr) MHD_destroy_response(slot->notModified);
+        slot->notModified = nullptr;
+        if (slot->ok != nullptr) {
+            slot->state.store(SLOT_DRAINING);
+            MHD_destroy_response(slot->ok);  // frees the slot via release_body
+            slot->ok = nullptr;
+        }
+        return false;
+    }
+
+    MHD_add_response_header(slot->ok, "Content-Type", contentType);
+    MHD_add_response_header(slot->ok, "Access-Control-Allow-Origin", "*");
+    MHD_add_response_header(slot->ok, "Cache-Control", "no-cache");
+    MHD_add_response_header(slot->ok, "ETag", slot->etag);
+    MHD_add_response_header(slot->notModified, "Access-Control-Allow-Origin", "*");
+    MHD_add_response_header(slot->notModified, "Cache-Control", "no-cache");
+    MHD_add_response_header(slot->notModified, "ETag", slot->etag);
+
+    slot->state.store(SLOT_CURRENT);
+    Slot* previous = current.exchange(slot);
+    if (previous != nullptr) {
+        previous->state.store(SLOT_RETIRED);
+    }
+    return true;
+}
+
+MHD_Result ResponseCache::serve(struct MHD_Connection* connection) {
+    // Pin the current slot. Re-checking after the increment means the
+    // producer either sees our pin or we see that the slot was replaced.
+    Slot* slot;
+    for (;;) {
+        slot = current.load();
+        if (slot == nullptr) {
+            return MHD_queue_response(connection, MHD_HTTP_SERVICE_UNAVAILABLE, unavailable);
+        }
+        slot->users.fetch_add(1);
+        if (current.load() == slot) break;
+        slot->users.fetch_sub(1);
+    }
+
+    const char* ifNoneMatch = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_IF_NONE_MATCH);
+    MHD_Result ret;
+    if (ifNoneMatch != nullptr && strcmp(ifNoneMatch, slot->etag) == 0) {
+        ret = MHD_queue_response(connection, MHD_HTTP_NOT_MODIFIED, slot->notModified);
+    } else {
+        ret = MHD_queue_response(connection, MHD_HTTP_OK, slot->ok);
+    }
+
+    slot->users.fetch_sub(1);
+    return ret;
+}
@@ -0,0 +1,65 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <microhttpd.h>
+
+// A small body that changes once per sample and is polled many times in
+// between. The producer renders each version once into a fixed slot and
+// wraps it in persistent libmicrohttpd responses (200 and 304) that point
+// straight at the slot, so serving a request allocates nothing and copies
+// nothing. Slots are recycled only after every connection has released
+// them, which libmicrohttpd reports through the response free callback.
+//
+// Single producer; serve() may run on any number of threads.
+class ResponseCache {
+public:
+    static const unsigned SLOTS = 4;
+    static const size_t BODY_MAX = 1024;  // default body capacity
+
+    explicit ResponseCache(const char* contentType, size_t bodyMax = BODY_MAX);
+    ~ResponseCache();
+
+    size_t body_max() const { return bodyMax; }
+
+    // Producer: buffer to render the next body into (body_max() bytes), or
+    // nullptr if every slot is still referenced by slow clients
+    char* begin_update();
+
+    // Producer: publish the body written into the begin_update() buffer
+    bool commit_update(uint64_t version, size_t length);
+
+    // Queue the current body, or 304 Not Modified if the client's
+    // If-None-Match already names it. 503 until the first update.
+    MHD_Result serve(struct MHD_Connection* connection);
+
+    unsigned long skipped_updates() const { return skipped.load(); }
+
+private:
+    enum SlotState { SLOT_FREE, SLOT_CURRENT, SLOT_RETIRED, SLOT_DRAINING };
+
+    struct Slot {
+        char* body;  // preceded by a pointer back to this slot, for the free callback
+        char etag[48];
+        std::atomic<int> state;
+        std::atomic<unsigned> users;  // serve() calls holding this slot
+        struct MHD_Response* ok;
+        struct MHD_Response* notModified;
+    };
+
+    static void release_body(void* body);
+    void reclaim_retired();
+
+    const char* contentType;
+    size_t bodyMax;
+    char etagPrefix[20];
+    Slot slots[SLOTS];
+    Slot* pending = nullptr;
+    std::atomic<Slot*> current{nullptr};
+    std::atomic<unsigned long> skipped{0};
+    struct MHD_Response* unavailable;
+};
+
+#endif
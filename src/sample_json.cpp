@@ -0,0 +1,204 @@
+#include "sample_json.h"
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+// Appends into a fixed buffer; once anything fails to fit, every later
+// append is a no-op and ok() reports the overflow
+class JsonWriter {
+public:
+    JsonWriter(char* buf, size_t max) : pos(buf), end(buf + max) {}
+
+    void literal(const char* text, size_t length) {
+        if (pos == nullptr || static_cast<size_t>(end - pos) < length) {
+            pos = nullptr;
+            return;
+        }
+        memcpy(pos, text, length);
+        pos += length;
+    }
+
+    template <size_t N>
+    void literal(const char (&text)[N]) {
+        literal(text, N - 1);
+    }
+
+    template <typename T>
+    void number(T value) {
+        if (pos == nullptr) return;
+        std::to_chars_result result = std::to_chars(pos, end, value);
+        pos = result.ec == std::errc() ? result.ptr : nullptr;
+    }
+
+    // A fixed point value rounded to `decimals` places, trailing zeros dropped
+    void fixed(fixed_t value, unsigned decimals) {
+        static const int64_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+        int64_t scale = powers[decimals];
+        int64_t scaled = div_round(value * scale, FIXED_ONE);
+        if (scaled < 0) {
+            literal("-");
+            scaled = -scaled;
+        }
+        number(static_cast<long long>(scaled / scale));
+        int64_t fraction = scaled % scale;
+        if (fraction == 0) return;
+        char digits[8] = {'.'};
+        unsigned length = decimals;
+        while (fraction % 10 == 0) {
+            fraction /= 10;
+            length--;
+        }
+        for (unsigned i = length; i > 0; i--) {
+            digits[i] = '0' + fraction % 10;
+            fraction /= 10;
+        }
+        literal(digits, length + 1);
+    }
+
+    void grams(fixed_t value) {
+        fixed(value, JSON_GRAMS_DECIMALS);
+    }
+
+    void ounces(fixed_t grams) {
+        fixed(convert_units<GramsToOunces>(grams), JSON_OUNCES_DECIMALS);
+    }
+
+    // Output of another renderer, written in place
+    void nested(size_t (*render)(const Sample&, char*, size_t), const Sample& s) {
+        if (pos == nullptr) return;
+        size_t length = render(s, pos, end - pos);
+        pos = length > 0 ? pos + length : nullptr;
+    }
+
+    void boolean(bool value) {
+        if (value) literal("true");
+        else literal("false");
+    }
+
+    bool ok() const { return pos != nullptr; }
+    char* position() const { return pos; }
+
+private:
+    char* pos;
+    char* end;
+};
+
+}  // namespace
+
+size_t render_sample_json(const Sample& s, char* buf, size_t max) {
+    JsonWriter out(buf, max);
+    out.literal("{\"timestamp_ms\": ");
+    out.number(static_cast<long long>(s.wall_ms));
+    out.literal(",\"measured_weight_g\": ");
+    out.grams(s.weight_g);
+    out.literal(",\"measured_weight_oz\": ");
+    out.ounces(s.weight_g);
+    out.literal(",\"container_weight_g\": ");
+    out.grams(s.container_g);
+    out.literal(",\"container_weight_oz\": ");
+    out.ounces(s.container_g);
+    out.literal(",\"fluid_weight_g\": ");
+    out.grams(s.net_g);
+    out.literal(",\"fluid_weight_oz\": ");
+    out.ounces(s.net_g);
+    out.literal(",\"stable\": ");
+    out.boolean(s.stable);
+    out.literal(",\"settled_at\": ");
+    if (s.settled_at_ms > 0) out.number(static_cast<long long>(s.settled_at_ms));
+    else out.literal("null");
+    out.literal(",\"time_to_settle_ms\": ");
+    if (s.time_to_settle_ms >= 0) out.number(s.time_to_settle_ms);
+    else out.literal("null");
+    out.literal(",\"flow_rate_g_s\": ");
+    out.grams(s.flow_gps);
+    out.literal(",\"flow_rate_oz_s\": ");
+    out.ounces(s.flow_gps);
+    out.literal(",\"target_g\": ");
+    if (s.target_g > 0) out.grams(s.target_g);
+    else out.literal("null");
+    out.literal(",\"time_to_target_s\": ");
+    if (s.time_to_target_s >= 0) out.number(s.time_to_target_s);
+    else out.literal("null");
+    out.literal(",\"cutoff_g\": ");
+    if (s.time_to_cutoff_s >= 0) out.grams(s.cutoff_g);
+    else out.literal("null");
+    out.literal(",\"time_to_cutoff_s\": ");
+    if (s.time_to_cutoff_s >= 0) out.number(s.time_to_cutoff_s);
+    else out.literal("null");
+    out.literal("}");
+    return out.ok() ? out.position() - buf : 0;
+}
+
+size_t render_settle_json(const Sample& s, char* buf, size_t max) {
+    JsonWriter out(buf, max);
+    out.literal("{\"settled_at\": ");
+    out.number(static_cast<long long>(s.settled_at_ms));
+    out.literal(",\"time_to_settle_ms\": ");
+    out.number(s.time_to_settle_ms);
+    out.literal(",\"measured_weight_g\": ");
+    out.grams(s.weight_g);
+    out.literal(",\"fluid_weight_g\": ");
+    out.grams(s.net_g);
+    out.literal(",\"fluid_weight_oz\": ");
+    out.ounces(s.net_g);
+    out.literal("}");
+    return out.ok() ? out.position() - buf : 0;
+}
+
+size_t render_scales_json(const char* const* ids, const Sample* const* samples, size_t count,
+                          char* buf, size_t max) {
+    JsonWriter out(buf, max);
+    out.literal("{");
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) out.literal(",");
+        out.literal("\"");
+        out.literal(ids[i], strlen(ids[i]));
+        out.literal("\": ");
+        if (samples[i] != nullptr) out.nested(render_sample_json, *samples[i]);
+        else out.literal("null");
+    }
+    out.literal("}");
+    return out.ok() ? out.position() - buf : 0;
+}
+
+size_t render_telemetry_row(const char* id, const Sample& s, char* buf, size_t max) {
+    JsonWriter out(buf, max);
+    out.literal("[\"");
+    out.literal(id, strlen(id));
+    out.literal("\",");
+    out.number(static_cast<long long>(s.wall_ms));
+    out.literal(",");
+    out.grams(s.weight_g);
+    out.literal(",");
+    out.grams(s.net_g);
+    out.literal(",");
+    out.grams(s.flow_gps);
+    out.literal(",");
+    out.boolean(s.stable);
+    out.literal("]");
+    return out.ok() ? out.position() - buf : 0;
+}
+
+void append_json_string(std::string& out, const std::string& text) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char escaped[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+            out.append(escaped, sizeof(escaped));
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+std::string json_string(const std::string& text) {
+    std::string quoted;
+    append_json_string(quoted, text);
+    return quoted;
+}
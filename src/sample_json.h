@@ -0,0 +1,37 @@
+#ifndef SAMPLE_JSON_H
+#define SAMPLE_JSON_H
+
+#include <stddef.h>
+#include <string>
+#include "sample_ring.h"
+
+#define SAMPLE_JSON_MAX 768  // comfortably above the longest rendering
+
+#define JSON_GRAMS_DECIMALS 3   // milligrams
+#define JSON_OUNCES_DECIMALS 5
+
+// Render one sample in the /api/measurements format with std::to_chars.
+// Fixed point weights are written as decimals straight from the integers.
+// No allocation and no locale; returns the length, or 0 if `max` is too small.
+size_t render_sample_json(const Sample& s, char* buf, size_t max);
+
+// Payload of the SSE "settle" event raised by the sample that settled
+size_t render_settle_json(const Sample& s, char* buf, size_t max);
+
+// Body of /api/scales: {"ID": measurement, ...} with null for a scale
+// that has no sample yet. Ids are emitted as is, so must not need escaping.
+size_t render_scales_json(const char* const* ids, const Sample* const* samples, size_t count,
+                          char* buf, size_t max);
+
+// One sample as a row of a JSON telemetry frame (see TELEMETRY_JSON_FIELDS):
+// ["ID", timestamp_ms, measured g, fluid g, flow g/s, stable]
+size_t render_telemetry_row(const char* id, const Sample& s, char* buf, size_t max);
+
+// Append `text` to `out` as a quoted JSON string. Quotes and backslashes
+// are escaped and control characters written as \u00XX.
+void append_json_string(std::string& out, const std::string& text);
+
+// The same as a new string
+std::string json_string(const std::string& text);
+
+#endif
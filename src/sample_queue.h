@@ -0,0 +1,70 @@
+#ifndef SAMPLE_QUEUE_H
+#define SAMPLE_QUEUE_H
+
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "clocks.h"
+
+// One 24-bit conversion as clocked out of the HX711
+struct RawSample {
+    long value;
+    uint64_t timestamp_us;
+    unsigned scale;  // index of the scale it was read from
+};
+
+// Bounded queue between the sensor backends and the measurement thread,
+// shared by all scales. When the consumer falls behind the oldest sample
+// is dropped so the producer never waits.
+class SampleQueue {
+public:
+    static const unsigned CAPACITY = 256;
+
+    void push(const RawSample& sample) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (count == CAPACITY) {
+                head = (head + 1) % CAPACITY;
+                count--;
+                dropped++;
+            }
+            items[(head + count) % CAPACITY] = sample;
+            count++;
+        }
+        ready.notify_one();
+    }
+
+    // Wait up to timeout_ms for a sample; returns false on timeout
+    bool pop(RawSample& out, int timeout_ms) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!ready.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                            [this] { return count > 0; })) {
+            return false;
+        }
+        out = items[head];
+        head = (head + 1) % CAPACITY;
+        count--;
+        return true;
+    }
+
+    bool empty() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count == 0;
+    }
+
+    unsigned long dropped_count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped;
+    }
+
+private:
+    RawSample items[CAPACITY];
+    unsigned head = 0;
+    unsigned count = 0;
+    unsigned long dropped = 0;
+    std::mutex mutex;
+    std::condition_variable ready;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+#include "fixed_point.h"
+
+// One processed measurement as published by the measurement thread
+struct Sample {
+    uint64_t seq;           // 1-based publish order, 0 = empty
+    uint64_t timestamp_us;  // monotonic time the conversion was read
+    int64_t wall_ms;        // wall-clock time, for history and clients
+    long raw;
+    fixed_t weight_g;       // weights and flow in fixed point, see fixed_point.h
+    fixed_t container_g;
+    fixed_t net_g;
+    bool stable;            // reading has settled
+    bool settled;           // this sample is the one that settled it
+    int64_t settled_at_ms;  // wall-clock time of the last settle, 0 if none
+    float time_to_settle_ms;  // duration of the last settle, -1 if none
+    fixed_t flow_gps;         // net weight change, grams per second
+    fixed_t target_g;         // fill target, 0 if none
+    float time_to_target_s;   // -1 unless a fill is running towards the target
+    fixed_t cutoff_g;         // weight to close the valve at, given what is in flight
+    float time_to_cutoff_s;   // -1 as time_to_target_s; 0 once past the cutoff
+};
+
+// Single-producer / multi-consumer ring of the most recent N items.
+// Every slot is guarded by its own seqlock: the producer never waits on a
+// reader, and a reader that races with an overwrite simply retries or
+// skips that slot. T must be trivially copyable and carry a uint64_t seq.
+template <typename T, unsigned N>
+class SeqRing {
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+public:
+    static const unsigned CAPACITY = N;
+
+    // Producer only. Assigns the next sequence number and returns it.
+    uint64_t publish(T item) {
+        uint64_t seq = nextSeq++;
+        item.seq = seq;
+        Slot& slot = slots[seq & (N - 1)];
+        slot.version.store(seq * 2 - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&slot.item, &item, sizeof(T));
+        slot.version.store(seq * 2, std::memory_order_release);
+        headSeq.store(seq, std::memory_order_release);
+        return seq;
+    }
+
+    // Sequence number of the newest item, 0 if nothing has been published
+    uint64_t head() const {
+        return headSeq.load(std::memory_order_acquire);
+    }
+
+    // Oldest sequence number still safe to read
+    uint64_t oldest() const {
+        uint64_t last = head();
+        return last > N - 1 ? last - N + 2 : 1;
+    }
+
+    // Copy out item `seq`; false if it was never written or already overwritten
+    bool get(uint64_t seq, T& out) const {
+        if (seq == 0) return false;
+        const Slot& slot = slots[seq & (N - 1)];
+        for (int attempt = 0; attempt < 4; attempt++) {
+            uint64_t v1 = slot.version.load(std::memory_order_acquire);
+            if (v1 != seq * 2) {
+                // Odd means a write is in progress on this very item
+                if (v1 == seq * 2 - 1) continue;
+                return false;
+            }
+            memcpy(&out, &slot.item, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.version.load(std::memory_order_relaxed) == v1) return true;
+        }
+        return false;
+    }
+
+    // Consistent copy of the newest item
+    bool latest(T& out) const {
+        for (int attempt = 0; attempt < 4; attempt++) {
+            if (get(head(), out)) return true;
+        }
+        return false;
+    }
+
+    // Up to `max` of the most recent items, oldest first. Returns the count.
+    unsigned history(T* out, unsigned max) const {
+        uint64_t last = head();
+        if (max > N - 1) max = N - 1;  // leave the slot being overwritten alone
+        uint64_t first = last >= max ? last - max + 1 : 1;
+        unsigned count = 0;
+        for (uint64_t seq = first; seq != 0 && seq <= last; seq++) {
+            if (get(seq, out[count])) count++;
+        }
+        return count;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> version{0};  // 2*seq when stable, odd while writing
+        T item;
+    };
+
+    Slot slots[N];
+    uint64_t nextSeq = 1;
+    std::atomic<uint64_t> headSeq{0};
+};
+
+typedef SeqRing<Sample, 1024> SampleRing;
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <atomic>
+#include "fixed_point.h"
+#include "sensor_backend.h"
+
+// Calibration on top of whichever backend supplies the scale's conversions.
+// measurement_thread converts with it while request handlers retune it.
+// Offset and factor are fixed point, so the tare keeps the fraction of a
+// count its averaging produced and conversion needs no floating point.
+class Scale {
+private:
+    SensorBackend* sensor;  // may serve other scales on the same clock line too
+    std::atomic<fixed_t> OFFSET{0};         // raw counts
+    std::atomic<fixed_t> SCALE{FIXED_ONE};  // raw counts per gram
+    std::atomic<int> GAIN{128};
+
+public:
+    explicit Scale(SensorBackend* backend) : sensor(backend) {
+    }
+
+    SensorBackend* backend() const {
+        return sensor;
+    }
+
+    // False, leaving the factor as it was, if it is zero in fixed point
+    bool set_scale(double scale) {
+        if (to_fixed(scale) == 0) return false;
+        SCALE = to_fixed(scale);
+        return true;
+    }
+
+    void set_offset(fixed_t offset) {
+        OFFSET = offset;
+    }
+
+    // False if the backend cannot run at `gain`
+    bool set_gain(int gain) {
+        if (!sensor->set_gain(gain)) return false;
+        GAIN = gain;
+        return true;
+    }
+
+    fixed_t get_offset() const {
+        return OFFSET.load(std::memory_order_relaxed);
+    }
+
+    double get_scale() const {
+        return from_fixed(SCALE.load(std::memory_order_relaxed));
+    }
+
+    int get_gain() const {
+        return GAIN.load(std::memory_order_relaxed);
+    }
+
+    // Grams, in fixed point: (raw - offset) / factor with both operands
+    // carrying FIXED_FRAC_BITS, rounded once
+    fixed_t to_units(long raw) const {
+        fixed_t counts = static_cast<fixed_t>(raw) * FIXED_ONE - get_offset();
+        return div_round(counts * FIXED_ONE, SCALE.load(std::memory_order_relaxed));
+    }
+};
+
+#endif
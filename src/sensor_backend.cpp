@@ -0,0 +1,292 @@
+#include "sensor_backend.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include "spec_parse.h"
+#ifndef WITHOUT_PIGPIO
+#include "hx711_backend.h"
+#endif
+
+// Default HX711 pins (BCM numbering)
+#define DEFAULT_DOUT_PIN 5
+#define DEFAULT_CLK_PIN 6
+
+#define DEFAULT_SIM_SPS 80
+#define DEFAULT_SIM_NOISE_G 0.2
+
+void apply_acquisition_options(const AcquisitionOptions& options) {
+    if (options.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(options.cpu, &cpus);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (rc != 0) {
+            std::cerr << "Cannot pin acquisition to CPU " << options.cpu << ": " << strerror(rc) << std::endl;
+        }
+    }
+    if (options.priority > 0) {
+        struct sched_param param;
+        param.sched_priority = options.priority;
+        int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (rc != 0) {
+            std::cerr << "Cannot run acquisition at SCHED_FIFO " << options.priority << ": " << strerror(rc) << std::endl;
+        }
+    }
+}
+
+TimedSensor::~TimedSensor() {
+    stop_acquisition();
+}
+
+bool TimedSensor::start_acquisition(SampleQueue* queue) {
+    stop_acquisition();
+    std::lock_guard<std::mutex> lock(mutex);
+    // Carry on from wherever the last run left the timetable
+    startUs = monotonic_us() - lastOffset;
+    stopping = false;
+    thread = std::thread(&TimedSensor::run, this, queue);
+    return true;
+}
+
+void TimedSensor::stop_acquisition() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+AcquisitionStats TimedSensor::stats() const {
+    AcquisitionStats stats;
+    stats.frames = frames.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void TimedSensor::run(SampleQueue* queue) {
+    apply_acquisition_options(options);
+    std::unique_lock<std::mutex> lock(mutex);
+    RawSample sample;
+    sample.scale = scaleIndex;
+    for (;;) {
+        uint64_t start = monotonic_ns();
+        if (stopping || !next(sample.value, lastOffset)) {
+            break;
+        }
+        readTime.observe(monotonic_ns() - start);
+        sample.timestamp_us = startUs + lastOffset;
+        std::chrono::steady_clock::time_point due{std::chrono::microseconds(sample.timestamp_us)};
+        if (wake.wait_until(lock, due, [this] { return stopping; })) {
+            break;
+        }
+        // How late the thread woke for its timetable
+        uint64_t woke = monotonic_ns();
+        readyWait.observe(woke > sample.timestamp_us * 1000 ? woke - sample.timestamp_us * 1000 : 0);
+        queue->push(sample);
+        frames.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool load_trace(const std::string& path, std::vector<TraceSample>& out, std::string* error) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        *error = "cannot open trace " + path;
+        return false;
+    }
+    out.clear();
+    std::string line;
+    for (unsigned number = 1; std::getline(file, line); number++) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        long long first = 0, second = 0;
+        TraceSample sample;
+        if (!(fields >> first)) {
+            *error = path + ":" + std::to_string(number) + ": expected a number";
+            return false;
+        }
+        if (fields >> second) {
+            sample.timestamp_us = first;
+            sample.value = second;
+        } else {
+            sample.timestamp_us = 0;
+            sample.value = first;
+        }
+        out.push_back(sample);
+    }
+    if (out.empty()) {
+        *error = "trace " + path + " is empty";
+        return false;
+    }
+    return true;
+}
+
+SimulatedSensor::SimulatedSensor(unsigned scale, const AcquisitionOptions& options,
+                                 Profile p, double sps, double noise_g)
+    : TimedSensor(scale, options), profile(p), periodUs(1e6 / sps), noise(0.0, noise_g) {
+}
+
+SimulatedSensor::SimulatedSensor(unsigned scale, const AcquisitionOptions& options,
+                                 const std::vector<TraceSample>& samples, double sps)
+    : TimedSensor(scale, options), profile(PROFILE_TRACE), periodUs(1e6 / sps), trace(samples) {
+}
+
+double SimulatedSensor::profile_weight(Profile profile, double t) {
+    if (profile == PROFILE_STEADY) {
+        return 250;
+    }
+
+    // Pour cycle
+    const double container = 180, rate = 35;  // g, g/s
+    double phase = std::fmod(t, 30.0);
+    if (phase < 3) return 0;                                 // empty
+    if (phase < 5) return container;                         // container placed
+    if (phase < 15) return container + rate * (phase - 5);   // pouring
+    if (phase < 25) return container + rate * 10;            // full, settling
+    return 0;                                                // taken away
+}
+
+bool SimulatedSensor::next(long& value, uint64_t& offset_us) {
+    offset_us = static_cast<uint64_t>(count * periodUs);
+    if (profile == PROFILE_TRACE) {
+        value = trace[count % trace.size()].value;
+    } else {
+        double grams = profile_weight(profile, offset_us / 1e6);
+        if (noise.stddev() > 0) grams += noise(random);
+        value = SIM_OFFSET + std::lround(grams * SIM_COUNTS_PER_GRAM);
+    }
+    count++;
+    return true;
+}
+
+ReplaySensor::ReplaySensor(unsigned scale, const AcquisitionOptions& options,
+                           const std::vector<TraceSample>& samples, double s)
+    : TimedSensor(scale, options), trace(samples), speed(s) {
+}
+
+bool ReplaySensor::next(long& value, uint64_t& offset_us) {
+    if (position >= trace.size()) {
+        value = trace.back().value;
+        return false;
+    }
+    value = trace[position].value;
+    offset_us = static_cast<uint64_t>((trace[position].timestamp_us - trace[0].timestamp_us) / speed);
+    position++;
+    return true;
+}
+
+static bool parse_non_negative(const std::string& text, double& out) {
+    return parse_number(text, out) && out >= 0;
+}
+
+bool is_hardware_sensor(const std::string& spec) {
+    return spec.compare(0, spec.find(':'), "hx711") == 0;
+}
+
+// A stand-in backend for one scale, or nullptr with *error set
+static SensorBackend* create_timed_sensor(const std::string& spec, unsigned scale,
+                                          const AcquisitionOptions& options, std::string* error) {
+    std::vector<std::string> args = split(spec, ':');
+    std::string name = args.empty() ? "" : args[0];
+    double a = 0, b = 0;
+
+    if (name == "sim" && args.size() <= 4) {
+        std::string profile = args.size() > 1 ? args[1] : "pour";
+        a = DEFAULT_SIM_SPS;
+        b = DEFAULT_SIM_NOISE_G;
+        if ((args.size() > 2 && (!parse_non_negative(args[2], a) || a == 0)) ||
+            (args.size() > 3 && !parse_non_negative(args[3], b))) {
+            *error = "invalid sensor '" + spec + "'";
+            return nullptr;
+        }
+        if (profile == "pour") return new SimulatedSensor(scale, options, SimulatedSensor::PROFILE_POUR, a, b);
+        if (profile == "steady") return new SimulatedSensor(scale, options, SimulatedSensor::PROFILE_STEADY, a, b);
+
+        std::vector<TraceSample> trace;
+        if (!load_trace(profile, trace, error)) return nullptr;
+        return new SimulatedSensor(scale, options, trace, a);
+    }
+
+    if (name == "replay" && (args.size() == 2 || args.size() == 3)) {
+        a = 1;
+        if (args.size() == 3 && (!parse_non_negative(args[2], a) || a == 0)) {
+            *error = "invalid sensor '" + spec + "'";
+            return nullptr;
+        }
+        std::vector<TraceSample> trace;
+        if (!load_trace(args[1], trace, error)) return nullptr;
+        for (size_t i = 1; i < trace.size(); i++) {
+            if (trace[i].timestamp_us <= trace[i - 1].timestamp_us) {
+                *error = "replay needs `timestamp_us raw` lines in time order";
+                return nullptr;
+            }
+        }
+        return new ReplaySensor(scale, options, trace, a);
+    }
+
+    *error = "invalid sensor '" + spec + "' (hx711, sim or replay)";
+    return nullptr;
+}
+
+bool create_sensor_backends(const std::vector<std::string>& specs, const AcquisitionOptions& options,
+                            std::vector<SensorBackend*>& backends,
+                            std::vector<SensorBackend*>& byScale, std::string* error) {
+    std::vector<SensorBackend*> created;
+    byScale.assign(specs.size(), nullptr);
+#ifndef WITHOUT_PIGPIO
+    std::vector<std::pair<int, Hx711Backend*>> clockLines;
+#endif
+
+    for (unsigned scale = 0; scale < specs.size(); scale++) {
+        const std::string& spec = specs[scale];
+        SensorBackend* backend = nullptr;
+
+        if (is_hardware_sensor(spec)) {
+            std::vector<std::string> args = split(spec, ':');
+            double dout = DEFAULT_DOUT_PIN, clk = DEFAULT_CLK_PIN;
+            if ((args.size() != 1 && !(args.size() == 3 && parse_non_negative(args[1], dout) && parse_non_negative(args[2], clk))) ||
+                dout > 31 || clk > 31 || dout == clk) {
+                *error = "invalid sensor '" + spec + "'";
+            } else {
+#ifndef WITHOUT_PIGPIO
+                Hx711Backend* line = nullptr;
+                for (auto& clockLine : clockLines) {
+                    if (clockLine.first == static_cast<int>(clk)) line = clockLine.second;
+                }
+                if (line == nullptr && (line = Hx711Backend::open(static_cast<int>(clk), options, error)) != nullptr) {
+                    clockLines.push_back(std::make_pair(static_cast<int>(clk), line));
+                    created.push_back(line);
+                }
+                if (line != nullptr && line->has_dout(static_cast<int>(dout))) {
+                    *error = "sensor '" + spec + "' reuses a DOUT pin";
+                } else if (line != nullptr) {
+                    line->add_channel(static_cast<int>(dout), scale);
+                    backend = line;
+                }
+#else
+                *error = "this build has no pigpio support; use sim or replay";
+#endif
+            }
+        } else if ((backend = create_timed_sensor(spec, scale, options, error)) != nullptr) {
+            created.push_back(backend);
+        }
+
+        if (backend == nullptr) {
+            for (SensorBackend* b : created) delete b;
+            byScale.clear();
+            return false;
+        }
+        byScale[scale] = backend;
+    }
+
+    backends.insert(backends.end(), created.begin(), created.end());
+    return true;
+}
@@ -0,0 +1,183 @@
+#ifndef SENSOR_BACKEND_H
+#define SENSOR_BACKEND_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <atomic>
+#include "sample_queue.h"
+#include "metrics.h"
+
+#define DEFAULT_SENSOR "hx711"
+
+// Synthetic scale: raw counts at 0 g and per gram. The per-gram figure
+// matches the server's default calibration factor, so simulated weights
+// come out in grams without recalibrating.
+#define SIM_OFFSET 50000
+#define SIM_COUNTS_PER_GRAM -1100.0
+
+// Scheduling for the threads that clock conversions out of the sensors
+struct AcquisitionOptions {
+    int priority = 0;  // SCHED_FIFO priority 1-99; 0 keeps normal scheduling
+    int cpu = -1;      // CPU to pin the thread to; -1 for any
+};
+
+// Apply `options` to the calling thread. Failures are reported on stderr
+// and the thread carries on with what it has.
+void apply_acquisition_options(const AcquisitionOptions& options);
+
+// How a backend's frames went, since it was created
+struct AcquisitionStats {
+    unsigned long frames = 0;     // delivered
+    unsigned long discarded = 0;  // dropped because clocking overran the chip's timing
+    uint32_t last_frame_ns = 0;   // time spent clocking the last frame
+    uint32_t max_frame_ns = 0;
+    uint64_t total_frame_ns = 0;  // over all frames, for the mean
+};
+
+// Where raw conversions come from: HX711s on the Pi, or a stand-in so the
+// server runs on any Linux box. A backend serves one or more scales and
+// tags every sample with the index of the scale it belongs to.
+class SensorBackend {
+public:
+    virtual ~SensorBackend() {}
+
+    // Push every conversion into `queue` as it is produced
+    virtual bool start_acquisition(SampleQueue* queue) = 0;
+    virtual void stop_acquisition() = 0;
+
+    virtual AcquisitionStats stats() const = 0;
+
+    // HX711 channel A gain (128, 64 or 32) from the next conversion on,
+    // for every scale the backend serves. Stand-ins only run at 128.
+    virtual bool set_gain(int gain) { return gain == 128; }
+
+    // GPIO pins (BCM) the backend reads or drives, one bit each; output
+    // rules must keep off them
+    virtual uint32_t gpio_pins() const { return 0; }
+
+    // How long conversions waited between becoming ready (DOUT low, or the
+    // scheduled time for stand-ins) and being read, and how long reading
+    // took. Filled in by the implementations.
+    const LatencyHistogram& ready_wait() const { return readyWait; }
+    const LatencyHistogram& read_time() const { return readTime; }
+
+protected:
+    LatencyHistogram readyWait;
+    LatencyHistogram readTime;
+};
+
+// Base for stand-ins that produce conversions on a timetable from a thread
+// of their own. Sample timestamps are the scheduled times, not the times
+// the thread happened to wake, so a run is reproducible. Subclasses stop
+// acquisition in their own destructor, while next() can still be called.
+class TimedSensor : public SensorBackend {
+public:
+    TimedSensor(unsigned scale, const AcquisitionOptions& acquisition)
+        : scaleIndex(scale), options(acquisition) {}
+    ~TimedSensor();
+
+    bool start_acquisition(SampleQueue* queue) override;
+    void stop_acquisition() override;
+
+    AcquisitionStats stats() const override;
+
+protected:
+    // Value of the next conversion and when it is due, in µs after the
+    // first one. False once there are no more.
+    virtual bool next(long& value, uint64_t& offset_us) = 0;
+
+private:
+    void run(SampleQueue* queue);
+
+    unsigned scaleIndex;
+    AcquisitionOptions options;
+    std::atomic<unsigned long> frames{0};
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    uint64_t startUs = 0;     // monotonic time of offset 0
+    uint64_t lastOffset = 0;  // of the conversion handed out last
+};
+
+// One line of a recorded trace: `timestamp_us raw`, or just `raw`
+struct TraceSample {
+    uint64_t timestamp_us;  // 0 when the line has no timestamp
+    long value;
+};
+
+// Read a trace file. Blank lines and lines starting with # are skipped.
+bool load_trace(const std::string& path, std::vector<TraceSample>& out, std::string* error);
+
+// Deterministic HX711 at `sps` conversions per second, following either a
+// synthetic profile or the values of a recorded trace (looped, timestamps
+// ignored). Synthetic profiles get Gaussian noise of `noise_g` grams from
+// a fixed seed. Profiles:
+//   pour     30 s cycle: empty, container placed, steady pour, hold, removed
+//   steady   constant 250 g
+class SimulatedSensor : public TimedSensor {
+public:
+    enum Profile { PROFILE_POUR, PROFILE_STEADY, PROFILE_TRACE };
+
+    SimulatedSensor(unsigned scale, const AcquisitionOptions& options,
+                    Profile profile, double sps, double noise_g);
+    SimulatedSensor(unsigned scale, const AcquisitionOptions& options,
+                    const std::vector<TraceSample>& trace, double sps);
+    ~SimulatedSensor() { stop_acquisition(); }
+
+    // Grams on the scale `t` seconds into a synthetic profile
+    static double profile_weight(Profile profile, double t);
+
+protected:
+    bool next(long& value, uint64_t& offset_us) override;
+
+private:
+    Profile profile;
+    double periodUs;
+    std::vector<TraceSample> trace;
+    uint64_t count = 0;
+    std::mt19937 random{1};
+    std::normal_distribution<double> noise;
+};
+
+// Plays a recorded trace back with its original spacing, sped up by
+// `speed`. Acquisition ends with the file.
+class ReplaySensor : public TimedSensor {
+public:
+    ReplaySensor(unsigned scale, const AcquisitionOptions& options,
+                 const std::vector<TraceSample>& trace, double speed);
+    ~ReplaySensor() { stop_acquisition(); }
+
+protected:
+    bool next(long& value, uint64_t& offset_us) override;
+
+private:
+    std::vector<TraceSample> trace;
+    double speed;
+    size_t position = 0;
+};
+
+// Backends for scales 0..N-1 from one spec each:
+//   hx711[:DOUT:CLK]             the chip through pigpio (BCM pins, default 5:6)
+//   sim[:PROFILE[:SPS[:NOISE]]]  simulated chip; PROFILE is pour, steady or a
+//                                trace file (default pour:80:0.2)
+//   replay:FILE[:SPEED]          trace file with its original timing
+// HX711s on the same clock pin share one backend that reads them all in
+// the same clock burst. `backends` receives every backend created (the
+// caller deletes them), `byScale` the backend of each scale. Returns false
+// and sets *error if a spec is invalid, names a backend that is not built
+// in, or one fails to start; nothing is left allocated then. Acquisition
+// threads run with `options`.
+bool create_sensor_backends(const std::vector<std::string>& specs, const AcquisitionOptions& options,
+                            std::vector<SensorBackend*>& backends,
+                            std::vector<SensorBackend*>& byScale, std::string* error);
+
+// True if `spec` needs the real hardware, and with it the Pi's network setup
+bool is_hardware_sensor(const std::string& spec);
+
+#endif
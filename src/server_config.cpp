@@ -0,0 +1,348 @@
+#include "server_config.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cerrno>
+#include <algorithm>
+#include "spec_parse.h"
+
+// Trim leading and trailing whitespace
+static std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+// Scale and fleet device ids end up in file names, URLs, JSON and metric labels
+static bool valid_id(const std::string& id) {
+    return !id.empty() && id.size() <= MAX_ID_LENGTH &&
+           id.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") == std::string::npos;
+}
+
+// scale.ID.FIELD
+static bool apply_scale_setting(const std::string& key, const std::string& value, ServerConfig& config) {
+    size_t dot = key.rfind('.');
+    std::string id = key.substr(6, dot > 6 ? dot - 6 : 0);
+    std::string field = key.substr(dot + 1);
+    if (!valid_id(id)) {
+        std::cerr << "Invalid scale id in '" << key << "' (up to " << MAX_ID_LENGTH
+                  << " letters, digits and underscores)" << std::endl;
+        return false;
+    }
+
+    ScaleConfig* scale = nullptr;
+    for (ScaleConfig& existing : config.scales) {
+        if (existing.id == id) scale = &existing;
+    }
+    if (scale == nullptr) {
+        config.scales.push_back(ScaleConfig());
+        scale = &config.scales.back();
+        scale->id = id;
+    }
+
+    if (field == "sensor") {
+        scale->sensor = value;
+    } else if (field == "filter") {
+        scale->filter = value;
+    } else if (field == "outputs") {
+        scale->outputs = value;
+    } else if (field == "calibration") {
+        char* end = nullptr;
+        scale->calibration = strtof(value.c_str(), &end);
+        if (value.empty() || *end != '\0' || !(std::fabs(scale->calibration) < 1e9) ||
+            to_fixed(scale->calibration) == 0) {
+            std::cerr << "Invalid value '" << value << "' for " << key << std::endl;
+            return false;
+        }
+    } else {
+        std::cerr << "Unknown scale setting '" << key << "' (sensor, filter, calibration, outputs)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// fleet.ID=URL, a scale for aggregator mode to subscribe to
+static bool apply_fleet_setting(const std::string& key, const std::string& value, ServerConfig& config) {
+    std::string id = key.substr(6);
+    if (!valid_id(id)) {
+        std::cerr << "Invalid fleet device id in '" << key << "' (up to " << MAX_ID_LENGTH
+                  << " letters, digits and underscores)" << std::endl;
+        return false;
+    }
+    if (value.empty()) {
+        std::cerr << "Missing url for " << key << std::endl;
+        return false;
+    }
+    for (FleetDeviceConfig& existing : config.fleet.devices) {
+        if (existing.id == id) {
+            existing.url = value;
+            return true;
+        }
+    }
+    config.fleet.devices.push_back(FleetDeviceConfig());
+    config.fleet.devices.back().id = id;
+    config.fleet.devices.back().url = value;
+    return true;
+}
+
+// Apply one setting. Keys use underscores; dashes are accepted too so the
+// command line can use --connection-limit.
+static bool apply_setting(std::string key, const std::string& value, ServerConfig& config) {
+    std::replace(key.begin(), key.end(), '-', '_');
+
+    if (key.compare(0, 6, "scale.") == 0) {
+        return apply_scale_setting(key, value, config);
+    }
+    if (key.compare(0, 6, "fleet.") == 0) {
+        return apply_fleet_setting(key, value, config);
+    }
+
+    if (key == "engine") {
+        if (value == "select") config.engine = ENGINE_SELECT;
+        else if (value == "poll") config.engine = ENGINE_POLL;
+        else if (value == "epoll") config.engine = ENGINE_EPOLL;
+        else if (value == "pool" || value == "thread_pool") config.engine = ENGINE_THREAD_POOL;
+        else {
+            std::cerr << "Unknown engine '" << value << "' (select, poll, epoll, pool)" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "filter") {
+        config.filter = value;
+        return true;
+    }
+
+    if (key == "sensor") {
+        config.sensor = value;
+        return true;
+    }
+
+    if (key == "acquisition_cpu") {
+        unsigned cpu = 0;
+        if (value == "any") {
+            config.acquisition_cpu = -1;
+        } else if (parse_unsigned(value, cpu)) {
+            config.acquisition_cpu = static_cast<int>(cpu);
+        } else {
+            std::cerr << "Invalid value '" << value << "' for " << key << " (a CPU number or any)" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (key == "calibration_file") {
+        config.calibration_file = value;
+        return true;
+    }
+
+    if (key == "outputs") {
+        config.outputs = value;
+        return true;
+    }
+
+    if (key == "output_driver") {
+        config.output_driver = value;
+        return true;
+    }
+
+    if (key == "telemetry") {
+        config.telemetry.target = value == "none" ? "" : value;
+        return true;
+    }
+
+    if (key == "telemetry_format") {
+        config.telemetry.format = value;
+        return true;
+    }
+
+    if (key == "telemetry_device") {
+        config.telemetry.device = value;
+        return true;
+    }
+
+    if (key == "wifi_scan_command") {
+        config.wifi_scan_command = value;
+        return true;
+    }
+
+    if (key == "web_root") {
+        config.web_root = value;
+        return true;
+    }
+
+    if (key == "history_file") {
+        config.history_file = value;
+        return true;
+    }
+
+    if (key == "stable_stddev_g") {
+        char* end = nullptr;
+        config.stable_stddev_g = strtod(value.c_str(), &end);
+        if (value.empty() || *end != '\0' || config.stable_stddev_g <= 0) {
+            std::cerr << "Invalid value '" << value << "' for " << key << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    unsigned* target = nullptr;
+    if (key == "port") target = &config.port;
+    else if (key == "threads") target = &config.threads;
+    else if (key == "connection_limit") target = &config.connection_limit;
+    else if (key == "per_ip_limit") target = &config.per_ip_limit;
+    else if (key == "connection_timeout" || key == "timeout") target = &config.connection_timeout;
+    else if (key == "stable_window") target = &config.stable_window;
+    else if (key == "flow_window") target = &config.flow_window;
+    else if (key == "flow_inflight_ms") target = &config.flow_inflight_ms;
+    else if (key == "history_size_mb") target = &config.history_size_mb;
+    else if (key == "history_flush_s") target = &config.history_flush_s;
+    else if (key == "acquisition_priority") target = &config.acquisition_priority;
+    else if (key == "wifi_scan_interval_s") target = &config.wifi_scan_interval_s;
+    else if (key == "telemetry_interval_ms") target = &config.telemetry.interval_ms;
+    else if (key == "telemetry_batch") target = &config.telemetry.batch;
+    else if (key == "telemetry_queue") target = &config.telemetry.queue;
+    else if (key == "telemetry_buffer_kb") target = &config.telemetry.buffer_kb;
+    else if (key == "fleet_stale_ms") target = &config.fleet.stale_ms;
+    else if (key == "fleet_coalesce_ms") target = &config.fleet.coalesce_ms;
+
+    if (target == nullptr) {
+        std::cerr << "Unknown server setting '" << key << "'" << std::endl;
+        return false;
+    }
+    if (!parse_unsigned(value, *target) || (target == &config.acquisition_priority && *target > 99) ||
+        (target == &config.port && (*target == 0 || *target > 65535))) {
+        std::cerr << "Invalid value '" << value << "' for " << key << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool load_server_config(const std::string& path, ServerConfig& config, bool required) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        if (required) {
+            std::cerr << "Cannot read config file " << path << ": " << strerror(errno) << std::endl;
+        }
+        return !required;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            std::cerr << path << ":" << lineNumber << ": expected key=value" << std::endl;
+            return false;
+        }
+        if (!apply_setting(trim(line.substr(0, eq)), trim(line.substr(eq + 1)), config)) {
+            std::cerr << path << ":" << lineNumber << ": invalid setting" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parse_server_args(int argc, char** argv, ServerConfig& config) {
+    std::string configFile = DEFAULT_CONFIG_FILE;
+    bool named = false;  // the default file may be missing, one asked for may not
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--config=", 9) == 0) {
+            configFile = argv[i] + 9;
+            named = true;
+        }
+    }
+    if (!load_server_config(configFile, config, named)) {
+        return false;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            std::cerr << "Unexpected argument '" << arg << "'" << std::endl;
+            return false;
+        }
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos) {
+            std::cerr << "Expected --key=value, got '" << arg << "'" << std::endl;
+            return false;
+        }
+        std::string key = arg.substr(2, eq - 2);
+        if (key == "config") continue;
+        if (!apply_setting(key, arg.substr(eq + 1), config)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<ScaleConfig> configured_scales(const ServerConfig& config) {
+    std::vector<ScaleConfig> scales = config.scales;
+    if (scales.empty()) {
+        scales.push_back(ScaleConfig());
+        scales.back().id = DEFAULT_SCALE_ID;
+        scales.back().outputs = config.outputs;  // pins belong to one scale, so no fallback for scale.* ones
+    }
+    for (ScaleConfig& scale : scales) {
+        if (scale.sensor.empty()) scale.sensor = config.sensor;
+        if (scale.filter.empty()) scale.filter = config.filter;
+    }
+    return scales;
+}
+
+const char* engine_name(ServerEngine engine) {
+    switch (engine) {
+    case ENGINE_SELECT: return "select";
+    case ENGINE_POLL: return "poll";
+    case ENGINE_EPOLL: return "epoll";
+    case ENGINE_THREAD_POOL: return "pool";
+    }
+    return "unknown";
+}
+
+struct MHD_Daemon* start_http_daemon(const ServerConfig& config,
+                                     MHD_AccessHandlerCallback handler, void* handler_cls,
+                                     MHD_NotifyConnectionCallback notify) {
+    // Streaming responses park idle subscribers, which needs suspend/resume
+    unsigned int flags = MHD_ALLOW_SUSPEND_RESUME | MHD_USE_ERROR_LOG;
+    switch (config.engine) {
+    case ENGINE_SELECT: flags |= MHD_USE_SELECT_INTERNALLY; break;
+    case ENGINE_POLL: flags |= MHD_USE_POLL_INTERNAL_THREAD; break;
+    case ENGINE_EPOLL:
+    case ENGINE_THREAD_POOL: flags |= MHD_USE_EPOLL_INTERNAL_THREAD; break;
+    }
+
+    struct MHD_OptionItem options[8];
+    int count = 0;
+    if (config.engine == ENGINE_THREAD_POOL && config.threads > 1) {
+        options[count++] = { MHD_OPTION_THREAD_POOL_SIZE, static_cast<intptr_t>(config.threads), NULL };
+    }
+    if (config.connection_limit > 0) {
+        options[count++] = { MHD_OPTION_CONNECTION_LIMIT, static_cast<intptr_t>(config.connection_limit), NULL };
+    }
+    if (config.per_ip_limit > 0) {
+        options[count++] = { MHD_OPTION_PER_IP_CONNECTION_LIMIT, static_cast<intptr_t>(config.per_ip_limit), NULL };
+    }
+    if (config.connection_timeout > 0) {
+        options[count++] = { MHD_OPTION_CONNECTION_TIMEOUT, static_cast<intptr_t>(config.connection_timeout), NULL };
+    }
+    if (notify != nullptr) {
+        options[count++] = { MHD_OPTION_NOTIFY_CONNECTION, reinterpret_cast<intptr_t>(notify), NULL };
+    }
+    options[count] = { MHD_OPTION_END, 0, NULL };
+
+    return MHD_start_daemon(
+        flags, static_cast<uint16_t>(config.port), NULL, NULL,
+        handler, handler_cls,
+        MHD_OPTION_ARRAY, options,
+        MHD_OPTION_END
+    );
+}
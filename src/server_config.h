@@ -0,0 +1,91 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include <string>
+#include <vector>
+#include <microhttpd.h>
+#include "filters.h"
+#include "stability.h"
+#include "flow_rate.h"
+#include "history_store.h"
+#include "sensor_backend.h"
+#include "static_assets.h"
+#include "calibration_store.h"
+#include "output_rules.h"
+#include "wifi_scanner.h"
+#include "telemetry.h"
+#include "fleet.h"
+
+#define DEFAULT_PORT 8080
+#define DEFAULT_CONFIG_FILE "/opt/fluid_measurement/server.conf"
+#define DEFAULT_CALIBRATION_FACTOR -1100.0f
+#define DEFAULT_SCALE_ID "0"
+#define MAX_ID_LENGTH 32
+
+// How libmicrohttpd drives its sockets
+enum ServerEngine {
+    ENGINE_SELECT,       // one internal thread, select(); capped at FD_SETSIZE
+    ENGINE_POLL,         // one internal thread, poll()
+    ENGINE_EPOLL,        // one internal thread, epoll
+    ENGINE_THREAD_POOL   // `threads` internal threads sharing the listen socket, epoll each
+};
+
+// One load cell, from scale.ID.* settings
+struct ScaleConfig {
+    std::string id;      // up to MAX_ID_LENGTH letters, digits and underscores
+    std::string sensor;  // empty: the top-level sensor setting
+    std::string filter;  // empty: the top-level filter setting
+    std::string outputs; // see build_output_rules()
+    float calibration = DEFAULT_CALIBRATION_FACTOR;  // raw counts per gram
+};
+
+struct ServerConfig {
+    unsigned port = DEFAULT_PORT;
+    ServerEngine engine = ENGINE_EPOLL;
+    unsigned threads = 4;               // only used by ENGINE_THREAD_POOL
+    unsigned connection_limit = 0;      // 0 = libmicrohttpd default
+    unsigned per_ip_limit = 0;          // 0 = unlimited
+    unsigned connection_timeout = 0;    // idle seconds before closing, 0 = never
+    std::string filter = DEFAULT_FILTER_CHAIN;  // see build_filter_chain()
+    unsigned stable_window = DEFAULT_STABLE_WINDOW;    // samples
+    double stable_stddev_g = DEFAULT_STABLE_STDDEV_G;  // settle threshold
+    unsigned flow_window = DEFAULT_FLOW_WINDOW;        // samples in the flow regression
+    unsigned flow_inflight_ms = DEFAULT_FLOW_INFLIGHT_MS;  // fill cutoff lead
+    std::string history_file = DEFAULT_HISTORY_FILE;   // empty disables history
+    unsigned history_size_mb = DEFAULT_HISTORY_SIZE_MB;
+    unsigned history_flush_s = DEFAULT_HISTORY_FLUSH_S;
+    std::string sensor = DEFAULT_SENSOR;  // see create_sensor_backends()
+    std::vector<ScaleConfig> scales;      // in order of first mention
+    unsigned acquisition_priority = 0;    // SCHED_FIFO 1-99 for sampling threads, 0 = normal
+    int acquisition_cpu = -1;             // CPU to pin sampling threads to, -1 = any
+    std::string web_root = DEFAULT_WEB_ROOT;  // dashboard files; empty serves only the API
+    std::string calibration_file = DEFAULT_CALIBRATION_FILE;  // saved tare and calibration
+    std::string outputs;                  // output rules of the single default scale
+    std::string output_driver = DEFAULT_OUTPUT_DRIVER;  // see OutputBank::open()
+    TelemetrySettings telemetry;          // target empty = no publisher
+    std::string wifi_scan_command = DEFAULT_WIFI_SCAN_COMMAND;  // one SSID per line, for the setup portal
+    unsigned wifi_scan_interval_s = DEFAULT_WIFI_SCAN_INTERVAL_S;  // 0 = only when the portal asks
+    FleetSettings fleet;                  // devices configured = aggregator mode, no local scales
+};
+
+// Read key=value lines from `path`. A missing file is an error only if
+// `required`.
+bool load_server_config(const std::string& path, ServerConfig& config, bool required = false);
+
+// Apply --key=value arguments on top of `config`. --config=FILE is read
+// first so the command line always wins over the file.
+bool parse_server_args(int argc, char** argv, ServerConfig& config);
+
+// The scales to run, with defaults filled in: the configured ones, or a
+// single scale DEFAULT_SCALE_ID built from the top-level settings
+std::vector<ScaleConfig> configured_scales(const ServerConfig& config);
+
+const char* engine_name(ServerEngine engine);
+
+// Start a daemon with the configured engine and limits. `notify`, if
+// given, is told about every connection opening and closing.
+struct MHD_Daemon* start_http_daemon(const ServerConfig& config,
+                                     MHD_AccessHandlerCallback handler, void* handler_cls,
+                                     MHD_NotifyConnectionCallback notify = nullptr);
+
+#endif
@@ -0,0 +1,32 @@
+#include "spec_parse.h"
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream ss(text);
+    std::string part;
+    while (std::getline(ss, part, separator)) {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+bool parse_number(const std::string& text, double& out) {
+    char* end = nullptr;
+    out = strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0' && std::isfinite(out);
+}
+
+bool parse_unsigned(const std::string& text, unsigned& out) {
+    if (text.empty() || text[0] < '0' || text[0] > '9') return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long parsed = strtoul(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed > UINT_MAX) return false;
+    out = static_cast<unsigned>(parsed);
+    return true;
+}
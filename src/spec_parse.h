@@ -0,0 +1,20 @@
+#ifndef SPEC_PARSE_H
+#define SPEC_PARSE_H
+
+#include <string>
+#include <vector>
+
+// Pieces of the colon- and comma-separated specs used for sensors,
+// filters and output rules
+
+// Split "a:b:c" on `separator`; empty pieces are kept
+std::vector<std::string> split(const std::string& text, char separator);
+
+// The whole of `text` as a finite number
+bool parse_number(const std::string& text, double& out);
+
+// The whole of `text` as an unsigned int, digits only: strtoul would
+// also take "-1" and " +5", and wrap the former
+bool parse_unsigned(const std::string& text, unsigned& out);
+
+#endif
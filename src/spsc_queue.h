@@ -0,0 +1,65 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. push() never waits: when the queue is full the item is refused
+// and the producer carries on. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) {
+        size_t slots = 2;
+        while (slots < capacity) slots *= 2;
+        items.resize(slots);
+        mask = slots - 1;
+    }
+
+    size_t capacity() const { return items.size(); }
+
+    // Producer only; false if full. *size is set to the items queued after
+    // the push, as the producer sees it.
+    bool push(const T& item, size_t* size = nullptr) {
+        uint64_t head = headIndex.load(std::memory_order_relaxed);
+        uint64_t tail = tailIndex.load(std::memory_order_acquire);
+        if (head - tail == items.size()) {
+            return false;
+        }
+        items[head & mask] = item;
+        headIndex.store(head + 1, std::memory_order_release);
+        if (size != nullptr) *size = head + 1 - tail;
+        return true;
+    }
+
+    // Consumer only: the oldest item, or nullptr if empty. Stays valid
+    // until pop().
+    const T* front() const {
+        uint64_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (headIndex.load(std::memory_order_acquire) == tail) {
+            return nullptr;
+        }
+        return &items[tail & mask];
+    }
+
+    // Consumer only; the queue must not be empty
+    void pop() {
+        tailIndex.store(tailIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Items queued when called; the other thread may change it right after
+    size_t size() const {
+        return headIndex.load(std::memory_order_acquire) - tailIndex.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> items;
+    size_t mask;
+    alignas(64) std::atomic<uint64_t> headIndex{0};  // next slot to write, producer
+    alignas(64) std::atomic<uint64_t> tailIndex{0};  // next slot to read, consumer
+};
+
+#endif
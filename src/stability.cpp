@@ -0,0 +1,54 @@
+#include "stability.h"
+#include <cmath>
+#include <algorithm>
+
+StabilityDetector::StabilityDetector(unsigned w, double t)
+    : window(w < 2 ? 2 : w), threshold(t) {
+    values.reserve(window);
+}
+
+double StabilityDetector::stddev() const {
+    if (values.size() < 2) return 0;
+    return std::sqrt(std::max(m2, 0.0) / values.size());
+}
+
+bool StabilityDetector::update(double x, uint64_t timestamp_us, int64_t wall_ms) {
+    if (motionStartUs == 0) {
+        motionStartUs = timestamp_us;
+    }
+
+    // Sliding-window Welford update
+    if (values.size() < window) {
+        values.push_back(x);
+        double delta = x - mean;
+        mean += delta / values.size();
+        m2 += delta * (x - mean);
+    } else {
+        double old = values[next];
+        values[next] = x;
+        double oldMean = mean;
+        mean += (x - old) / window;
+        m2 += (x - old) * (x - mean + old - oldMean);
+    }
+    next = (next + 1) % window;
+
+    if (values.size() < window) {
+        return false;
+    }
+
+    double sd = stddev();
+    if (isStable) {
+        if (sd > threshold * 1.5) {
+            isStable = false;
+            motionStartUs = timestamp_us;
+        }
+        return false;
+    }
+    if (sd <= threshold) {
+        isStable = true;
+        settledAtMs = wall_ms;
+        settleDurationMs = (timestamp_us - motionStartUs) / 1000.0;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,45 @@
+#ifndef STABILITY_H
+#define STABILITY_H
+
+#include <stdint.h>
+#include <vector>
+
+#define DEFAULT_STABLE_WINDOW 10      // samples
+#define DEFAULT_STABLE_STDDEV_G 0.5   // grams
+
+// Decides when the reading has settled: the standard deviation over the
+// last `window` samples must drop to `threshold` grams. It has to rise
+// past 1.5x the threshold before the reading counts as moving again, so
+// the flag does not flap around the boundary. O(1) per sample.
+class StabilityDetector {
+public:
+    StabilityDetector(unsigned window = DEFAULT_STABLE_WINDOW,
+                      double threshold = DEFAULT_STABLE_STDDEV_G);
+
+    // Feed one filtered sample. Returns true if it made the reading settle.
+    bool update(double weight, uint64_t timestamp_us, int64_t wall_ms);
+
+    bool stable() const { return isStable; }
+    double stddev() const;
+
+    // Wall-clock time of the most recent settle, 0 if never settled
+    int64_t settled_at_ms() const { return settledAtMs; }
+
+    // From when movement was last detected to the settle, -1 if never settled
+    double time_to_settle_ms() const { return settleDurationMs; }
+
+private:
+    unsigned window;
+    double threshold;
+    std::vector<double> values;
+    unsigned next = 0;
+    double mean = 0;
+    double m2 = 0;  // sum of squared deviations from the mean
+
+    bool isStable = false;
+    uint64_t motionStartUs = 0;
+    int64_t settledAtMs = 0;
+    double settleDurationMs = -1;
+};
+
+#endif
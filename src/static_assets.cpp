@@ -0,0 +1,215 @@
+#include "static_assets.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <zlib.h>
+#include <brotli/encode.h>
+
+// Content-Coding of each Encoding, and the ETag suffix telling them apart
+static const char* const contentCodings[] = { nullptr, "gzip", "br" };
+static const char* const etagSuffixes[] = { "", "-gz", "-br" };
+
+static const char* content_type(const std::string& path) {
+    size_t dot = path.rfind('.');
+    std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+    if (ext == "html") return "text/html; charset=utf-8";
+    if (ext == "js") return "text/javascript; charset=utf-8";
+    if (ext == "css") return "text/css; charset=utf-8";
+    if (ext == "json") return "application/json";
+    if (ext == "svg") return "image/svg+xml";
+    if (ext == "png") return "image/png";
+    if (ext == "ico") return "image/x-icon";
+    return "application/octet-stream";
+}
+
+// 64-bit FNV-1a of the file, for ETags that survive restarts
+static uint64_t content_hash(const std::string& data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool gzip_compress(const std::string& in, std::string& out) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 15 + 16: largest window, gzip wrapper
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&stream, in.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream.avail_in = in.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = out.size();
+    int status = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return status == Z_STREAM_END;
+}
+
+static bool brotli_compress(const std::string& in, bool text, std::string& out) {
+    size_t size = BrotliEncoderMaxCompressedSize(in.size());
+    if (size == 0) return false;
+    out.resize(size);
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW,
+                               text ? BROTLI_MODE_TEXT : BROTLI_MODE_GENERIC,
+                               in.size(), reinterpret_cast<const uint8_t*>(in.data()),
+                               &size, reinterpret_cast<uint8_t*>(&out[0]))) {
+        return false;
+    }
+    out.resize(size);
+    return true;
+}
+
+// True if an Accept-Encoding header lists `coding` without refusing it
+// through q=0
+static bool accepts_encoding(const char* header, const char* coding) {
+    size_t length = strlen(coding);
+    const char* p = header;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        const char* token = p;
+        while (*p != '\0' && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+        bool match = static_cast<size_t>(p - token) == length && strncasecmp(token, coding, length) == 0;
+        const char* params = p;
+        while (*p != '\0' && *p != ',') p++;
+        if (!match) continue;
+
+        for (const char* q = params; q + 1 < p; q++) {
+            if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=') {
+                return strtod(q + 2, nullptr) > 0;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+StaticAssets::~StaticAssets() {
+    for (auto& asset : assets) {
+        for (Variant& variant : asset->variants) {
+            if (variant.ok != nullptr) MHD_destroy_response(variant.ok);
+            if (variant.notModified != nullptr) MHD_destroy_response(variant.notModified);
+        }
+    }
+}
+
+bool StaticAssets::load(const std::string& dir, std::string* error) {
+    DIR* listing = opendir(dir.c_str());
+    if (listing == nullptr) {
+        *error = "cannot open " + dir + ": " + strerror(errno);
+        return false;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(listing)) {
+        if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+    }
+    closedir(listing);
+    std::sort(names.begin(), names.end());
+
+    for (const std::string& name : names) {
+        std::string file = dir + "/" + name;
+        struct stat info;
+        if (stat(file.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) continue;
+
+        std::ifstream in(file, std::ios::binary);
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        if (!in) {
+            *error = "cannot read " + file;
+            return false;
+        }
+
+        std::unique_ptr<Asset> asset(new Asset());
+        asset->path = "/" + name;
+        const char* type = content_type(name);
+        Variant* variants = asset->variants;
+        variants[ENCODING_IDENTITY].body = contents.str();
+        const std::string& identity = variants[ENCODING_IDENTITY].body;
+
+        // Only keep an encoding that actually saves bytes
+        if (!identity.empty()) {
+            if (!gzip_compress(identity, variants[ENCODING_GZIP].body) ||
+                variants[ENCODING_GZIP].body.size() >= identity.size()) {
+                variants[ENCODING_GZIP].body.clear();
+            }
+            if (!brotli_compress(identity, strncmp(type, "text/", 5) == 0, variants[ENCODING_BROTLI].body) ||
+                variants[ENCODING_BROTLI].body.size() >= identity.size()) {
+                variants[ENCODING_BROTLI].body.clear();
+            }
+        }
+
+        unsigned long long hash = content_hash(identity);
+        for (int e = 0; e < ENCODINGS; e++) {
+            Variant& variant = variants[e];
+            if (e != ENCODING_IDENTITY && variant.body.empty()) continue;
+
+            snprintf(variant.etag, sizeof(variant.etag), "\"%016llx%s\"", hash, etagSuffixes[e]);
+            variant.ok = MHD_create_response_from_buffer(variant.body.size(), (void*)variant.body.data(),
+                                                         MHD_RESPMEM_PERSISTENT);
+            variant.notModified = MHD_create_response_from_buffer(0, (void*)"", MHD_RESPMEM_PERSISTENT);
+            if (variant.ok == nullptr || variant.notModified == nullptr) {
+                *error = "cannot create response for " + file;
+                assets.push_back(std::move(asset));  // so the destructor frees what was made
+                return false;
+            }
+            MHD_add_response_header(variant.ok, "Content-Type", type);
+            if (contentCodings[e] != nullptr) {
+                MHD_add_response_header(variant.ok, "Content-Encoding", contentCodings[e]);
+            }
+            // Every file is revalidated on every load, the scripts and styles
+            // too: a page from an upgrade must never run against cached
+            // scripts written for the old API. A match costs only a 304.
+            for (struct MHD_Response* response : { variant.ok, variant.notModified }) {
+                MHD_add_response_header(response, "Cache-Control", "no-cache");
+                MHD_add_response_header(response, "ETag", variant.etag);
+                MHD_add_response_header(response, "Vary", "Accept-Encoding");
+            }
+        }
+        assets.push_back(std::move(asset));
+    }
+    return true;
+}
+
+bool StaticAssets::serve(struct MHD_Connection* connection, const char* url, MHD_Result* result) const {
+    if (strcmp(url, "/") == 0) url = "/index.html";
+    const Asset* asset = nullptr;
+    for (const auto& candidate : assets) {
+        if (candidate->path == url) {
+            asset = candidate.get();
+            break;
+        }
+    }
+    if (asset == nullptr) return false;
+
+    // Smallest stored encoding the client takes
+    const Variant* variant = &asset->variants[ENCODING_IDENTITY];
+    const char* acceptEncoding = MHD_lookup_connection_value(connection, MHD_HEADER_KIND,
+                                                             MHD_HTTP_HEADER_ACCEPT_ENCODING);
+    if (acceptEncoding != nullptr) {
+        for (int e = ENCODING_GZIP; e < ENCODINGS; e++) {
+            const Variant& candidate = asset->variants[e];
+            if (candidate.ok != nullptr && candidate.body.size() < variant->body.size() &&
+                accepts_encoding(acceptEncoding, contentCodings[e])) {
+                variant = &candidate;
+            }
+        }
+    }
+
+    const char* ifNoneMatch = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_IF_NONE_MATCH);
+    if (ifNoneMatch != nullptr && strstr(ifNoneMatch, variant->etag) != nullptr) {
+        *result = MHD_queue_response(connection, MHD_HTTP_NOT_MODIFIED, variant->notModified);
+    } else {
+        *result = MHD_queue_response(connection, MHD_HTTP_OK, variant->ok);
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <microhttpd.h>
+
+#define DEFAULT_WEB_ROOT "web"
+
+// The dashboard's files, read once at startup and kept in memory next to
+// their gzip and brotli encodings. Every response (each encoding and its
+// 304) is built up front and queued as is, so serving an asset touches
+// neither the disk nor the allocator. Immutable after load().
+class StaticAssets {
+public:
+    ~StaticAssets();
+
+    // Load every regular file directly inside `dir`. Compression runs here,
+    // at the encoders' highest settings, so this takes a moment.
+    bool load(const std::string& dir, std::string* error);
+
+    size_t count() const { return assets.size(); }
+
+    // Queue `url` ("/" meaning /index.html) in the smallest encoding the
+    // client accepts, or 304 if its If-None-Match names that encoding.
+    // False, with nothing queued, if there is no such asset.
+    bool serve(struct MHD_Connection* connection, const char* url, MHD_Result* result) const;
+
+private:
+    enum Encoding { ENCODING_IDENTITY, ENCODING_GZIP, ENCODING_BROTLI, ENCODINGS };
+
+    struct Variant {
+        std::string body;  // empty: not stored because it is no smaller
+        char etag[32];
+        struct MHD_Response* ok = nullptr;
+        struct MHD_Response* notModified = nullptr;
+    };
+
+    struct Asset {
+        std::string path;  // URL path, e.g. /script.js
+        Variant variants[ENCODINGS];
+    };
+
+    std::vector<std::unique_ptr<Asset>> assets;
+};
+
+#endif
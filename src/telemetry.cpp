@@ -0,0 +1,514 @@
+#include "telemetry.h"
+#include <errno.h>
+#include <stdio.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <iostream>
+#include "clocks.h"
+#include "net_client.h"
+#include "sample_json.h"
+
+// Where frames go. Everything here runs on the publisher thread and must
+// not block; host names are resolved on a thread of their own.
+class TelemetryTransport {
+public:
+    virtual ~TelemetryTransport() {}
+
+    virtual size_t max_frame() const = 0;
+
+    // Socket to poll and the events wanted, -1 for none
+    virtual int fd() const { return -1; }
+    virtual short events() const { return 0; }
+
+    // Handle poll results and timers
+    virtual void service(short revents, int64_t now_ms) {}
+
+    // When service() next needs calling without any event, -1 for never
+    virtual int64_t deadline_ms() const { return -1; }
+
+    // Take a frame, or refuse it if it cannot be sent now
+    virtual bool send(const uint8_t* frame, size_t length, int64_t now_ms) = 0;
+
+    virtual bool connected() const { return true; }
+    virtual uint64_t connects() const { return 0; }
+};
+
+// Datagrams to a unicast or multicast IPv4 address, one frame each
+class UdpTransport : public TelemetryTransport {
+public:
+    ~UdpTransport() {
+        if (sock >= 0) close(sock);
+    }
+
+    bool open(const std::string& host, unsigned port, std::string* error) {
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+            *error = "telemetry: '" + host + "' is not an IPv4 address";
+            return false;
+        }
+        sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sock < 0) {
+            *error = std::string("telemetry: socket: ") + strerror(errno);
+            return false;
+        }
+        if (IN_MULTICAST(ntohl(address.sin_addr.s_addr))) {
+            unsigned char ttl = TELEMETRY_MULTICAST_TTL;
+            unsigned char loop = 1;  // listeners on this box hear it too
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+        }
+        return true;
+    }
+
+    size_t max_frame() const override { return TELEMETRY_UDP_MAX; }
+
+    bool send(const uint8_t* frame, size_t length, int64_t now_ms) override {
+        return sendto(sock, frame, length, MSG_DONTWAIT, reinterpret_cast<const sockaddr*>(&address),
+                      sizeof(address)) == static_cast<ssize_t>(length);
+    }
+
+private:
+    int sock = -1;
+    sockaddr_in address;
+};
+
+// MQTT 3.1.1 client for QoS 0 publishing only: CONNECT, PUBLISH,
+// PINGREQ. Sessions are clean; a lost one is reconnected with backoff.
+// The broker's name is looked up again for every attempt, off the
+// publisher thread, so a hanging resolver only delays the reconnect.
+class MqttTransport : public TelemetryTransport, private ReconnectingClient {
+public:
+    MqttTransport(const std::string& host, unsigned port, const std::string& topic,
+                  const std::string& client_id, size_t buffer_bytes)
+        : ReconnectingClient(host, port, TELEMETRY_CONNECT_TIMEOUT_MS, TELEMETRY_RECONNECT_MAX_S),
+          topic(topic), clientId(client_id), bufferLimit(buffer_bytes) {
+        label = "Telemetry: " + host + ":" + std::to_string(port);
+    }
+
+    size_t max_frame() const override { return bufferLimit - topic.size() - 8; }
+    int fd() const override { return ReconnectingClient::fd(); }
+    short events() const override { return ReconnectingClient::events(); }
+    int64_t deadline_ms() const override { return ReconnectingClient::deadline_ms(); }
+    void service(short revents, int64_t now_ms) override { ReconnectingClient::service(revents, now_ms); }
+
+    bool connected() const override { return isConnected.load(std::memory_order_relaxed); }
+    uint64_t connects() const override { return sessions.load(std::memory_order_relaxed); }
+
+    bool send(const uint8_t* frame, size_t length, int64_t now_ms) override {
+        if (!acked) return false;
+        uint8_t header[8];
+        size_t remaining = 2 + topic.size() + length;
+        size_t headerLength = 0;
+        header[headerLength++] = 0x30;  // PUBLISH, QoS 0
+        do {
+            uint8_t byte = remaining % 128;
+            remaining /= 128;
+            header[headerLength++] = byte | (remaining > 0 ? 0x80 : 0);
+        } while (remaining > 0);
+        header[headerLength++] = static_cast<uint8_t>(topic.size() >> 8);
+        header[headerLength++] = static_cast<uint8_t>(topic.size());
+
+        if (out.size() - outAt + headerLength + topic.size() + length > bufferLimit) {
+            flush(now_ms);
+            if (!acked || out.size() - outAt + headerLength + topic.size() + length > bufferLimit) return false;
+        }
+        append(header, headerLength);
+        append(reinterpret_cast<const uint8_t*>(topic.data()), topic.size());
+        append(frame, length);
+        flush(now_ms);
+        return true;
+    }
+
+private:
+    void opened(int64_t now_ms) override {
+        // Keep the kernel from queueing much more than we would, so a slow
+        // broker shows up as dropped frames rather than growing latency
+        int sendBuffer = static_cast<int>(bufferLimit);
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+        openedMs = now_ms;
+        queue_connect();
+        flush(now_ms);
+    }
+
+    short session_events() const override {
+        return POLLIN | (out.size() > outAt ? POLLOUT : 0);
+    }
+
+    int64_t session_deadline_ms() const override {
+        if (!acked) return openedMs + TELEMETRY_CONNECT_TIMEOUT_MS;
+        return std::min(lastPingMs + TELEMETRY_MQTT_KEEPALIVE_S * 500,
+                        lastReceivedMs + TELEMETRY_MQTT_KEEPALIVE_S * 1500);
+    }
+
+    void session_service(short revents, int64_t now_ms) override {
+        if ((revents & POLLIN) && !receive(now_ms)) return;
+        if (revents & (POLLERR | POLLHUP)) {
+            fail(now_ms, "connection lost");
+            return;
+        }
+        if (revents & POLLOUT) flush(now_ms);
+        if (sock < 0) return;
+        if (!acked && now_ms >= openedMs + TELEMETRY_CONNECT_TIMEOUT_MS) {
+            fail(now_ms, "no CONNACK");
+        } else if (acked && now_ms >= lastReceivedMs + TELEMETRY_MQTT_KEEPALIVE_S * 1500) {
+            fail(now_ms, "broker stopped answering");
+        } else if (acked && now_ms >= lastPingMs + TELEMETRY_MQTT_KEEPALIVE_S * 500) {
+            static const uint8_t ping[] = { 0xc0, 0x00 };
+            if (append(ping, sizeof(ping))) lastPingMs = now_ms;
+            flush(now_ms);
+        }
+    }
+
+    void closed(int64_t now_ms, bool new_error) override {
+        acked = false;
+        isConnected.store(false, std::memory_order_relaxed);
+        out.clear();
+        outAt = 0;
+    }
+
+    void queue_connect() {
+        uint8_t packet[64];
+        size_t idLength = clientId.size();  // within TELEMETRY_MQTT_CLIENT_ID_MAX
+        size_t n = 0;
+        packet[n++] = 0x10;  // CONNECT
+        packet[n++] = static_cast<uint8_t>(10 + 2 + idLength);
+        static const uint8_t variable[] = { 0, 4, 'M', 'Q', 'T', 'T', 4, 0x02,  // level 4, clean session
+                                            0, TELEMETRY_MQTT_KEEPALIVE_S };
+        memcpy(packet + n, variable, sizeof(variable));
+        n += sizeof(variable);
+        packet[n++] = 0;
+        packet[n++] = static_cast<uint8_t>(idLength);
+        memcpy(packet + n, clientId.data(), idLength);
+        n += idLength;
+        out.clear();
+        outAt = 0;
+        append(packet, n);
+    }
+
+    // Read what the broker sent: CONNACK while connecting, then only
+    // PINGRESP, which need no more than proving the session alive
+    bool receive(int64_t now_ms) {
+        uint8_t buf[256];
+        ssize_t n = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            return fail(now_ms, n == 0 ? "closed by the broker" : strerror(errno));
+        }
+        if (n < 0) return true;
+        lastReceivedMs = now_ms;
+        if (!acked) {
+            // Brokers send the 4 bytes in one segment
+            if (n < 4 || buf[0] != 0x20 || buf[3] != 0) {
+                return fail(now_ms, n >= 4 && buf[0] == 0x20 ? "connection refused by the broker" : "bad CONNACK");
+            }
+            acked = true;
+            isConnected.store(true, std::memory_order_relaxed);
+            lastPingMs = now_ms;
+            reset_backoff();
+            sessions.fetch_add(1, std::memory_order_relaxed);
+            std::cout << "Telemetry: connected to " << host << ":" << port << std::endl;
+        }
+        return true;
+    }
+
+    bool append(const uint8_t* data, size_t length) {
+        if (outAt == out.size()) {
+            out.clear();
+            outAt = 0;
+        }
+        if (out.size() - outAt + length > bufferLimit + 64) return false;
+        out.insert(out.end(), data, data + length);
+        return true;
+    }
+
+    void flush(int64_t now_ms) {
+        while (outAt < out.size()) {
+            ssize_t n = ::send(sock, out.data() + outAt, out.size() - outAt, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+                fail(now_ms, strerror(errno));
+                return;
+            }
+            outAt += n;
+        }
+        // Drop what was sent so the buffer does not creep forward forever
+        if (outAt > bufferLimit) {
+            out.erase(out.begin(), out.begin() + outAt);
+            outAt = 0;
+        }
+    }
+
+    std::string topic;
+    std::string clientId;
+    size_t bufferLimit;
+
+    bool acked = false;  // CONNACK received, PUBLISH allowed
+    int64_t openedMs = 0;
+    int64_t lastPingMs = 0;
+    int64_t lastReceivedMs = 0;
+    std::vector<uint8_t> out;  // packets not yet written to the socket
+    size_t outAt = 0;
+    std::atomic<bool> isConnected{false};
+    std::atomic<uint64_t> sessions{0};
+};
+
+// "fluidscale-DEVICE" when that is within the 23 bytes every broker takes.
+// A longer one keeps the start of the name and adds a hash of all of it,
+// so kitchen-scale-1 and kitchen-scale-2 cannot end up sharing an id and
+// knock each other off the broker.
+static std::string mqtt_client_id(const std::string& device) {
+    std::string id = "fluidscale-" + device;
+    if (id.size() <= TELEMETRY_MQTT_CLIENT_ID_MAX) return id;
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (unsigned char c : device) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    char suffix[10];
+    snprintf(suffix, sizeof(suffix), "-%08x", hash);
+    return "fs-" + device.substr(0, TELEMETRY_MQTT_CLIENT_ID_MAX - 3 - 9) + suffix;
+}
+
+TelemetryPublisher::TelemetryPublisher() {}
+
+TelemetryPublisher::~TelemetryPublisher() {
+    stop();
+}
+
+bool TelemetryPublisher::start(const TelemetrySettings& config, std::string* error) {
+    settings = config;
+    if (settings.format == "json") format = TELEMETRY_JSON;
+    else if (settings.format == "binary") format = TELEMETRY_BINARY;
+    else {
+        *error = "unknown telemetry format '" + settings.format + "' (json, binary)";
+        return false;
+    }
+    if (settings.device.empty()) {
+        char name[256] = "";
+        gethostname(name, sizeof(name) - 1);
+        settings.device = name;
+    }
+    if (settings.device.empty() || settings.device.size() > 64 ||
+        settings.device.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.") !=
+            std::string::npos) {
+        *error = "telemetry device '" + settings.device + "' must be 1-64 letters, digits, '-', '_' or '.'";
+        return false;
+    }
+    if (settings.batch == 0 || settings.batch > 65535 || settings.interval_ms == 0 || settings.queue == 0) {
+        *error = "telemetry batch, interval and queue must be positive";
+        return false;
+    }
+
+    std::string address, host;
+    unsigned port = 0;
+    if (settings.target.compare(0, 7, "mqtt://") == 0) {
+        address = settings.target.substr(7);
+        size_t slash = address.find('/');
+        std::string topic = slash != std::string::npos ? address.substr(slash + 1) : "";
+        if (topic.empty()) topic = "fluidscale/" + settings.device + "/telemetry";
+        if (!split_host_port(address.substr(0, slash), DEFAULT_MQTT_PORT, host, port) || topic.size() > 1024) {
+            *error = "invalid telemetry target '" + settings.target + "'";
+            return false;
+        }
+        size_t buffer = std::max<size_t>(settings.buffer_kb, 4) * 1024;
+        std::string clientId = mqtt_client_id(settings.device);
+        transport.reset(new MqttTransport(host, port, topic, clientId, buffer));
+        summary = "mqtt://" + host + ":" + std::to_string(port) + "/" + topic + " as " + clientId;
+    } else if (settings.target.compare(0, 6, "udp://") == 0) {
+        UdpTransport* udp = new UdpTransport;
+        transport.reset(udp);
+        if (!split_host_port(settings.target.substr(6), 0, host, port)) {
+            *error = "invalid telemetry target '" + settings.target + "' (udp://ADDRESS:PORT)";
+            transport.reset();
+            return false;
+        }
+        if (!udp->open(host, port, error)) {
+            transport.reset();
+            return false;
+        }
+        summary = "udp://" + host + ":" + std::to_string(port);
+    } else {
+        *error = "invalid telemetry target '" + settings.target + "' (mqtt://HOST[:PORT]/TOPIC or udp://ADDRESS:PORT)";
+        return false;
+    }
+    summary += ", " + settings.format + ", " + std::to_string(settings.batch) + " samples or " +
+               std::to_string(settings.interval_ms) + " ms per frame";
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        *error = std::string("telemetry: eventfd: ") + strerror(errno);
+        transport.reset();
+        return false;
+    }
+    queue.reset(new SpscQueue<Queued>(settings.queue));
+    stopping = false;
+    worker = std::thread(&TelemetryPublisher::run, this);
+    return true;
+}
+
+void TelemetryPublisher::stop() {
+    if (!worker.joinable()) return;
+    stopping = true;
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        // the publisher still sees `stopping` within its interval
+    }
+    worker.join();
+    close(wakeFd);
+    wakeFd = -1;
+    transport.reset();
+    queue.reset();
+}
+
+void TelemetryPublisher::offer(const Sample& sample, unsigned scale) {
+    size_t size = 0;
+    if (!queue->push(Queued{sample, scale}, &size)) {
+        droppedQueue.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // Wake the publisher to start the interval, and when a frame is full
+    if (size == 1 || size == settings.batch) {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            // already signalled and not yet read
+        }
+    }
+}
+
+TelemetryStats TelemetryPublisher::stats() const {
+    TelemetryStats stats;
+    stats.sent = sent.load(std::memory_order_relaxed);
+    stats.dropped_queue = droppedQueue.load(std::memory_order_relaxed);
+    stats.dropped_network = droppedNetwork.load(std::memory_order_relaxed);
+    stats.frames = frames.load(std::memory_order_relaxed);
+    if (transport != nullptr) {
+        stats.connects = transport->connects();
+        stats.connected = transport->connected();
+    }
+    return stats;
+}
+
+static void put_le(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+static int32_t milli(fixed_t value) {
+    int64_t scaled = div_round(value * 1000, FIXED_ONE);
+    return static_cast<int32_t>(std::max<int64_t>(std::min<int64_t>(scaled, INT32_MAX), INT32_MIN));
+}
+
+// Move up to `batch` queued samples into `frame`, keeping it within
+// `max_bytes` (but always taking at least one). Returns the samples taken.
+size_t TelemetryPublisher::encode_frame(std::vector<uint8_t>& frame, size_t max_bytes) {
+    const Queued* item = queue->front();
+    if (item == nullptr) return 0;
+    size_t count = 0;
+    frameSeq++;
+
+    if (format == TELEMETRY_BINARY) {
+        frame.push_back('F');
+        frame.push_back('T');
+        frame.push_back(1);
+        frame.push_back(static_cast<uint8_t>(settings.device.size()));
+        frame.insert(frame.end(), settings.device.begin(), settings.device.end());
+        put_le(frame, frameSeq, 4);
+        size_t countAt = frame.size();
+        put_le(frame, 0, 2);
+        int64_t base = item->sample.wall_ms;
+        put_le(frame, static_cast<uint64_t>(base), 8);
+        for (; item != nullptr && count < settings.batch; item = queue->front()) {
+            if (count > 0 && frame.size() + 18 > max_bytes) break;
+            const Sample& s = item->sample;
+            frame.push_back(static_cast<uint8_t>(item->scale));
+            frame.push_back(s.stable ? 1 : 0);
+            put_le(frame, static_cast<uint32_t>(std::max<int64_t>(s.wall_ms - base, 0)), 4);
+            put_le(frame, static_cast<uint32_t>(milli(s.weight_g)), 4);
+            put_le(frame, static_cast<uint32_t>(milli(s.net_g)), 4);
+            put_le(frame, static_cast<uint32_t>(milli(s.flow_gps)), 4);
+            queue->pop();
+            count++;
+        }
+        frame[countAt] = static_cast<uint8_t>(count);
+        frame[countAt + 1] = static_cast<uint8_t>(count >> 8);
+        return count;
+    }
+
+    std::string header = "{\"device\":\"" + settings.device + "\",\"seq\":" + std::to_string(frameSeq) +
+                         ",\"fields\":" TELEMETRY_JSON_FIELDS ",\"samples\":[";
+    frame.insert(frame.end(), header.begin(), header.end());
+    char row[256];
+    for (; item != nullptr && count < settings.batch; item = queue->front()) {
+        const std::string& id = item->scale < settings.scale_ids.size() ? settings.scale_ids[item->scale] : "";
+        size_t length = render_telemetry_row(id.c_str(), item->sample, row, sizeof(row));
+        if (count > 0 && frame.size() + 1 + length + 2 > max_bytes) break;
+        if (count > 0) frame.push_back(',');
+        frame.insert(frame.end(), row, row + length);
+        queue->pop();
+        count++;
+    }
+    frame.push_back(']');
+    frame.push_back('}');
+    return count;
+}
+
+void TelemetryPublisher::run() {
+    std::vector<uint8_t> frame;
+    frame.reserve(transport->max_frame() + 256);
+    int64_t waitingSinceMs = -1;  // when the oldest unsent sample was first seen
+    short revents = 0;
+
+    while (!stopping) {
+        int64_t now = monotonic_ms();
+        transport->service(revents, now);
+
+        size_t queued = queue->size();
+        if (queued > 0 && waitingSinceMs < 0) waitingSinceMs = now;
+        bool intervalDue = queued > 0 && now - waitingSinceMs >= settings.interval_ms;
+        while (queue->size() >= settings.batch || (intervalDue && queue->size() > 0)) {
+            frame.clear();
+            size_t count = encode_frame(frame, transport->max_frame());
+            if (transport->send(frame.data(), frame.size(), now)) {
+                sent.fetch_add(count, std::memory_order_relaxed);
+                frames.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                droppedNetwork.fetch_add(count, std::memory_order_relaxed);
+            }
+        }
+        if (queue->size() == 0) waitingSinceMs = -1;
+        else if (intervalDue) waitingSinceMs = now;
+
+        // Sleep until the interval runs out, the transport has work, or
+        // measurement_thread queues the first sample or fills a frame
+        int64_t wake = waitingSinceMs >= 0 ? waitingSinceMs + settings.interval_ms : -1;
+        int64_t deadline = transport->deadline_ms();
+        if (deadline >= 0 && (wake < 0 || deadline < wake)) wake = deadline;
+        int timeout = wake < 0 ? -1 : static_cast<int>(std::max<int64_t>(wake - monotonic_ms(), 0));
+
+        pollfd fds[2];
+        fds[0].fd = wakeFd;
+        fds[0].events = POLLIN;
+        fds[1].fd = transport->fd();
+        fds[1].events = transport->events();
+        int nfds = fds[1].fd >= 0 && fds[1].events != 0 ? 2 : 1;
+        fds[1].revents = 0;
+        if (poll(fds, nfds, timeout) < 0 && errno != EINTR) {
+            std::cerr << "Telemetry: poll: " << strerror(errno) << std::endl;
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint64_t count;
+            if (read(wakeFd, &count, sizeof(count)) < 0) {
+                // raced with another read; nothing to do
+            }
+        }
+        revents = nfds == 2 ? fds[1].revents : 0;
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sample_ring.h"
+#include "spsc_queue.h"
+
+#define DEFAULT_TELEMETRY_FORMAT "json"
+#define DEFAULT_TELEMETRY_INTERVAL_MS 1000  // longest a sample waits for its frame
+#define DEFAULT_TELEMETRY_BATCH 50          // samples per frame, at most
+#define DEFAULT_TELEMETRY_QUEUE 1024        // samples waiting for the publisher
+#define DEFAULT_TELEMETRY_BUFFER_KB 64      // frames waiting for a slow broker
+#define DEFAULT_MQTT_PORT 1883
+#define TELEMETRY_UDP_MAX 1400              // payload that crosses Ethernet unfragmented
+#define TELEMETRY_MULTICAST_TTL 1           // stay on the local network
+#define TELEMETRY_MQTT_KEEPALIVE_S 30
+#define TELEMETRY_MQTT_CLIENT_ID_MAX 23     // the longest client id every broker takes
+#define TELEMETRY_CONNECT_TIMEOUT_MS 5000
+#define TELEMETRY_RECONNECT_MAX_S 30        // backoff doubles from 1 s up to this
+#define TELEMETRY_JSON_FIELDS "[\"scale\",\"timestamp_ms\",\"measured_weight_g\",\"fluid_weight_g\",\"flow_rate_g_s\",\"stable\"]"
+
+// Frame encodings
+//
+// json:   {"device": "HOST", "seq": N, "fields": TELEMETRY_JSON_FIELDS,
+//          "samples": [["ID", ms, g, g, g/s, bool], ...]}
+//
+// binary: little-endian; "FT", version 1, device name length, the name,
+//         uint32 seq, uint16 sample count, int64 timestamp_ms of the first
+//         sample, then per sample 18 bytes: uint8 scale index (in the
+//         order scales are configured), uint8 flags (1 = stable),
+//         uint32 ms after the first sample, int32 measured mg, int32
+//         fluid mg, int32 flow mg/s
+enum TelemetryFormat {
+    TELEMETRY_JSON,
+    TELEMETRY_BINARY
+};
+
+struct TelemetrySettings {
+    std::string target;  // mqtt://HOST[:PORT]/TOPIC or udp://ADDRESS:PORT
+    std::string format = DEFAULT_TELEMETRY_FORMAT;
+    std::string device;  // empty: the host name
+    unsigned interval_ms = DEFAULT_TELEMETRY_INTERVAL_MS;
+    unsigned batch = DEFAULT_TELEMETRY_BATCH;
+    unsigned queue = DEFAULT_TELEMETRY_QUEUE;
+    unsigned buffer_kb = DEFAULT_TELEMETRY_BUFFER_KB;
+    std::vector<std::string> scale_ids;  // by scale index
+};
+
+struct TelemetryStats {
+    uint64_t sent = 0;             // samples in frames handed to the network
+    uint64_t dropped_queue = 0;    // samples refused because the publisher fell behind
+    uint64_t dropped_network = 0;  // samples in frames the network could not take
+    uint64_t frames = 0;
+    uint64_t connects = 0;         // MQTT sessions established
+    bool connected = false;        // MQTT: a session is up; UDP: always
+};
+
+class TelemetryTransport;
+
+// Pushes every processed sample to a SCADA collector, batched into frames
+// of up to `batch` samples sent at least every `interval_ms`, over MQTT
+// (QoS 0) to a broker or as UDP datagrams, multicast or not.
+//
+// measurement_thread hands samples over through a lock-free queue and
+// never waits: when the queue is full the sample is dropped and counted.
+// The publisher thread does all encoding and network I/O. A broker that
+// reads slowly fills a bounded send buffer, after which whole frames are
+// dropped; a lost connection is retried with backoff while frames keep
+// being dropped, so the queue never backs up into the sampler.
+class TelemetryPublisher {
+public:
+    TelemetryPublisher();
+    ~TelemetryPublisher();
+
+    bool start(const TelemetrySettings& settings, std::string* error);
+    void stop();
+    bool running() const { return transport != nullptr; }
+
+    // measurement_thread only; never blocks
+    void offer(const Sample& sample, unsigned scale);
+
+    TelemetryStats stats() const;
+    const std::string& description() const { return summary; }
+
+private:
+    struct Queued {
+        Sample sample;
+        unsigned scale;
+    };
+
+    void run();
+    size_t encode_frame(std::vector<uint8_t>& frame, size_t max_bytes);
+
+    TelemetrySettings settings;
+    TelemetryFormat format = TELEMETRY_JSON;
+    std::string summary;
+    std::unique_ptr<SpscQueue<Queued>> queue;
+    std::unique_ptr<TelemetryTransport> transport;
+    int wakeFd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+    uint32_t frameSeq = 0;
+
+    std::atomic<uint64_t> droppedQueue{0};
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> droppedNetwork{0};
+    std::atomic<uint64_t> frames{0};
+};
+
+#endif
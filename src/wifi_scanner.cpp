@@ -0,0 +1,139 @@
+#include "wifi_scanner.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include "clocks.h"
+
+// iwlist shows hidden networks as an empty ESSID or a run of \x00
+static bool hidden_ssid(const std::string& ssid) {
+    if (ssid.size() % 4 != 0) return false;
+    for (size_t i = 0; i < ssid.size(); i += 4) {
+        if (ssid.compare(i, 4, "\\x00") != 0) return false;
+    }
+    return true;
+}
+
+bool run_wifi_scan(const std::string& command, std::vector<std::string>& networks, std::string* error) {
+    networks.clear();
+    FILE* pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr) {
+        *error = std::string("cannot run scan command: ") + strerror(errno);
+        return false;
+    }
+
+    char line[512];
+    std::string ssid;
+    while (fgets(line, sizeof(line), pipe) != nullptr) {
+        ssid += line;
+        if (ssid.empty() || ssid.back() != '\n') {
+            if (!feof(pipe)) continue;  // longer than the buffer, keep reading
+        }
+        while (!ssid.empty() && (ssid.back() == '\n' || ssid.back() == '\r')) ssid.pop_back();
+
+        if (!hidden_ssid(ssid) && ssid.size() <= WIFI_SSID_MAX && networks.size() < WIFI_SCAN_MAX_NETWORKS &&
+            std::find(networks.begin(), networks.end(), ssid) == networks.end()) {
+            networks.push_back(ssid);
+        }
+        ssid.clear();
+    }
+
+    int status = pclose(pipe);
+    if (status == -1) {
+        *error = std::string("scan command failed: ") + strerror(errno);
+        return false;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        *error = WIFEXITED(status) ? "scan command exited with status " + std::to_string(WEXITSTATUS(status))
+                                   : "scan command was killed";
+        return false;
+    }
+    return true;
+}
+
+WifiScanner::WifiScanner(const std::string& c, unsigned interval_s) : command(c), intervalS(interval_s) {}
+
+WifiScanner::~WifiScanner() {
+    stop();
+}
+
+void WifiScanner::start() {
+    if (worker.joinable()) return;
+    stopping = false;
+    requested = true;  // first scan right away
+    worker = std::thread(&WifiScanner::run, this);
+}
+
+void WifiScanner::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void WifiScanner::request_scan() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requested = true;
+    }
+    wakeup.notify_all();
+}
+
+WifiScanResult WifiScanner::result() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    WifiScanResult result;
+    result.networks = networks;
+    result.age_ms = scannedAtMs < 0 ? -1 : monotonic_ms() - scannedAtMs;
+    result.scanning = scanning || requested;
+    result.error = lastError;
+    return result;
+}
+
+void WifiScanner::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    int64_t lastStartMs = -1;
+    while (!stopping) {
+        int64_t now = monotonic_ms();
+        int64_t dueMs = INT64_MAX;
+        if (requested) {
+            dueMs = lastStartMs < 0 ? now : lastStartMs + WIFI_SCAN_MIN_GAP_S * 1000;
+        }
+        if (intervalS > 0 && lastStartMs >= 0) {
+            dueMs = std::min<int64_t>(dueMs, lastStartMs + static_cast<int64_t>(intervalS) * 1000);
+        }
+
+        if (dueMs > now) {
+            if (dueMs == INT64_MAX) {
+                wakeup.wait(lock);
+            } else {
+                wakeup.wait_for(lock, std::chrono::milliseconds(dueMs - now));
+            }
+            continue;
+        }
+
+        requested = false;
+        scanning = true;
+        lastStartMs = now;
+        lock.unlock();
+
+        std::vector<std::string> found;
+        std::string error;
+        bool ok = run_wifi_scan(command, found, &error);
+
+        lock.lock();
+        scanning = false;
+        if (ok) {
+            networks.swap(found);
+            scannedAtMs = monotonic_ms();
+            lastError.clear();
+        } else {
+            // Keep the last good list, a failed scan says nothing about what is in range
+            lastError = error;
+            fprintf(stderr, "Wi-Fi scan: %s\n", error.c_str());
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef WIFI_SCANNER_H
+#define WIFI_SCANNER_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Prints one SSID per line. Hidden networks come out empty and are skipped.
+#define DEFAULT_WIFI_SCAN_COMMAND "iwlist wlan0 scan 2>/dev/null | sed -n 's/^ *ESSID:\"\\(.*\\)\"$/\\1/p'"
+#define DEFAULT_WIFI_SCAN_INTERVAL_S 30
+#define WIFI_SCAN_MIN_GAP_S 5         // on-demand scans wait this long after the last one
+#define WIFI_SCAN_MAX_NETWORKS 64
+#define WIFI_SSID_MAX 128             // iwlist escapes bytes, so allow more than 32
+
+// What the last scan found
+struct WifiScanResult {
+    std::vector<std::string> networks;  // in the order the command listed them, no duplicates
+    int64_t age_ms = -1;                // since the last successful scan, -1 before the first
+    bool scanning = false;              // a scan is running or due
+    std::string error;                  // why the last scan failed, empty if it did not
+};
+
+// Runs a scan command on a worker thread, right away, every `interval_s`
+// seconds and whenever request_scan() asks, and keeps what it printed.
+// Readers get the cached list at once, however long a scan takes. The
+// command runs through popen(), so any shell pipeline works, including a
+// fake one for testing (scripts/fake_wifi_scan.sh).
+class WifiScanner {
+public:
+    explicit WifiScanner(const std::string& command = DEFAULT_WIFI_SCAN_COMMAND,
+                         unsigned interval_s = DEFAULT_WIFI_SCAN_INTERVAL_S);
+    ~WifiScanner();
+
+    void start();
+
+    // Waits for a running scan to finish
+    void stop();
+
+    // Scan as soon as WIFI_SCAN_MIN_GAP_S has passed since the last one
+    void request_scan();
+
+    WifiScanResult result() const;
+
+private:
+    void run();
+
+    std::string command;
+    unsigned intervalS;  // 0: only on request
+    std::thread worker;
+
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+    bool requested = false;
+    bool scanning = false;
+    std::vector<std::string> networks;
+    int64_t scannedAtMs = -1;  // monotonic
+    std::string lastError;
+};
+
+// Run `command` and collect the SSIDs it prints; false and *error if it
+// cannot be started or exits with an error
+bool run_wifi_scan(const std::string& command, std::vector<std::string>& networks, std::string* error);
+
+#endif
@@ -7,6 +7,9 @@
 #include <unistd.h>
 #include <microhttpd.h>
 #include <cstring>  // Added for strcmp function
+#include <cstdio>
+#include "sample_json.h"
+#include "wifi_scanner.h"
 
 #define SETUP_PORT 80
 
@@ -32,6 +35,39 @@ bool is_wifi_configured() {
     return false;
 }
 
+// Escape text for an HTML attribute or element
+static std::string html_escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        switch (c) {
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '"': out += "&quot;"; break;
+        case '\'': out += "&#39;"; break;
+        default: out += c;
+        }
+    }
+    return out;
+}
+
+// Body of /api/networks
+static std::string networks_json(const WifiScanResult& scan) {
+    std::string json = "{\"networks\":[";
+    for (size_t i = 0; i < scan.networks.size(); i++) {
+        if (i > 0) json += ",";
+        append_json_string(json, scan.networks[i]);
+    }
+    json += "],\"age_s\":";
+    json += scan.age_ms < 0 ? "null" : std::to_string(scan.age_ms / 1000);
+    json += ",\"scanning\":";
+    json += scan.scanning ? "true" : "false";
+    json += ",\"error\":";
+    json += scan.error.empty() ? "null" : json_string(scan.error);
+    json += "}";
+    return json;
+}
+
 // POST request iterator callback
 static int iterate_post(void *cls, enum MHD_ValueKind kind, 
                         const char *key, const char *filename, 
@@ -60,6 +96,7 @@ static MHD_Result handle_setup_request(void *cls, struct MHD_Connection *connect
         return MHD_YES;
     }
     
+    WifiScanner *scanner = static_cast<WifiScanner*>(cls);
     struct ConnectionInfo *info = static_cast<ConnectionInfo*>(*con_cls);
     struct MHD_Response *response;
     MHD_Result ret;  // Changed from int to MHD_Result
@@ -137,19 +174,26 @@ static MHD_Result handle_setup_request(void *cls, struct MHD_Connection *connect
         }
     }
     
+    // Scan results for the page to refresh from; ?rescan=1 asks for a new scan
+    if (0 == strcmp(method, "GET") && 0 == strcmp(url, "/api/networks")) {
+        const char* rescan = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "rescan");
+        if (rescan != NULL && 0 == strcmp(rescan, "1")) {
+            scanner->request_scan();
+        }
+        std::string json = networks_json(scanner->result());
+        response = MHD_create_response_from_buffer(json.length(), (void*)json.c_str(), MHD_RESPMEM_MUST_COPY);
+        MHD_add_response_header(response, "Content-Type", "application/json");
+        MHD_add_response_header(response, "Cache-Control", "no-store");
+        ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+        MHD_destroy_response(response);
+        return ret;
+    }
+
     // GET request - Serve setup page
     if (0 == strcmp(method, "GET") && (0 == strcmp(url, "/") || 0 == strcmp(url, "/setup"))) {
-        // Scan for Wi-Fi networks
-        system("iwlist wlan0 scan | grep ESSID | awk -F':' '{print $2}' | sed 's/\"//g' > /tmp/wifi_networks");
-        std::ifstream wifiScan("/tmp/wifi_networks");
-        std::string line;
-        std::vector<std::string> networks;
-        
-        while (std::getline(wifiScan, line)) {
-            if (!line.empty()) {
-                networks.push_back(line);
-            }
-        }
+        // Networks from the last background scan; the page polls
+        // /api/networks for newer ones rather than waiting on a scan here
+        WifiScanResult scan = scanner->result();
         
         // Create setup page HTML
         std::string setup_page = "<html><head><title>Fluid Scale Wi-Fi Setup</title>"
@@ -162,6 +206,8 @@ static MHD_Result handle_setup_request(void *cls, struct MHD_Connection *connect
                               "select, input { width: 100%; padding: 12px; margin-bottom: 20px; border: 1px solid #d2d2d7; border-radius: 8px; font-size: 16px; }"
                               "button { background: #0071e3; color: white; border: none; padding: 12px 0; width: 100%; font-size: 16px; border-radius: 8px; cursor: pointer; }"
                               "button:hover { background: #0062c3; }"
+                              "#rescan { background: none; color: #0071e3; padding: 0; width: auto; font-size: 14px; margin: -12px 0 20px; }"
+                              "#scan-status { color: #86868b; font-size: 14px; margin-left: 8px; }"
                               "</style></head>"
                               "<body>"
                               "<h1>Fluid Scale<br>Wi-Fi Setup</h1>"
@@ -170,13 +216,18 @@ static MHD_Result handle_setup_request(void *cls, struct MHD_Connection *connect
                               "<select name=\"ssid\" id=\"ssid\">";
         
         // Add network options
-        for (const auto& network : networks) {
-            setup_page += "<option value=\"" + network + "\">" + network + "</option>";
+        for (const auto& network : scan.networks) {
+            std::string escaped = html_escape(network);
+            setup_page += "<option value=\"" + escaped + "\">" + escaped + "</option>";
         }
         
         // Add manual entry option
         setup_page += "<option value=\"manual\">Enter manually...</option>"
                       "</select>"
+                      "<button type=\"button\" id=\"rescan\">Scan again</button>"
+                      "<span id=\"scan-status\">";
+        setup_page += scan.scanning ? "Scanning..." : "";
+        setup_page += "</span>"
                       "<div id=\"manual-ssid\" style=\"display:none;\">"
                       "<label for=\"manual-ssid-input\">Network Name (SSID):</label>"
                       "<input type=\"text\" id=\"manual-ssid-input\" name=\"manual-ssid\">"
@@ -186,7 +237,9 @@ static MHD_Result handle_setup_request(void *cls, struct MHD_Connection *connect
                       "<button type=\"submit\">Connect</button>"
                       "</form>"
                       "<script>"
-                      "document.getElementById('ssid').addEventListener('change', function() {"
+                      "var select = document.getElementById('ssid');"
+                      "var status = document.getElementById('scan-status');"
+                      "select.addEventListener('change', function() {"
                       "  var manualDiv = document.getElementById('manual-ssid');"
                       "  if (this.value === 'manual') {"
                       "    manualDiv.style.display = 'block';"
@@ -194,6 +247,32 @@ static MHD_Result handle_setup_request(void *cls, struct MHD_Connection *connect
                       "    manualDiv.style.display = 'none';"
                       "  }"
                       "});"
+                      // Rebuild the options from a scan, keeping the selection
+                      "function showNetworks(scan) {"
+                      "  var selected = select.value;"
+                      "  while (select.options.length > 1) select.remove(0);"
+                      "  scan.networks.forEach(function(name) {"
+                      "    select.add(new Option(name, name), select.options[select.options.length - 1]);"
+                      "  });"
+                      "  select.value = selected;"
+                      "  if (select.selectedIndex < 0) select.selectedIndex = 0;"
+                      "  status.textContent = scan.scanning ? 'Scanning...' : scan.error ? 'Scan failed' : '';"
+                      "}"
+                      // Poll quickly while a scan runs, slowly otherwise
+                      "var timer;"
+                      "function refresh(rescan) {"
+                      "  clearTimeout(timer);"
+                      "  fetch('/api/networks' + (rescan ? '?rescan=1' : '')).then(function(r) { return r.json(); })"
+                      "    .then(function(scan) {"
+                      "      showNetworks(scan);"
+                      "      timer = setTimeout(refresh, scan.scanning || rescan ? 3000 : 15000);"
+                      "    }, function() { timer = setTimeout(refresh, 15000); });"
+                      "}"
+                      "document.getElementById('rescan').addEventListener('click', function() {"
+                      "  status.textContent = 'Scanning...';"
+                      "  refresh(true);"
+                      "});"
+                      "refresh(false);"
                       "</script>"
                       "</body></html>";
         
@@ -225,7 +304,7 @@ static void request_completed(void *cls, struct MHD_Connection *connection,
 }
 
 // Start access point mode for WiFi setup
-void start_ap_mode() {
+void start_ap_mode(const std::string& scanCommand, unsigned scanIntervalS) {
     std::cout << "Setting up access point mode for WiFi configuration..." << std::endl;
     
     // Create hostapd configuration
@@ -266,10 +345,14 @@ void start_ap_mode() {
     std::cout << "Access point started. SSID: FluidScale-Setup, Password: fluidscale" << std::endl;
     std::cout << "Starting web server for setup..." << std::endl;
     
+    // Scan from the start so the first page already lists networks
+    WifiScanner scanner(scanCommand, scanIntervalS);
+    scanner.start();
+    
     // Start web server for setup with proper type casting
     struct MHD_Daemon *daemon = MHD_start_daemon(
         MHD_USE_SELECT_INTERNALLY, SETUP_PORT, NULL, NULL,
-        reinterpret_cast<MHD_AccessHandlerCallback>(handle_setup_request), NULL, 
+        reinterpret_cast<MHD_AccessHandlerCallback>(handle_setup_request), &scanner, 
         MHD_OPTION_NOTIFY_COMPLETED, request_completed, NULL,
         MHD_OPTION_END
     );
@@ -290,6 +373,7 @@ void start_ap_mode() {
     std::cout << "Wi-Fi configuration complete. Stopping setup mode..." << std::endl;
     
     MHD_stop_daemon(daemon);
+    scanner.stop();
     
     // Stop AP services
     system("systemctl stop hostapd");
@@ -1,10 +1,14 @@
 #ifndef WIFI_SETUP_H
 #define WIFI_SETUP_H
 
+#include <string>
+
 // Function to check if WiFi is configured
 bool is_wifi_configured();
 
-// Function to start access point setup mode
-void start_ap_mode();
+// Function to start access point setup mode. The setup page lists the
+// networks `scanCommand` prints, rescanned every `scanIntervalS` seconds
+// and on request (see WifiScanner).
+void start_ap_mode(const std::string& scanCommand, unsigned scanIntervalS);
 
 #endif
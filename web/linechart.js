@@ -0,0 +1,115 @@
+// Minimal filled line chart on a canvas, standing in for the small part
+// of Chart.js the dashboard used. Served by the scale itself, so the page
+// needs nothing from the internet.
+//
+//   const chart = new LineChart(canvas, { color: '#2d7ceb', fill: 'rgba(45, 124, 235, 0.1)' });
+//   chart.data = [1, 2, null, 3];  // nulls leave gaps
+//   chart.update();
+class LineChart {
+    constructor(canvas, options = {}) {
+        this.canvas = canvas;
+        this.context = canvas.getContext('2d');
+        this.color = options.color || '#2d7ceb';
+        this.fill = options.fill || 'rgba(45, 124, 235, 0.1)';
+        this.lineWidth = options.lineWidth || 2;
+        this.tension = options.tension === undefined ? 0.4 : options.tension;
+        this.beginAtZero = options.beginAtZero !== false;
+        this.data = [];
+
+        // Follow the parent's size, as Chart.js did with responsive: true
+        if (window.ResizeObserver) {
+            new ResizeObserver(() => this.update()).observe(canvas.parentElement);
+        } else {
+            window.addEventListener('resize', () => this.update());
+        }
+        this.update();
+    }
+
+    // Size the backing store to the displayed size and redraw
+    update() {
+        const parent = this.canvas.parentElement;
+        const style = getComputedStyle(parent);
+        const width = parent.clientWidth - parseFloat(style.paddingLeft) - parseFloat(style.paddingRight);
+        const height = parent.clientHeight - parseFloat(style.paddingTop) - parseFloat(style.paddingBottom);
+        const ratio = window.devicePixelRatio || 1;
+        if (width <= 0 || height <= 0) return;
+
+        this.canvas.style.width = `${width}px`;
+        this.canvas.style.height = `${height}px`;
+        if (this.canvas.width !== Math.round(width * ratio) || this.canvas.height !== Math.round(height * ratio)) {
+            this.canvas.width = Math.round(width * ratio);
+            this.canvas.height = Math.round(height * ratio);
+        }
+        this.context.setTransform(ratio, 0, 0, ratio, 0, 0);
+        this.draw(width, height);
+    }
+
+    draw(width, height) {
+        const ctx = this.context;
+        ctx.clearRect(0, 0, width, height);
+
+        const values = this.data.filter((v) => v !== null && v !== undefined && isFinite(v));
+        if (values.length === 0) return;
+        let min = Math.min(...values);
+        let max = Math.max(...values);
+        if (this.beginAtZero) {
+            min = Math.min(min, 0);
+            max = Math.max(max, 0);
+        }
+        if (max === min) {
+            max += 1;
+        }
+
+        // Keep the line clear of the edges
+        const inset = this.lineWidth;
+        const step = this.data.length > 1 ? (width - 2 * inset) / (this.data.length - 1) : 0;
+        const x = (i) => inset + i * step;
+        const y = (v) => inset + (height - 2 * inset) * (1 - (v - min) / (max - min));
+        const baseline = y(Math.max(min, Math.min(0, max)));
+
+        // Runs of consecutive values, each drawn as its own curve
+        const runs = [];
+        let run = [];
+        this.data.forEach((v, i) => {
+            if (v === null || v === undefined || !isFinite(v)) {
+                if (run.length) runs.push(run);
+                run = [];
+            } else {
+                run.push([x(i), y(v)]);
+            }
+        });
+        if (run.length) runs.push(run);
+
+        for (const points of runs) {
+            ctx.beginPath();
+            this.trace(points);
+            ctx.strokeStyle = this.color;
+            ctx.lineWidth = this.lineWidth;
+            ctx.lineJoin = 'round';
+            ctx.stroke();
+
+            ctx.lineTo(points[points.length - 1][0], baseline);
+            ctx.lineTo(points[0][0], baseline);
+            ctx.closePath();
+            ctx.fillStyle = this.fill;
+            ctx.fill();
+        }
+    }
+
+    // Path through `points`, smoothed with Catmull-Rom style control points
+    trace(points) {
+        const ctx = this.context;
+        ctx.moveTo(points[0][0], points[0][1]);
+        for (let i = 1; i < points.length; i++) {
+            const before = points[Math.max(i - 2, 0)];
+            const from = points[i - 1];
+            const to = points[i];
+            const after = points[Math.min(i + 1, points.length - 1)];
+            const t = this.tension / 2;
+            ctx.bezierCurveTo(
+                from[0] + (to[0] - before[0]) * t, from[1] + (to[1] - before[1]) * t,
+                to[0] - (after[0] - from[0]) * t, to[1] - (after[1] - from[1]) * t,
+                to[0], to[1]);
+        }
+    }
+}
@@ -4,6 +4,8 @@ let historyChart = null;
 let currentUnit = 'oz'; // Default unit (fl oz)
 let isConnected = false;
 let lastUpdate = Date.now();
+let lastHistoryUpdate = 0;
+let pendingData = null;
 
 // DOM Elements
 const fluidWeightValue = document.getElementById('fluid-weight-value');
@@ -16,48 +18,15 @@ const connectionStatus = document.getElementById('connection-status');
 
 // Initialize history chart
 function initializeChart() {
-    const ctx = document.getElementById('history-chart').getContext('2d');
-    
-    historyChart = new Chart(ctx, {
-        type: 'line',
-        data: {
-            labels: Array(30).fill(''),
-            datasets: [{
-                label: 'Fluid Weight',
-                data: measurementHistory,
-                borderColor: '#2d7ceb',
-                backgroundColor: 'rgba(45, 124, 235, 0.1)',
-                borderWidth: 2,
-                tension: 0.4,
-                fill: true,
-                pointRadius: 0
-            }]
-        },
-        options: {
-            responsive: true,
-            maintainAspectRatio: false,
-            plugins: {
-                legend: {
-                    display: false
-                },
-                tooltip: {
-                    enabled: false
-                }
-            },
-            scales: {
-                y: {
-                    beginAtZero: true,
-                    display: false
-                },
-                x: {
-                    display: false
-                }
-            },
-            animation: {
-                duration: 800
-            }
-        }
+    historyChart = new LineChart(document.getElementById('history-chart'), {
+        color: '#2d7ceb',
+        fill: 'rgba(45, 124, 235, 0.1)',
+        lineWidth: 2,
+        tension: 0.4,
+        beginAtZero: true
     });
+    historyChart.data = measurementHistory;
+    historyChart.update();
 }
 
 // Format number with 2 decimal places
@@ -72,7 +41,7 @@ function updateHistory(value) {
         measurementHistory.shift();
     }
     
-    historyChart.data.datasets[0].data = measurementHistory;
+    historyChart.data = measurementHistory;
     historyChart.update();
 }
 
@@ -102,6 +71,55 @@ async function fetchMeasurements() {
     }
 }
 
+// Seed the chart from the server's history: the last 30 s at one point per second
+async function loadRecentHistory() {
+    try {
+        const to = Date.now();
+        const response = await fetch(`/api/history?from=${to - 30000}&to=${to}&step=1000`);
+        if (!response.ok) return;
+        
+        const history = await response.json();
+        history.points.forEach(([time, meanGrams]) => {
+            updateHistory(currentUnit === 'oz' ? meanGrams * 0.03527396 : meanGrams);
+        });
+    } catch (error) {
+        console.error('Error loading history:', error);
+    }
+}
+
+// Subscribe to the server's live sample stream. Samples arrive at the
+// sensor's rate; the UI is redrawn at most once per animation frame.
+function connectStream() {
+    const stream = new EventSource('/api/stream');
+    
+    stream.onopen = () => {
+        isConnected = true;
+        connectionStatus.classList.add('connected');
+    };
+    
+    stream.onmessage = (event) => {
+        lastUpdate = Date.now();
+        const first = pendingData === null;
+        pendingData = JSON.parse(event.data);
+        if (first) {
+            requestAnimationFrame(() => {
+                updateUI(pendingData);
+                pendingData = null;
+            });
+        }
+    };
+    
+    // EventSource reconnects on its own; just reflect the state
+    stream.onerror = () => {
+        isConnected = false;
+        connectionStatus.classList.remove('connected');
+        
+        if (Date.now() - lastUpdate > 2000) {
+            showNotification('Connection to scale lost');
+        }
+    };
+}
+
 // Update UI with new measurements
 function updateUI(data) {
     if (!data) return;
@@ -120,7 +138,15 @@ function updateUI(data) {
     containerWeightValue.textContent = formatNumber(containerWeight);
     containerWeightUnit.textContent = unit;
     
-    updateHistory(fluidWeight);
+    // The stream delivers every sample; keep the chart at one point per second
+    if (Date.now() - lastHistoryUpdate >= 1000) {
+        lastHistoryUpdate = Date.now();
+        updateHistory(fluidWeight);
+    }
+    
+    // Dim the reading until the server reports it has settled
+    const fluidWeightContainer = document.getElementById('fluid-weight-container');
+    fluidWeightContainer.classList.toggle('moving', data.stable === false);
     
     if (fluidWeight < 0) {
         fluidWeightValue.classList.add('negative');
@@ -146,10 +172,14 @@ document.getElementById('unit-toggle-button').addEventListener('click', () => {
     showNotification(`Switched to ${currentUnit === 'oz' ? 'fluid ounces' : 'grams'}`);
 });
 
+// Requests that change the scale are POSTs with this header, which the
+// server requires so that pages from other sites cannot send them
+const changeRequest = { method: 'POST', headers: { 'X-Requested-With': 'fetch' } };
+
 // Tare scale
 document.getElementById('tare-button').addEventListener('click', async () => {
     try {
-        const response = await fetch('/api/tare');
+        const response = await fetch('/api/tare', changeRequest);
         if (response.ok) {
             showNotification('Scale tared successfully');
         } else {
@@ -164,7 +194,7 @@ document.getElementById('tare-button').addEventListener('click', async () => {
 // Reset container weight
 document.getElementById('reset-container-button').addEventListener('click', async () => {
     try {
-        const response = await fetch('/api/reset_container');
+        const response = await fetch('/api/reset_container', changeRequest);
         if (response.ok) {
             showNotification('Container weight reset');
         } else {
@@ -194,10 +224,15 @@ document.getElementById('set-container-button').addEventListener('click', () =>
 // Initialize and start periodic updates
 document.addEventListener('DOMContentLoaded', () => {
     initializeChart();
+    loadRecentHistory();
     
-    // Update measurements every second
-    setInterval(async () => {
-        const data = await fetchMeasurements();
-        updateUI(data);
-    }, 1000);
+    if (window.EventSource) {
+        connectStream();
+    } else {
+        // Fall back to polling every second
+        setInterval(async () => {
+            const data = await fetchMeasurements();
+            updateUI(data);
+        }, 1000);
+    }
 });